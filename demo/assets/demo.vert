@@ -2,7 +2,7 @@
 // Based on the shader from tutorial #8 from opengl-tutorial.org
 
 // Input vertex data, different for all executions of this shader.
-layout(location = 0) in vec3 vertexPosition_modelspace;
+layout(location = 0) in vec3 vertexPosition_quantized;
 layout(location = 1) in vec2 vertexUV;
 layout(location = 2) in vec3 vertexNormal_modelspace;
 
@@ -23,10 +23,16 @@ uniform mat4 modelMat;
 uniform mat3 normalMatrix;
 uniform vec3 lightPosWorld;
 uniform vec3 light2PosWorld;
+// Turns the quantized positions back into model space. 0 and 1 for float positions.
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
 
 void main(){
 
+	// Position of the vertex, in modelspace : undo the quantization
+	vec3 vertexPosition_modelspace = positionOffset + positionScale * vertexPosition_quantized;
+
 	// Output position of the vertex, in clip space : modelViewProj * position
 	gl_Position =  modelViewProj * vec4(vertexPosition_modelspace,1);
 	
@@ -0,0 +1,1727 @@
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "loader.h"
+#include "meshopt.h"
+#include "quantize.h"
+#include "meshlet.h"
+#include "simplify.h"
+#include "tangent.h"
+#include "parallel.h"
+#include "meshcache.h"
+#include "glb.h"
+#include "scan.h"
+#include "mipmap.h"
+#include "blockcompress.h"
+#include "texture.h"
+#include "ktx.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stddef.h>
+
+#include <string>
+#include <algorithm>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <time.h>
+#include <sys/resource.h>
+#endif
+
+// Where the demo itself finds its model, relative to x64/Release
+#define BENCH_MODEL_PATH        "../../assets/model.obj"
+#define BENCH_SYNTHETIC_PATH    "bench_synthetic.obj"
+#define BENCH_SYNTHETIC_SIZE    700 // Grid side, 700x700 is ~1M triangles and ~75 MB of text
+#define BENCH_ITERATIONS        3
+
+// argv[0], for the benchmarks that need a fresh process
+static const char * benchExecutable;
+
+// Seconds, from a monotonic high resolution clock.
+// (The std::chrono clocks only tick every millisecond on older MSVC.)
+static double benchTime(){
+#if defined(_WIN32)
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// The most memory this process has ever had resident, in bytes.
+// It never goes down, so compare loaders in separate processes.
+static size_t peakResidentBytes(){
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  return (size_t)usage.ru_maxrss; // bytes
+#else
+  return (size_t)usage.ru_maxrss * 1024; // kilobytes
+#endif
+#endif
+}
+
+static size_t fileSize(const char * path){
+  FILE * file = fopen(path, "rb");
+  if (!file)
+    return 0;
+  fseek(file, 0, SEEK_END);
+  size_t size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+// Writes a wavy side x side grid with one v/vt/vn per grid point and two
+// triangles per cell, formatted like the Blender exporter formats model.obj
+static bool writeSyntheticOBJ(const char * path, int side){
+  FILE * file = fopen(path, "w");
+  if (!file)
+    return false;
+
+  fprintf(file, "# Synthetic %dx%d grid written by the loader benchmark\n", side, side);
+  for (int y = 0; y < side; y++)
+    for (int x = 0; x < side; x++)
+      fprintf(file, "v %f %f %f\n", x / (float)side - 0.5f, 0.1f * sinf(x * 0.05f) * cosf(y * 0.07f), y / (float)side - 0.5f);
+  for (int y = 0; y < side; y++)
+    for (int x = 0; x < side; x++)
+      fprintf(file, "vt %f %f\n", x / (float)(side - 1), y / (float)(side - 1));
+  for (int y = 0; y < side; y++)
+    for (int x = 0; x < side; x++){
+      glm::vec3 n = glm::normalize(glm::vec3(-0.005f * cosf(x * 0.05f) * cosf(y * 0.07f), 1.0f, 0.007f * sinf(x * 0.05f) * sinf(y * 0.07f)));
+      fprintf(file, "vn %f %f %f\n", n.x, n.y, n.z);
+    }
+  for (int y = 0; y + 1 < side; y++)
+    for (int x = 0; x + 1 < side; x++){
+      int a = y * side + x + 1, b = a + 1, c = a + side, d = c + 1;
+      fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b);
+      fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, b, b, c, c, c, d, d, d);
+    }
+
+  fclose(file);
+  return true;
+}
+
+// Runs bench on the model at argv[0], or BENCH_MODEL_PATH, then on a synthetic
+// grid of argv[1], or defaultSide, points a side
+static int benchModelAndGrid(int argc, char ** argv, int defaultSide, bool (*bench)(const char *)){
+  const char * path = argc > 0 ? argv[0] : BENCH_MODEL_PATH;
+  int side = argc > 1 ? atoi(argv[1]) : defaultSide;
+
+  bool ok = bench(path);
+
+  printf("\nWriting %dx%d synthetic grid to %s...\n", side, side, BENCH_SYNTHETIC_PATH);
+  if (!writeSyntheticOBJ(BENCH_SYNTHETIC_PATH, side)){
+    printf("%s could not be written.\n", BENCH_SYNTHETIC_PATH);
+    return 1;
+  }
+  ok = bench(BENCH_SYNTHETIC_PATH) && ok;
+  remove(BENCH_SYNTHETIC_PATH);
+
+  return ok ? 0 : 1;
+}
+
+typedef bool(*OBJLoader)(const char *, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+
+struct LoadedOBJ{
+  std::vector<glm::vec3> vertices;
+  std::vector<glm::vec2> uvs;
+  std::vector<glm::vec3> normals;
+};
+
+// Best of BENCH_ITERATIONS runs, in seconds. Returns a negative time if the loader fails.
+static double timeOBJLoader(OBJLoader loader, const char * path, LoadedOBJ & out_obj){
+  double best = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    out_obj = LoadedOBJ();
+    double start = benchTime();
+    if (!loader(path, out_obj.vertices, out_obj.uvs, out_obj.normals))
+      return -1.0;
+    double elapsed = benchTime() - start;
+    if (best < 0.0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+template <typename T>
+static bool sameBits(const std::vector<T> & a, const std::vector<T> & b){
+  return a.size() == b.size() && (a.empty() || memcmp(&a[0], &b[0], a.size() * sizeof(T)) == 0);
+}
+
+static bool sameOBJ(const LoadedOBJ & a, const LoadedOBJ & b){
+  return sameBits(a.vertices, b.vertices) && sameBits(a.uvs, b.uvs) && sameBits(a.normals, b.normals);
+}
+
+static void reportOBJLoader(const char * name, double seconds, double baseline, size_t bytes){
+  if (seconds < 0.0){
+    printf("  %-10s failed\n", name);
+    return;
+  }
+  printf("  %-10s %9.2f ms %9.1f MB/s %6.2fx\n", name, seconds * 1000.0, bytes / seconds / (1024.0 * 1024.0), baseline / seconds);
+}
+
+// loadOBJ_parallel with the thread count given on the command line
+static unsigned int benchThreads = 0;
+static bool loadOBJ_benchParallel(const char * path, std::vector<glm::vec3> & out_vertices, std::vector<glm::vec2> & out_uvs, std::vector<glm::vec3> & out_normals){
+  return loadOBJ_parallel(path, out_vertices, out_uvs, out_normals, benchThreads);
+}
+
+static bool benchOBJFile(const char * path){
+  size_t bytes = fileSize(path);
+  if (bytes == 0){
+    printf("%s could not be opened.\n", path);
+    return false;
+  }
+
+  LoadedOBJ reference, mapped, reserved, parallel;
+  double fscanfTime = timeOBJLoader(loadOBJ, path, reference);
+  double mappedTime = timeOBJLoader(loadOBJ_mapped, path, mapped);
+  double reservedTime = timeOBJLoader(loadOBJ_reserved, path, reserved);
+  double parallelTime = timeOBJLoader(loadOBJ_benchParallel, path, parallel);
+
+  printf("\n%s : %.1f MB, %u triangles\n", path, bytes / (1024.0 * 1024.0), (unsigned int)(reference.vertices.size() / 3));
+  reportOBJLoader("fscanf", fscanfTime, fscanfTime, bytes);
+  reportOBJLoader("mapped", mappedTime, fscanfTime, bytes);
+  reportOBJLoader("reserved", reservedTime, fscanfTime, bytes);
+  reportOBJLoader("parallel", parallelTime, fscanfTime, bytes);
+
+  bool identical = sameOBJ(reference, mapped) && sameOBJ(reference, reserved) && sameOBJ(reference, parallel);
+  printf("  output %s\n", identical ? "bit-identical" : "DIFFERS from loadOBJ");
+  return identical;
+}
+
+// --bench obj [file.obj] [synthetic grid side] [threads]
+static int benchOBJ(int argc, char ** argv){
+  benchThreads = argc > 2 ? atoi(argv[2]) : 0;
+  return benchModelAndGrid(argc, argv, BENCH_SYNTHETIC_SIZE, benchOBJFile);
+}
+
+struct NamedOBJLoader{
+  const char * name;
+  OBJLoader load;
+};
+
+static const NamedOBJLoader objLoaders[] = {
+  { "fscanf", loadOBJ },
+  { "mapped", loadOBJ_mapped },
+  { "reserved", loadOBJ_reserved },
+  { "parallel", loadOBJ_benchParallel },
+};
+
+// Loads the file once with one loader and reports the peak resident memory
+static int benchOBJMemoryChild(const char * path, const char * loaderName){
+  size_t count = sizeof(objLoaders) / sizeof(objLoaders[0]);
+  for (size_t i = 0; i < count; i++){
+    if (strcmp(objLoaders[i].name, loaderName) != 0)
+      continue;
+
+    size_t before = peakResidentBytes();
+    LoadedOBJ obj;
+    if (!objLoaders[i].load(path, obj.vertices, obj.uvs, obj.normals))
+      return 1;
+    size_t peak = peakResidentBytes();
+    size_t kept = obj.vertices.size() * sizeof(glm::vec3) + obj.uvs.size() * sizeof(glm::vec2) + obj.normals.size() * sizeof(glm::vec3);
+
+    printf("  %-10s peak %8.1f MB, %8.1f MB above startup for %8.1f MB of output\n", loaderName,
+           peak / (1024.0 * 1024.0), (peak - before) / (1024.0 * 1024.0), kept / (1024.0 * 1024.0));
+    fflush(stdout);
+    return 0;
+  }
+  printf("Unknown loader %s\n", loaderName);
+  return 1;
+}
+
+// Peak memory only ever grows, so every loader runs in its own process
+static bool benchOBJMemoryFile(const char * path){
+  // The mapped loaders count the file's pages as resident while they read them
+  printf("\n%s : %.1f MB, peak resident memory\n", path, fileSize(path) / (1024.0 * 1024.0));
+  fflush(stdout);
+
+  bool ok = true;
+  size_t count = sizeof(objLoaders) / sizeof(objLoaders[0]);
+  for (size_t i = 0; i < count; i++){
+    std::string command = std::string("\"") + benchExecutable + "\" --bench objmem \"" + path + "\" " + objLoaders[i].name;
+#if defined(_WIN32)
+    command = "\"" + command + "\""; // cmd.exe strips the outer quotes
+#endif
+    ok = system(command.c_str()) == 0 && ok;
+  }
+  return ok;
+}
+
+// --bench objmem [file.obj] [grid side] [threads], or --bench objmem file.obj loader
+static int benchOBJMemory(int argc, char ** argv){
+  if (argc == 2 && atoi(argv[1]) == 0)
+    return benchOBJMemoryChild(argv[0], argv[1]);
+
+  benchThreads = argc > 2 ? atoi(argv[2]) : 0;
+  return benchModelAndGrid(argc, argv, BENCH_SYNTHETIC_SIZE, benchOBJMemoryFile);
+}
+
+// Every corner of the indexed mesh must still resolve to the attributes loadOBJ gives it
+static bool sameCorners(const LoadedOBJ & soup, const std::vector<unsigned short> & indices, const LoadedOBJ & indexed){
+  if (indices.size() != soup.vertices.size())
+    return false;
+  for (size_t i = 0; i < indices.size(); i++){
+    unsigned int v = indices[i];
+    if (v >= indexed.vertices.size() ||
+        memcmp(&soup.vertices[i], &indexed.vertices[v], sizeof(glm::vec3)) != 0 ||
+        memcmp(&soup.uvs[i], &indexed.uvs[v], sizeof(glm::vec2)) != 0 ||
+        memcmp(&soup.normals[i], &indexed.normals[v], sizeof(glm::vec3)) != 0)
+      return false;
+  }
+  return true;
+}
+
+static bool benchIndexedOBJFile(const char * path){
+  LoadedOBJ soup, indexed, fused;
+  std::vector<unsigned short> indices, fusedIndices;
+  double separateTime = -1.0, fusedTime = -1.0;
+
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    soup = indexed = fused = LoadedOBJ();
+    indices.clear();
+    fusedIndices.clear();
+
+    double start = benchTime();
+    if (!loadOBJ_reserved(path, soup.vertices, soup.uvs, soup.normals))
+      return false;
+    indexVBO(soup.vertices, soup.uvs, soup.normals, indices, indexed.vertices, indexed.uvs, indexed.normals);
+    double middle = benchTime();
+    if (!loadIndexedOBJ(path, fusedIndices, fused.vertices, fused.uvs, fused.normals))
+      return false;
+    double end = benchTime();
+
+    if (separateTime < 0.0 || middle - start < separateTime) separateTime = middle - start;
+    if (fusedTime < 0.0 || end - middle < fusedTime)          fusedTime = end - middle;
+  }
+
+  printf("\n%s : %u triangles\n", path, (unsigned int)(soup.vertices.size() / 3));
+  printf("  loadOBJ_reserved + indexVBO %9.2f ms, %u vertices\n", separateTime * 1000.0, (unsigned int)indexed.vertices.size());
+  printf("  loadIndexedOBJ              %9.2f ms, %u vertices, %.2fx\n", fusedTime * 1000.0, (unsigned int)fused.vertices.size(), separateTime / fusedTime);
+
+  bool ok = sameCorners(soup, fusedIndices, fused);
+  printf("  every corner %s\n", ok ? "matches loadOBJ" : "DIFFERS from loadOBJ");
+  return ok;
+}
+
+// --bench indexedobj [file.obj] [grid side]
+static int benchIndexedOBJ(int argc, char ** argv){
+  // 16-bit indices for now : stay below 65536 vertices
+  return benchModelAndGrid(argc, argv, 180, benchIndexedOBJFile);
+}
+
+// Expands a wavy grid into a triangle soup of about cornerCount corners, the
+// way loadOBJ would : every grid point is repeated in the ~6 corners that use it
+static void makeSyntheticSoup(size_t cornerCount, LoadedOBJ & out_soup){
+  int side = 2;
+  while (6.0 * (side - 1) * (side - 1) < (double)cornerCount)
+    side++;
+
+  out_soup = LoadedOBJ();
+  out_soup.vertices.reserve(cornerCount);
+  out_soup.uvs.reserve(cornerCount);
+  out_soup.normals.reserve(cornerCount);
+  for (int y = 0; y + 1 < side && out_soup.vertices.size() < cornerCount; y++){
+    for (int x = 0; x + 1 < side && out_soup.vertices.size() < cornerCount; x++){
+      static const int cornerX[6] = { 0, 0, 1, 1, 0, 1 }, cornerY[6] = { 0, 1, 0, 0, 1, 1 };
+      for (int c = 0; c < 6; c++){
+        float gx = (float)(x + cornerX[c]), gy = (float)(y + cornerY[c]);
+        out_soup.vertices.push_back(glm::vec3(gx / side - 0.5f, 0.1f * sinf(gx * 0.05f) * cosf(gy * 0.07f), gy / side - 0.5f));
+        out_soup.uvs.push_back(glm::vec2(gx / (side - 1), gy / (side - 1)));
+        out_soup.normals.push_back(glm::normalize(glm::vec3(-0.005f * cosf(gx * 0.05f), 1.0f, 0.007f * sinf(gy * 0.07f))));
+      }
+    }
+  }
+}
+
+typedef void(*VertexIndexer)(std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+                             std::vector<unsigned short> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+
+struct IndexedMesh{
+  std::vector<unsigned short> indices;
+  LoadedOBJ vertices;
+};
+
+// Best of BENCH_ITERATIONS runs, in seconds
+static double timeIndexer(VertexIndexer indexer, LoadedOBJ & soup, IndexedMesh & out_mesh){
+  double best = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    out_mesh = IndexedMesh();
+    double start = benchTime();
+    indexer(soup.vertices, soup.uvs, soup.normals, out_mesh.indices, out_mesh.vertices.vertices, out_mesh.vertices.uvs, out_mesh.vertices.normals);
+    double elapsed = benchTime() - start;
+    if (best < 0.0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+static bool sameIndexedMesh(const IndexedMesh & a, const IndexedMesh & b){
+  return sameBits(a.indices, b.indices) && sameOBJ(a.vertices, b.vertices);
+}
+
+// The brute force indexer is quadratic, don't wait for it on big meshes
+#define BENCH_SLOW_MAX_CORNERS 100000
+
+// Every indexer here writes 16-bit indices : the synthetic soup outgrows them a
+// little under 400000 corners, and --bench pindex takes the bigger meshes
+#define BENCH_INDEX_MAX_VERTICES 65536
+
+// --bench index [max corners]
+static int benchIndex(int argc, char ** argv){
+  size_t maxCorners = argc > 0 ? (size_t)atof(argv[0]) : 100000;
+
+  printf("%10s %10s %12s %12s %12s %8s\n", "corners", "vertices", "slow ms", "map ms", "hash ms", "speedup");
+  bool ok = true;
+  for (size_t corners = 10000; corners <= maxCorners; corners *= 10){
+    LoadedOBJ soup;
+    makeSyntheticSoup(corners, soup);
+
+    IndexedMesh slow, map, hash;
+    double slowTime = corners <= BENCH_SLOW_MAX_CORNERS ? timeIndexer(indexVBO_slow, soup, slow) : -1.0;
+    double mapTime = timeIndexer(indexVBO_map, soup, map);
+    double hashTime = timeIndexer(indexVBO, soup, hash);
+    if (hash.vertices.vertices.size() > BENCH_INDEX_MAX_VERTICES){
+      printf("%10u corners make more vertices than 16-bit indices address, stopping\n", (unsigned int)corners);
+      break;
+    }
+
+    char slowText[32] = "skipped";
+    if (slowTime >= 0.0)
+      sprintf(slowText, "%.2f", slowTime * 1000.0);
+    printf("%10u %10u %12s %12.2f %12.2f %7.2fx\n", (unsigned int)corners, (unsigned int)hash.vertices.vertices.size(),
+           slowText, mapTime * 1000.0, hashTime * 1000.0, mapTime / hashTime);
+
+    if (!sameIndexedMesh(map, hash)){
+      printf("  hash output DIFFERS from the map indexer\n");
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
+
+// Moves every corner by up to amplitude on every attribute, so that shared
+// vertices only match within a tolerance
+static void jitterSoup(LoadedOBJ & soup, float amplitude){
+  unsigned int state = 12345;
+  for (size_t i = 0; i < soup.vertices.size(); i++){
+    float * values[8] = { &soup.vertices[i].x, &soup.vertices[i].y, &soup.vertices[i].z, &soup.uvs[i].x, &soup.uvs[i].y,
+                          &soup.normals[i].x, &soup.normals[i].y, &soup.normals[i].z };
+    for (int j = 0; j < 8; j++){
+      state = state * 1664525 + 1013904223;
+      *values[j] += amplitude * ((state >> 8) / 8388608.0f - 1.0f);
+    }
+  }
+}
+
+static bool benchWeldSoup(const char * name, LoadedOBJ & soup, bool runSlow){
+  IndexedMesh slow, welded;
+  double slowTime = runSlow ? timeIndexer(indexVBO_slow, soup, slow) : -1.0;
+  double weldedTime = timeIndexer(indexVBO_welded, soup, welded);
+
+  char slowText[32] = "skipped";
+  if (slowTime >= 0.0)
+    sprintf(slowText, "%.2f", slowTime * 1000.0);
+  printf("%-16s %10u %10u %12s %12.2f\n", name, (unsigned int)soup.vertices.size(), (unsigned int)welded.vertices.vertices.size(), slowText, weldedTime * 1000.0);
+
+  if (runSlow && !sameIndexedMesh(slow, welded)){
+    printf("  welded output DIFFERS from indexVBO_slow\n");
+    return false;
+  }
+  return true;
+}
+
+// --bench weld [file.obj] [max corners]
+static int benchWeld(int argc, char ** argv){
+  const char * path = argc > 0 ? argv[0] : BENCH_MODEL_PATH;
+  size_t maxCorners = argc > 1 ? (size_t)atof(argv[1]) : 1000000;
+
+  printf("%-16s %10s %10s %12s %12s\n", "mesh", "corners", "vertices", "slow ms", "welded ms");
+  LoadedOBJ model;
+  if (!loadOBJ_mapped(path, model.vertices, model.uvs, model.normals))
+    return 1;
+  bool ok = benchWeldSoup("model.obj", model, true);
+
+  for (size_t corners = 10000; corners <= maxCorners; corners *= 10){
+    LoadedOBJ soup;
+    makeSyntheticSoup(corners, soup);
+    jitterSoup(soup, 0.004f);
+
+    char name[32];
+    sprintf(name, "jittered %uk", (unsigned int)(corners / 1000));
+    ok = benchWeldSoup(name, soup, corners <= BENCH_SLOW_MAX_CORNERS) && ok;
+  }
+  return ok ? 0 : 1;
+}
+
+// Best of BENCH_ITERATIONS runs of the 32-bit indexVBO, or of indexVBO_parallel
+// on threadCount threads when it isn't 0, in seconds
+static double timeIndexer32(LoadedOBJ & soup, unsigned int threadCount, std::vector<unsigned int> & out_indices, LoadedOBJ & out_vertices){
+  double best = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    out_indices.clear();
+    out_vertices = LoadedOBJ();
+    double start = benchTime();
+    if (threadCount == 0)
+      indexVBO(soup.vertices, soup.uvs, soup.normals, out_indices, out_vertices.vertices, out_vertices.uvs, out_vertices.normals);
+    else
+      indexVBO_parallel(soup.vertices, soup.uvs, soup.normals, out_indices, out_vertices.vertices, out_vertices.uvs, out_vertices.normals, threadCount);
+    double elapsed = benchTime() - start;
+    if (best < 0.0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+// --bench pindex [corners] [max threads]
+static int benchParallelIndex(int argc, char ** argv){
+  size_t corners = argc > 0 ? (size_t)atof(argv[0]) : 10000000;
+  unsigned int maxThreads = argc > 1 ? atoi(argv[1]) : 16;
+
+  LoadedOBJ soup;
+  makeSyntheticSoup(corners, soup);
+
+  std::vector<unsigned int> serialIndices;
+  LoadedOBJ serialVertices;
+  double serialTime = timeIndexer32(soup, 0, serialIndices, serialVertices);
+  printf("%u corners, %u vertices\n", (unsigned int)soup.vertices.size(), (unsigned int)serialVertices.vertices.size());
+  printf("%10s %12s %10s\n", "threads", "ms", "speedup");
+  printf("%10s %12.2f %10s\n", "indexVBO", serialTime * 1000.0, "1.00x");
+
+  bool ok = true;
+  for (unsigned int threads = 1; threads <= maxThreads; threads *= 2){
+    std::vector<unsigned int> indices;
+    LoadedOBJ vertices;
+    double best = timeIndexer32(soup, threads, indices, vertices);
+    printf("%10u %12.2f %9.2fx\n", threads, best * 1000.0, serialTime / best);
+
+    // Exactly the same output as indexVBO, whatever the thread count
+    if (!sameBits(indices, serialIndices) || !sameOBJ(vertices, serialVertices)){
+      printf("  output DIFFERS from indexVBO\n");
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
+
+static bool lessTriangle(const glm::uvec3 & a, const glm::uvec3 & b){
+  if (a.x != b.x) return a.x < b.x;
+  if (a.y != b.y) return a.y < b.y;
+  return a.z < b.z;
+}
+
+// Triangles as sorted triples, to check that a reordering lost or invented none
+static void sortedTriangles(const std::vector<unsigned int> & indices, std::vector<glm::uvec3> & out_triangles){
+  out_triangles.resize(indices.size() / 3);
+  for (size_t t = 0; t < out_triangles.size(); t++){
+    unsigned int a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+    // Rotate the smallest index first, which keeps the winding
+    if (b < a && b <= c)      out_triangles[t] = glm::uvec3(b, c, a);
+    else if (c < a && c < b)  out_triangles[t] = glm::uvec3(c, a, b);
+    else                      out_triangles[t] = glm::uvec3(a, b, c);
+  }
+  std::sort(out_triangles.begin(), out_triangles.end(), lessTriangle);
+}
+
+static bool benchVertexCacheFile(const char * path){
+  std::vector<unsigned int> indices;
+  LoadedOBJ mesh;
+  if (!loadIndexedOBJ(path, indices, mesh.vertices, mesh.uvs, mesh.normals))
+    return false;
+  size_t vertexCount = mesh.vertices.size();
+
+  VertexCacheStats before = analyzeVertexCache(&indices[0], indices.size(), vertexCount);
+
+  std::vector<unsigned int> optimized;
+  double best = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    optimized = indices;
+    double start = benchTime();
+    optimizeVertexCache(&optimized[0], optimized.size(), vertexCount);
+    double elapsed = benchTime() - start;
+    if (best < 0.0 || elapsed < best)
+      best = elapsed;
+  }
+
+  VertexCacheStats after = analyzeVertexCache(&optimized[0], optimized.size(), vertexCount);
+
+  printf("\n%s : %u triangles, %u vertices, FIFO cache of %d\n", path, (unsigned int)(indices.size() / 3), (unsigned int)vertexCount, VERTEX_CACHE_SIZE);
+  printf("  %-12s %12s %8s %8s\n", "", "transformed", "ACMR", "ATVR");
+  printf("  %-12s %12u %8.3f %8.3f\n", "OBJ order", before.transformedVertices, before.acmr, before.atvr);
+  printf("  %-12s %12u %8.3f %8.3f\n", "Tipsify", after.transformedVertices, after.acmr, after.atvr);
+  printf("  %.1f%% fewer vertex shader invocations, optimized in %.2f ms\n",
+    100.0 * (1.0 - after.transformedVertices / (double)before.transformedVertices), best * 1000.0);
+
+  std::vector<glm::uvec3> a, b;
+  sortedTriangles(indices, a);
+  sortedTriangles(optimized, b);
+  bool ok = a == b;
+  printf("  triangles %s\n", ok ? "are the same, reordered" : "DIFFER");
+
+  // Vertices renumbered in first use order, on top of Tipsify
+  std::vector<unsigned int> fetchOrdered = optimized, remap;
+  double start = benchTime();
+  size_t fetchVertexCount = optimizeVertexFetch(&fetchOrdered[0], fetchOrdered.size(), vertexCount, remap);
+  LoadedOBJ remapped = mesh;
+  remapVertices(remapped.vertices, remap, fetchVertexCount);
+  remapVertices(remapped.uvs, remap, fetchVertexCount);
+  remapVertices(remapped.normals, remap, fetchVertexCount);
+  double fetchTime = benchTime() - start;
+
+  // Position stream, the other two follow the same pattern
+  size_t stride = sizeof(glm::vec3);
+  VertexFetchStats fetchBefore = analyzeVertexFetch(&indices[0], indices.size(), vertexCount, stride);
+  VertexFetchStats fetchTipsify = analyzeVertexFetch(&optimized[0], optimized.size(), vertexCount, stride);
+  VertexFetchStats fetchAfter = analyzeVertexFetch(&fetchOrdered[0], fetchOrdered.size(), fetchVertexCount, stride);
+  printf("  vertex fetch, %d lines of %d bytes, %u-byte vertices\n", VERTEX_FETCH_LINES, VERTEX_FETCH_LINE_SIZE, (unsigned int)stride);
+  printf("  %-12s %12s %8s\n", "", "bytes", "overfetch");
+  printf("  %-12s %12u %8.3f\n", "OBJ order", fetchBefore.bytesFetched, fetchBefore.overfetch);
+  printf("  %-12s %12u %8.3f\n", "Tipsify", fetchTipsify.bytesFetched, fetchTipsify.overfetch);
+  printf("  %-12s %12u %8.3f\n", "+ remap", fetchAfter.bytesFetched, fetchAfter.overfetch);
+  printf("  remapped in %.2f ms\n", fetchTime * 1000.0);
+
+  bool same = analyzeVertexCache(&fetchOrdered[0], fetchOrdered.size(), fetchVertexCount).transformedVertices == after.transformedVertices;
+  for (size_t i = 0; same && i < optimized.size(); i++){
+    unsigned int from = optimized[i], to = fetchOrdered[i];
+    same = mesh.vertices[from] == remapped.vertices[to] && mesh.uvs[from] == remapped.uvs[to] && mesh.normals[from] == remapped.normals[to];
+  }
+  printf("  every corner %s\n", same ? "keeps its vertex after the remap" : "DIFFERS after the remap");
+  return ok && same;
+}
+
+// --bench vcache [file.obj] [grid side]
+static int benchVertexCache(int argc, char ** argv){
+  // Stands in for a big scan : long rows, so OBJ order falls out of the cache between rows
+  return benchModelAndGrid(argc, argv, BENCH_SYNTHETIC_SIZE, benchVertexCacheFile);
+}
+
+static void reportOverdraw(const char * name, const std::vector<unsigned int> & indices, const LoadedOBJ & mesh){
+  VertexCacheStats cache = analyzeVertexCache(&indices[0], indices.size(), mesh.vertices.size());
+  OverdrawStats overdraw = analyzeOverdraw(&indices[0], indices.size(), mesh.vertices);
+  printf("  %-12s %8.3f %12u %12u %9.3f\n", name, cache.acmr, overdraw.shadedFragments, overdraw.coveredPixels, overdraw.overdraw);
+}
+
+static bool benchOverdrawFile(const char * path){
+  std::vector<unsigned int> indices;
+  LoadedOBJ mesh;
+  if (!loadIndexedOBJ(path, indices, mesh.vertices, mesh.uvs, mesh.normals))
+    return false;
+
+  std::vector<unsigned int> tipsify = indices;
+  optimizeVertexCache(&tipsify[0], tipsify.size(), mesh.vertices.size());
+
+  std::vector<unsigned int> sorted;
+  double best = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    sorted = tipsify;
+    double start = benchTime();
+    optimizeOverdraw(&sorted[0], sorted.size(), mesh.vertices);
+    double elapsed = benchTime() - start;
+    if (best < 0.0 || elapsed < best)
+      best = elapsed;
+  }
+
+  printf("\n%s : %u triangles, %d views of %dx%d\n", path, (unsigned int)(indices.size() / 3), 6, OVERDRAW_VIEW_SIZE, OVERDRAW_VIEW_SIZE);
+  printf("  %-12s %8s %12s %12s %9s\n", "", "ACMR", "fragments", "pixels", "overdraw");
+  reportOverdraw("OBJ order", indices, mesh);
+  reportOverdraw("Tipsify", tipsify, mesh);
+  reportOverdraw("+ overdraw", sorted, mesh);
+  printf("  sorted in %.2f ms\n", best * 1000.0);
+
+  std::vector<glm::uvec3> a, b;
+  sortedTriangles(indices, a);
+  sortedTriangles(sorted, b);
+  bool ok = a == b;
+  printf("  triangles %s\n", ok ? "are the same, reordered" : "DIFFER");
+  return ok;
+}
+
+// --bench overdraw [file.obj] [grid side]
+static int benchOverdraw(int argc, char ** argv){
+  return benchModelAndGrid(argc, argv, 300, benchOverdrawFile);
+}
+
+static bool benchQuantizeFile(const char * path){
+  std::vector<unsigned int> indices;
+  std::vector<PackedVertex> vertices;
+  if (!loadIndexedOBJ(path, indices, vertices))
+    return false;
+
+  QuantizationBounds bounds = computeQuantizationBounds(vertices);
+  std::vector<QuantizedVertex> quantized, reference;
+  double simdTime = -1.0, glmTime = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    double start = benchTime();
+    quantizeVertices(vertices, bounds, quantized);
+    double middle = benchTime();
+    quantizeVertices_glm(vertices, bounds, reference);
+    double end = benchTime();
+    if (simdTime < 0.0 || middle - start < simdTime) simdTime = middle - start;
+    if (glmTime < 0.0 || end - middle < glmTime)     glmTime = end - middle;
+  }
+
+  // Bounding box diagonal, to put the position error in perspective
+  glm::vec3 extent = bounds.scale * 65534.0f;
+  float diagonal = glm::length(extent);
+
+  QuantizationError error = measureQuantizationError(vertices, quantized, bounds);
+  printf("\n%s : %u vertices, %u bytes -> %u bytes\n", path, (unsigned int)vertices.size(),
+    (unsigned int)(vertices.size() * sizeof(PackedVertex)), (unsigned int)(quantized.size() * sizeof(QuantizedVertex)));
+  printf("  quantizeVertices     %9.3f ms\n", simdTime * 1000.0);
+  printf("  quantizeVertices_glm %9.3f ms, %.2fx\n", glmTime * 1000.0, glmTime / simdTime);
+  printf("  position error : max %g, mean %g (%.5f%% of the bounding box diagonal)\n",
+    error.maxPosition, error.meanPosition, 100.0 * error.maxPosition / diagonal);
+  printf("  normal error : max %.3f degrees\n", error.maxNormal);
+  printf("  uv error : max %g\n", error.maxUV);
+
+  // Rounding ties may go either way, anything else must match glm
+  unsigned int different = 0;
+  for (size_t i = 0; i < quantized.size(); i++)
+    different += memcmp(&quantized[i], &reference[i], sizeof(QuantizedVertex)) != 0;
+  QuantizationError referenceError = measureQuantizationError(vertices, reference, bounds);
+  bool ok = error.maxPosition <= referenceError.maxPosition * 1.01f && error.maxNormal <= referenceError.maxNormal * 1.01f + 0.01f && error.maxUV <= referenceError.maxUV;
+  printf("  %u vertices differ from quantizeVertices_glm, errors %s\n", different, ok ? "match" : "are LARGER");
+  return ok;
+}
+
+// --bench quantize [file.obj] [grid side]
+static int benchQuantize(int argc, char ** argv){
+  return benchModelAndGrid(argc, argv, BENCH_SYNTHETIC_SIZE, benchQuantizeFile);
+}
+
+// A culled meshlet must not have a single triangle that is both front facing
+// and, for all the frustum knows, inside it
+static bool culledCorrectly(const Meshlet & meshlet, const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & positions, const MeshletCulling & culling){
+  for (size_t i = meshlet.indexOffset; i < meshlet.indexOffset + meshlet.indexCount; i += 3){
+    glm::vec3 a = positions[indices[i]], b = positions[indices[i + 1]], c = positions[indices[i + 2]];
+    bool frontFacing = glm::dot(glm::cross(b - a, c - a), a - culling.cameraPosition) < 0.0f;
+    bool outside = false;
+    for (int p = 0; p < 6 && !outside; p++){
+      glm::vec3 n(culling.planes[p]);
+      float d = culling.planes[p].w;
+      outside = glm::dot(n, a) + d < 0.0f && glm::dot(n, b) + d < 0.0f && glm::dot(n, c) + d < 0.0f;
+    }
+    if (frontFacing && !outside)
+      return false;
+  }
+  return true;
+}
+
+static bool benchMeshletsFile(const char * path){
+  std::vector<unsigned int> indices;
+  std::vector<glm::vec3> positions, normals;
+  std::vector<glm::vec2> uvs;
+  if (!loadIndexedOBJ(path, indices, positions, uvs, normals))
+    return false;
+  optimizeVertexCache(&indices[0], indices.size(), positions.size());
+
+  SubMesh whole = { 0, (unsigned int)indices.size(), 0, (unsigned int)positions.size() };
+  std::vector<Meshlet> meshlets;
+  std::vector<unsigned int> cacheOrder = indices;
+  double best = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    meshlets.clear();
+    indices = cacheOrder;
+    double start = benchTime();
+    buildMeshlets(indices, positions, whole, meshlets);
+    double elapsed = benchTime() - start;
+    if (best < 0.0 || elapsed < best)
+      best = elapsed;
+  }
+
+  // Every triangle exactly once, within the limits
+  std::vector<glm::uvec3> a, b;
+  sortedTriangles(cacheOrder, a);
+  sortedTriangles(indices, b);
+  bool ok = a == b;
+  unsigned int next = 0, vertexTotal = 0;
+  for (size_t i = 0; i < meshlets.size(); i++){
+    ok = ok && meshlets[i].indexOffset == next && meshlets[i].vertexCount <= MESHLET_MAX_VERTICES && meshlets[i].indexCount <= MESHLET_MAX_TRIANGLES * 3;
+    next += meshlets[i].indexCount;
+    vertexTotal += meshlets[i].vertexCount;
+  }
+  ok = ok && next == indices.size();
+
+  printf("\n%s : %u triangles, %u meshlets built in %.2f ms\n", path, (unsigned int)(indices.size() / 3), (unsigned int)meshlets.size(), best * 1000.0);
+  printf("  %.1f vertices and %.1f triangles per meshlet on average\n",
+    vertexTotal / (double)meshlets.size(), indices.size() / 3.0 / meshlets.size());
+  VertexCacheStats before = analyzeVertexCache(&cacheOrder[0], cacheOrder.size(), positions.size());
+  VertexCacheStats after = analyzeVertexCache(&indices[0], indices.size(), positions.size());
+  printf("  ACMR %.3f in vertex cache order, %.3f in meshlets\n", before.acmr, after.acmr);
+
+  // Look at the mesh from 6 sides, close enough that parts of it leave the frustum
+  glm::vec3 minimum = positions[0], maximum = positions[0];
+  for (size_t i = 0; i < positions.size(); i++){
+    minimum = glm::min(minimum, positions[i]);
+    maximum = glm::max(maximum, positions[i]);
+  }
+  glm::vec3 center = (minimum + maximum) * 0.5f;
+  float size = glm::length(maximum - minimum);
+  glm::mat4 proj = glm::perspective(45.0f, 16.0f / 9.0f, size * 0.01f, size * 10.0f);
+  glm::vec3 directions[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0.01f), glm::vec3(0, -1, 0.01f), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+
+  printf("  %-10s %10s %10s %10s\n", "view", "visible", "triangles", "culled");
+  for (int d = 0; d < 6; d++){
+    glm::mat4 modelView = glm::lookAt(center + directions[d] * size * 0.8f, center, glm::vec3(0, 1, 0));
+    MeshletCulling culling;
+    setupMeshletCulling(modelView, proj * modelView, culling);
+
+    unsigned int visible = 0, triangles = 0;
+    for (size_t i = 0; i < meshlets.size(); i++){
+      if (isMeshletVisible(meshlets[i], culling)){
+        visible++;
+        triangles += meshlets[i].indexCount / 3;
+      }
+      else if (!culledCorrectly(meshlets[i], indices, positions, culling)){
+        printf("  meshlet %u was culled but has a visible triangle\n", (unsigned int)i);
+        ok = false;
+      }
+    }
+    printf("  %-10d %10u %10u %9.1f%%\n", d, visible, triangles, 100.0 * (1.0 - triangles / (indices.size() / 3.0)));
+  }
+
+  printf("  meshlets %s\n", ok ? "cover every triangle once and cull conservatively" : "are WRONG");
+  return ok;
+}
+
+// --bench meshlets [file.obj] [grid side]
+static int benchMeshlets(int argc, char ** argv){
+  return benchModelAndGrid(argc, argv, 300, benchMeshletsFile);
+}
+
+// Best of BENCH_ITERATIONS runs of generateLODs on threadCount threads, in seconds
+static double timeLODs(const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & positions, unsigned int threadCount,
+                       std::vector<unsigned int> & out_indices, std::vector<MeshLOD> & out_lods){
+  double best = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    out_indices = indices;
+    double start = benchTime();
+    generateLODs(out_indices, positions, out_lods, threadCount);
+    double elapsed = benchTime() - start;
+    if (best < 0.0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+static bool benchLODFile(const char * path){
+  std::vector<unsigned int> indices;
+  LoadedOBJ mesh;
+  if (!loadIndexedOBJ(path, indices, mesh.vertices, mesh.uvs, mesh.normals))
+    return false;
+  optimizeVertexCache(&indices[0], indices.size(), mesh.vertices.size());
+
+  std::vector<unsigned int> serialIndices, parallelIndices;
+  std::vector<MeshLOD> serialLODs, lods;
+  double serialTime = timeLODs(indices, mesh.vertices, 1, serialIndices, serialLODs);
+  double parallelTime = timeLODs(indices, mesh.vertices, 0, parallelIndices, lods);
+
+  printf("\n%s : %u triangles, %u vertices\n", path, (unsigned int)(indices.size() / 3), (unsigned int)mesh.vertices.size());
+  printf("  %u levels in %.2f ms on one thread, %.2f ms on one per level, %.2fx\n",
+    (unsigned int)lods.size(), serialTime * 1000.0, parallelTime * 1000.0, serialTime / parallelTime);
+
+  // Where each level takes over, seen through the demo's camera
+  glm::vec3 minimum = mesh.vertices[0], maximum = mesh.vertices[0];
+  for (size_t i = 0; i < mesh.vertices.size(); i++){
+    minimum = glm::min(minimum, mesh.vertices[i]);
+    maximum = glm::max(maximum, mesh.vertices[i]);
+  }
+  float size = glm::length(maximum - minimum);
+  glm::mat4 proj = glm::perspective(45.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+  float pixelsPerUnitAt1 = proj[1][1] * 720.0f * 0.5f;
+
+  printf("  %-6s %10s %8s %12s %16s\n", "level", "triangles", "kept", "error", "from distance");
+  bool ok = serialIndices == parallelIndices;
+  for (size_t l = 0; l < lods.size(); l++){
+    const MeshLOD & lod = lods[l];
+    printf("  %-6u %10u %7.1f%% %11.3f%% %13.2f x size\n", (unsigned int)l, lod.indexCount / 3, 100.0 * lod.indexCount / lods[0].indexCount,
+      100.0 * lod.error / size, lod.error * pixelsPerUnitAt1 / size);
+    for (size_t i = lod.indexOffset; i < lod.indexOffset + lod.indexCount; i += 3){
+      unsigned int a = parallelIndices[i], b = parallelIndices[i + 1], c = parallelIndices[i + 2];
+      ok = ok && a < mesh.vertices.size() && b < mesh.vertices.size() && c < mesh.vertices.size() && a != b && b != c && c != a;
+    }
+    ok = ok && (l == 0 || lod.indexCount < lods[l - 1].indexCount);
+  }
+  ok = ok && std::equal(indices.begin(), indices.end(), parallelIndices.begin());
+  printf("  levels %s\n", ok ? "index the full mesh's vertices and match on every thread count" : "are WRONG");
+  return ok;
+}
+
+// --bench lod [file.obj] [grid side]
+static int benchLOD(int argc, char ** argv){
+  return benchModelAndGrid(argc, argv, 300, benchLODFile);
+}
+
+struct TangentMesh{
+  std::vector<unsigned short> shortIndices;
+  std::vector<unsigned int> indices;
+  LoadedOBJ mesh;
+  std::vector<glm::vec3> tangents, bitangents;
+};
+
+static bool benchTangentsFile(const char * path){
+  LoadedOBJ soup;
+  if (!loadOBJ_reserved(path, soup.vertices, soup.uvs, soup.normals))
+    return false;
+
+  std::vector<glm::vec3> tangents, bitangents;
+  double serialTime = -1.0, parallelTime = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    double start = benchTime();
+    computeTangentBasis(soup.vertices, soup.uvs, soup.normals, tangents, bitangents, 1);
+    double middle = benchTime();
+    computeTangentBasis(soup.vertices, soup.uvs, soup.normals, tangents, bitangents, benchThreads);
+    double end = benchTime();
+    if (serialTime < 0.0 || middle - start < serialTime)  serialTime = middle - start;
+    if (parallelTime < 0.0 || end - middle < parallelTime) parallelTime = end - middle;
+  }
+
+  // The welding indexer only has 16-bit indices
+  std::vector<unsigned short> probe;
+  LoadedOBJ plain;
+  indexVBO(soup.vertices, soup.uvs, soup.normals, probe, plain.vertices, plain.uvs, plain.normals);
+  bool runWelded = plain.vertices.size() <= 65536;
+
+  TangentMesh welded, fast;
+  double weldedTime = -1.0, fastTime = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    welded = fast = TangentMesh();
+    double start = benchTime();
+    if (runWelded)
+      indexVBO_TBN(soup.vertices, soup.uvs, soup.normals, tangents, bitangents, welded.shortIndices,
+                   welded.mesh.vertices, welded.mesh.uvs, welded.mesh.normals, welded.tangents, welded.bitangents);
+    double middle = benchTime();
+    indexVBO_TBN_fast(soup.vertices, soup.uvs, soup.normals, tangents, bitangents, fast.indices,
+                      fast.mesh.vertices, fast.mesh.uvs, fast.mesh.normals, fast.tangents, fast.bitangents);
+    double end = benchTime();
+    if (weldedTime < 0.0 || middle - start < weldedTime) weldedTime = middle - start;
+    if (fastTime < 0.0 || end - middle < fastTime)       fastTime = end - middle;
+  }
+
+  printf("\n%s : %u triangles\n", path, (unsigned int)(soup.vertices.size() / 3));
+  printf("  computeTangentBasis  %9.2f ms on one thread, %9.2f ms on %u, %.2fx\n",
+    serialTime * 1000.0, parallelTime * 1000.0, workerCount(benchThreads), serialTime / parallelTime);
+  if (runWelded)
+    printf("  indexVBO_TBN         %9.2f ms, %u vertices\n", weldedTime * 1000.0, (unsigned int)welded.mesh.vertices.size());
+  printf("  indexVBO_TBN_fast    %9.2f ms, %u vertices (%u more for mirrored uvs)",
+    fastTime * 1000.0, (unsigned int)fast.mesh.vertices.size(), (unsigned int)(fast.mesh.vertices.size() - plain.vertices.size()));
+  // indexVBO_TBN welds vertices within 0.01 of each other, the fast one only
+  // merges equal ones : timing them against each other only means something
+  // when that made no difference
+  if (runWelded && welded.mesh.vertices.size() == plain.vertices.size())
+    printf(", %.2fx", weldedTime / fastTime);
+  else if (runWelded)
+    printf(", not comparable : indexVBO_TBN welded %u near vertices",
+      (unsigned int)(plain.vertices.size() - welded.mesh.vertices.size()));
+  printf("\n");
+
+  // Orthonormal around the normal, and on the side of the bitangent of every corner
+  bool ok = true;
+  for (size_t v = 0; v < fast.mesh.vertices.size(); v++){
+    glm::vec3 n = glm::normalize(fast.mesh.normals[v]), t = fast.tangents[v], b = fast.bitangents[v];
+    bool sided = glm::length(glm::cross(n, t) - b) < 1e-3f || glm::length(glm::cross(n, t) + b) < 1e-3f;
+    ok = ok && fabsf(glm::length(t) - 1.0f) < 1e-3f && fabsf(glm::dot(n, t)) < 1e-3f && sided;
+  }
+  for (size_t i = 0; i < soup.vertices.size(); i++){
+    unsigned int v = fast.indices[i];
+    ok = ok && (glm::dot(glm::cross(soup.normals[i], tangents[i]), bitangents[i]) < 0.0f) == (glm::dot(glm::cross(fast.mesh.normals[v], fast.tangents[v]), fast.bitangents[v]) < 0.0f);
+  }
+  printf("  tangent frames %s\n", ok ? "are orthonormal and keep the handedness of their corners" : "are WRONG");
+  return ok;
+}
+
+// --bench tbn [file.obj] [grid side] [threads]
+static int benchTangents(int argc, char ** argv){
+  benchThreads = argc > 2 ? atoi(argv[2]) : 0;
+  // indexVBO_TBN is 16-bit, and welds within 0.01 : a grid spacing, 1 / side,
+  // above that keeps every grid point for both indexers
+  return benchModelAndGrid(argc, argv, 90, benchTangentsFile);
+}
+
+// Copies a file, so that the benchmark can touch it without touching the asset
+static bool copyFile(const char * from, const char * to){
+  MappedFile source;
+  if (!mapFile(from, source))
+    return false;
+  FILE * file = fopen(to, "wb");
+  bool ok = file && (source.size == 0 || fwrite(source.data, 1, source.size, file) == source.size);
+  ok = file && fclose(file) == 0 && ok;
+  unmapFile(source);
+  return ok;
+}
+
+// What a warm start gets out of the cache, and a stand-in for glBufferData
+struct CachedMesh{
+  std::vector<unsigned int> indices;
+  std::vector<PackedVertex> vertices;
+};
+
+static bool readMeshCache(const char * cachePath, const char * sourcePath, CachedMesh & out_mesh){
+  MeshCache cache;
+  if (!openMeshCache(cachePath, sourcePath, 0, cache))
+    return false;
+  const MeshCacheBlock * indices = findMeshCacheBlock(cache.blocks, 0);
+  const MeshCacheBlock * vertices = findMeshCacheBlock(cache.blocks, 1);
+  bool ok = indices && vertices;
+  if (ok){
+    out_mesh.indices.assign((const unsigned int *)indices->data, (const unsigned int *)indices->data + indices->size / sizeof(unsigned int));
+    out_mesh.vertices.assign((const PackedVertex *)vertices->data, (const PackedVertex *)vertices->data + vertices->size / sizeof(PackedVertex));
+  }
+  closeMeshCache(cache);
+  return ok;
+}
+
+static bool benchMeshCacheFile(const char * path){
+  std::string sourcePath = std::string(path) + ".bench.obj";
+  std::string cachePath = meshCachePath(sourcePath.c_str());
+  if (!copyFile(path, sourcePath.c_str()))
+    return false;
+
+  // Cold : parse, index, write the cache. Warm : validate, map, copy out.
+  CachedMesh cold, warm;
+  double coldTime = -1.0, warmTime = -1.0;
+  bool ok = true;
+  for (int i = 0; ok && i < BENCH_ITERATIONS; i++){
+    cold = warm = CachedMesh();
+    remove(cachePath.c_str());
+
+    double start = benchTime();
+    ok = loadIndexedOBJ(sourcePath.c_str(), cold.indices, cold.vertices);
+    std::vector<MeshCacheBlock> blocks;
+    blocks.push_back(meshCacheBlock(0, cold.indices));
+    blocks.push_back(meshCacheBlock(1, cold.vertices));
+    ok = ok && writeMeshCache(cachePath.c_str(), sourcePath.c_str(), 0, blocks);
+    double middle = benchTime();
+    ok = ok && readMeshCache(cachePath.c_str(), sourcePath.c_str(), warm);
+    double end = benchTime();
+
+    if (coldTime < 0.0 || middle - start < coldTime) coldTime = middle - start;
+    if (warmTime < 0.0 || end - middle < warmTime)   warmTime = end - middle;
+  }
+  ok = ok && cold.indices == warm.indices && sameBits(cold.vertices, warm.vertices);
+
+  // Same size and modification time, other contents : only the hash can tell
+  CachedMesh stale;
+  MappedFile source;
+  bool mapped = mapFile(sourcePath.c_str(), source);
+  std::string contents = mapped && source.size > 0 ? std::string(source.data, source.size) : std::string();
+  unmapFile(source);
+  bool rejected = false;
+  if (!contents.empty()){
+    contents[contents.size() - 1] = contents[contents.size() - 1] == '\n' ? ' ' : '\n';
+    FILE * file = fopen(sourcePath.c_str(), "r+b");
+    if (file){
+      fwrite(contents.data(), 1, contents.size(), file);
+      fclose(file);
+    }
+    rejected = !readMeshCache(cachePath.c_str(), sourcePath.c_str(), stale);
+  }
+
+  printf("\n%s : %u triangles, %u vertices, %u-byte cache\n", path, (unsigned int)(cold.indices.size() / 3),
+    (unsigned int)cold.vertices.size(), (unsigned int)fileSize(cachePath.c_str()));
+  printf("  cold : loadIndexedOBJ + writeMeshCache %9.2f ms\n", coldTime * 1000.0);
+  printf("  warm : openMeshCache + copy            %9.2f ms, %.1fx faster\n", warmTime * 1000.0, coldTime / warmTime);
+  printf("  cached buffers %s, edited source %s\n", ok ? "match" : "DIFFER", rejected ? "rejected" : "NOT REJECTED");
+
+  remove(cachePath.c_str());
+  remove(sourcePath.c_str());
+  return ok && rejected;
+}
+
+// --bench meshcache [file.obj] [grid side]
+static int benchMeshCache(int argc, char ** argv){
+  return benchModelAndGrid(argc, argv, BENCH_SYNTHETIC_SIZE, benchMeshCacheFile);
+}
+
+// Writes mesh as a .glb, with its own vertex streams, or with the PackedVertex
+// array as one interleaved buffer view. 16-bit indices when they fit.
+static bool writeGLB(const char * path, const std::vector<unsigned int> & indices, const std::vector<PackedVertex> & vertices, bool interleaved){
+  bool shortIndices = vertices.size() <= 65536;
+  std::string bin;
+  size_t vertexBytes = vertices.size() * sizeof(PackedVertex);
+  if (interleaved)
+    bin.append((const char *)&vertices[0], vertexBytes);
+  else{
+    for (size_t i = 0; i < vertices.size(); i++) bin.append((const char *)&vertices[i].position, 12);
+    for (size_t i = 0; i < vertices.size(); i++) bin.append((const char *)&vertices[i].normal, 12);
+    for (size_t i = 0; i < vertices.size(); i++) bin.append((const char *)&vertices[i].uv, 8);
+  }
+  for (size_t i = 0; i < indices.size(); i++){
+    unsigned short shortIndex = (unsigned short)indices[i];
+    bin.append(shortIndices ? (const char *)&shortIndex : (const char *)&indices[i], shortIndices ? 2 : 4);
+  }
+  while (bin.size() % 4)
+    bin.push_back('\0');
+
+  // Accessors 0, 1, 2 are the position, normal and uv, 3 the indices
+  unsigned int count = (unsigned int)vertices.size();
+  char json[2048];
+  if (interleaved)
+    sprintf(json, "{\"asset\":{\"version\":\"2.0\"},\"buffers\":[{\"byteLength\":%u}],\"bufferViews\":["
+      "{\"buffer\":0,\"byteLength\":%u,\"byteStride\":%u},{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u}],\"accessors\":["
+      "{\"bufferView\":0,\"byteOffset\":%u,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},"
+      "{\"bufferView\":0,\"byteOffset\":%u,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},"
+      "{\"bufferView\":0,\"byteOffset\":%u,\"componentType\":5126,\"count\":%u,\"type\":\"VEC2\"},",
+      (unsigned int)bin.size(), (unsigned int)vertexBytes, (unsigned int)sizeof(PackedVertex), (unsigned int)vertexBytes, (unsigned int)(bin.size() - vertexBytes),
+      (unsigned int)offsetof(PackedVertex, position), count, (unsigned int)offsetof(PackedVertex, normal), count, (unsigned int)offsetof(PackedVertex, uv), count);
+  else
+    sprintf(json, "{\"asset\":{\"version\":\"2.0\"},\"buffers\":[{\"byteLength\":%u}],\"bufferViews\":["
+      "{\"buffer\":0,\"byteLength\":%u},{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u},"
+      "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u},{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u}],\"accessors\":["
+      "{\"bufferView\":0,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},"
+      "{\"bufferView\":1,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},"
+      "{\"bufferView\":2,\"componentType\":5126,\"count\":%u,\"type\":\"VEC2\"},",
+      (unsigned int)bin.size(), count * 12, count * 12, count * 12, count * 24, count * 8, count * 32, (unsigned int)(bin.size() - count * 32),
+      count, count, count);
+  sprintf(json + strlen(json), "{\"bufferView\":%d,\"componentType\":%d,\"count\":%u,\"type\":\"SCALAR\"}],"
+    "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":3,\"mode\":4}]}]}",
+    interleaved ? 1 : 3, shortIndices ? 5123 : 5125, (unsigned int)indices.size());
+  std::string text = json;
+  while (text.size() % 4)
+    text.push_back(' ');
+
+  unsigned int header[5] = { 0x46546c67, 2, (unsigned int)(12 + 8 + text.size() + 8 + bin.size()), (unsigned int)text.size(), 0x4e4f534a };
+  unsigned int binHeader[2] = { (unsigned int)bin.size(), 0x004e4942 };
+  FILE * file = fopen(path, "wb");
+  if (!file)
+    return false;
+  bool ok = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(text.data(), 1, text.size(), file) == text.size() &&
+    fwrite(binHeader, sizeof(binHeader), 1, file) == 1 && fwrite(bin.data(), 1, bin.size(), file) == bin.size();
+  return fclose(file) == 0 && ok;
+}
+
+// Whether stream, stride bytes per element, holds the member at offset of every vertex
+static bool sameGLBStream(const GLBMesh & mesh, GLBStream stream, const std::vector<PackedVertex> & vertices, size_t offset, size_t size){
+  const GLBPrimitive & primitive = mesh.primitives[0];
+  if (primitive.vertexCount != vertices.size())
+    return false;
+  for (size_t i = 0; i < vertices.size(); i++)
+    if (memcmp(primitive.streams[stream].data + i * mesh.strides[stream], (const char *)&vertices[i] + offset, size) != 0)
+      return false;
+  return true;
+}
+
+static bool sameGLBIndices(const GLBMesh & mesh, const std::vector<unsigned int> & indices){
+  const GLBPrimitive & primitive = mesh.primitives[0];
+  if (primitive.indexCount != indices.size())
+    return false;
+  for (size_t i = 0; i < indices.size(); i++){
+    unsigned int index;
+    if (mesh.indexType == GL_UNSIGNED_SHORT){
+      unsigned short shortIndex;
+      memcpy(&shortIndex, primitive.streams[GLB_INDICES].data + i * 2, 2);
+      index = shortIndex;
+    }
+    else
+      memcpy(&index, primitive.streams[GLB_INDICES].data + i * 4, 4);
+    if (index != indices[i])
+      return false;
+  }
+  return true;
+}
+
+static bool benchGLBFile(const char * path){
+  std::vector<unsigned int> indices;
+  std::vector<PackedVertex> vertices;
+  double objTime = -1.0;
+  bool ok = true;
+  for (int i = 0; ok && i < BENCH_ITERATIONS; i++){
+    indices.clear(), vertices.clear();
+    double start = benchTime();
+    ok = loadIndexedOBJ(path, indices, vertices);
+    double end = benchTime();
+    if (objTime < 0.0 || end - start < objTime) objTime = end - start;
+  }
+  if (!ok)
+    return false;
+  printf("\n%s : %u triangles, %u vertices\n", path, (unsigned int)(indices.size() / 3), (unsigned int)vertices.size());
+  printf("  loadIndexedOBJ               %9.2f ms\n", objTime * 1000.0);
+
+  // loadGLB, and a copy of every range standing in for glBufferData
+  std::string glbPath = std::string(path) + ".bench.glb";
+  for (int interleaved = 0; interleaved < 2; interleaved++){
+    ok = writeGLB(glbPath.c_str(), indices, vertices, interleaved != 0) && ok;
+    GLBMesh mesh;
+    std::vector<char> uploaded[GLB_STREAM_COUNT];
+    double glbTime = -1.0;
+    bool loaded = true;
+    for (int i = 0; loaded && i < BENCH_ITERATIONS; i++){
+      double start = benchTime();
+      loaded = loadGLB(glbPath.c_str(), mesh);
+      for (int s = 0; loaded && s < GLB_STREAM_COUNT; s++)
+        uploaded[s].assign(mesh.primitives[0].streams[s].data, mesh.primitives[0].streams[s].data + mesh.primitives[0].streams[s].size);
+      double end = benchTime();
+      if (glbTime < 0.0 || end - start < glbTime) glbTime = end - start;
+      if (loaded && i + 1 < BENCH_ITERATIONS)
+        closeGLB(mesh);
+    }
+
+    bool same = loaded && mesh.primitives.size() == 1 &&
+      sameGLBStream(mesh, GLB_POSITIONS, vertices, offsetof(PackedVertex, position), 12) &&
+      sameGLBStream(mesh, GLB_NORMALS, vertices, offsetof(PackedVertex, normal), 12) &&
+      sameGLBStream(mesh, GLB_UVS, vertices, offsetof(PackedVertex, uv), 8) &&
+      sameGLBIndices(mesh, indices);
+    printf("  loadGLB + copy, %-11s %9.2f ms, %.1fx faster, %u-bit indices, %u-byte file, ranges %s\n",
+      interleaved ? "interleaved" : "separate", glbTime * 1000.0, objTime / glbTime, loaded && mesh.indexType == GL_UNSIGNED_SHORT ? 16 : 32,
+      (unsigned int)fileSize(glbPath.c_str()), same ? "match" : "DIFFER");
+    if (loaded)
+      closeGLB(mesh);
+    ok = ok && same;
+  }
+  remove(glbPath.c_str());
+  return ok;
+}
+
+// --bench glb [file.obj] [grid side]
+static int benchGLB(int argc, char ** argv){
+  return benchModelAndGrid(argc, argv, BENCH_SYNTHETIC_SIZE, benchGLBFile);
+}
+
+// Appends value to out, in the byte order asked for
+template <typename T>
+static void appendBytes(std::string & out, T value, bool bigEndian){
+  char bytes[sizeof(T)];
+  memcpy(bytes, &value, sizeof(T));
+  unsigned int one = 1;
+  if (bigEndian == (*(unsigned char *)&one == 1))
+    std::reverse(bytes, bytes + sizeof(T));
+  out.append(bytes, sizeof(T));
+}
+
+// Writes mesh as a binary PLY, with a per-vertex property and an element the
+// loader has to skip
+static bool writePLY(const char * path, const std::vector<unsigned int> & indices, const std::vector<PackedVertex> & vertices, bool bigEndian){
+  char header[512];
+  sprintf(header, "ply\nformat %s 1.0\ncomment written by the benchmark\nelement vertex %u\n"
+    "property float x\nproperty float y\nproperty float z\nproperty uchar confidence\nproperty float nx\nproperty float ny\nproperty float nz\n"
+    "property float s\nproperty float t\nelement face %u\nproperty list uchar int vertex_indices\nelement camera 1\nproperty list uchar float view\nend_header\n",
+    bigEndian ? "binary_big_endian" : "binary_little_endian", (unsigned int)vertices.size(), (unsigned int)(indices.size() / 3));
+  std::string data = header;
+  for (size_t i = 0; i < vertices.size(); i++){
+    const PackedVertex & vertex = vertices[i];
+    appendBytes(data, vertex.position.x, bigEndian), appendBytes(data, vertex.position.y, bigEndian), appendBytes(data, vertex.position.z, bigEndian);
+    appendBytes(data, (unsigned char)255, bigEndian);
+    appendBytes(data, vertex.normal.x, bigEndian), appendBytes(data, vertex.normal.y, bigEndian), appendBytes(data, vertex.normal.z, bigEndian);
+    appendBytes(data, vertex.uv.x, bigEndian), appendBytes(data, vertex.uv.y, bigEndian);
+  }
+  for (size_t i = 0; i + 2 < indices.size(); i += 3){
+    appendBytes(data, (unsigned char)3, bigEndian);
+    for (int c = 0; c < 3; c++)
+      appendBytes(data, (int)indices[i + c], bigEndian);
+  }
+  appendBytes(data, (unsigned char)2, bigEndian), appendBytes(data, 1.0f, bigEndian), appendBytes(data, 2.0f, bigEndian);
+
+  FILE * file = fopen(path, "wb");
+  bool ok = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+  return file && fclose(file) == 0 && ok;
+}
+
+// Writes the triangles of mesh as a binary STL, every corner on its own
+static bool writeSTL(const char * path, const std::vector<unsigned int> & indices, const std::vector<PackedVertex> & vertices){
+  std::string data(80, ' ');
+  appendBytes(data, (unsigned int)(indices.size() / 3), false);
+  for (size_t i = 0; i + 2 < indices.size(); i += 3){
+    glm::vec3 a = vertices[indices[i]].position, b = vertices[indices[i + 1]].position, c = vertices[indices[i + 2]].position;
+    glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+    data.append((const char *)&normal, 12);
+    data.append((const char *)&a, 12), data.append((const char *)&b, 12), data.append((const char *)&c, 12);
+    data.append(2, '\0');
+  }
+  FILE * file = fopen(path, "wb");
+  bool ok = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+  return file && fclose(file) == 0 && ok;
+}
+
+// Whether both meshes have the same triangles at the same places
+static bool sameTrianglePositions(const std::vector<unsigned int> & indicesA, const std::vector<PackedVertex> & verticesA,
+  const std::vector<unsigned int> & indicesB, const std::vector<PackedVertex> & verticesB){
+  if (indicesA.size() != indicesB.size())
+    return false;
+  for (size_t i = 0; i < indicesA.size(); i++)
+    if (verticesA[indicesA[i]].position != verticesB[indicesB[i]].position)
+      return false;
+  return true;
+}
+
+static bool benchScanFile(const char * path){
+  std::vector<unsigned int> indices;
+  std::vector<PackedVertex> vertices;
+  double objTime = benchTime();
+  if (!loadIndexedOBJ(path, indices, vertices))
+    return false;
+  objTime = benchTime() - objTime;
+
+  std::string scanPath = std::string(path) + ".bench";
+  const char * names[] = { "PLY, little endian", "PLY, big endian", "STL" };
+  double times[3];
+  bool same[3];
+  size_t sizes[3], weldedCount = 0;
+  for (int format = 0; format < 3; format++){
+    bool ok = format < 2 ? writePLY(scanPath.c_str(), indices, vertices, format == 1) : writeSTL(scanPath.c_str(), indices, vertices);
+    sizes[format] = fileSize(scanPath.c_str());
+    std::vector<unsigned int> scanIndices;
+    std::vector<PackedVertex> scanVertices;
+    times[format] = -1.0;
+    for (int i = 0; ok && i < BENCH_ITERATIONS; i++){
+      double start = benchTime();
+      ok = format < 2 ? loadPLY(scanPath.c_str(), scanIndices, scanVertices) : loadSTL(scanPath.c_str(), scanIndices, scanVertices);
+      double end = benchTime();
+      if (times[format] < 0.0 || end - start < times[format]) times[format] = end - start;
+    }
+    // PLY keeps the vertices as they are, STL only the triangles' positions
+    same[format] = ok && (format < 2 ? scanIndices == indices && sameBits(scanVertices, vertices) :
+      sameTrianglePositions(scanIndices, scanVertices, indices, vertices));
+    if (format == 2)
+      weldedCount = scanVertices.size();
+    remove(scanPath.c_str());
+  }
+
+  printf("\n%s : %u triangles, %u vertices\n", path, (unsigned int)(indices.size() / 3), (unsigned int)vertices.size());
+  printf("  loadIndexedOBJ               %9.2f ms, %9u-byte file\n", objTime * 1000.0, (unsigned int)fileSize(path));
+  for (int format = 0; format < 3; format++)
+    printf("  %-20s         %9.2f ms, %9u-byte file, %.1fx faster, mesh %s\n", names[format], times[format] * 1000.0,
+      (unsigned int)sizes[format], objTime / times[format], same[format] ? "matches" : "DIFFERS");
+  printf("  STL welded into %u vertices\n", (unsigned int)weldedCount);
+  return same[0] && same[1] && same[2];
+}
+
+// --bench scan [file.obj] [grid side]
+static int benchScan(int argc, char ** argv){
+  return benchModelAndGrid(argc, argv, BENCH_SYNTHETIC_SIZE, benchScanFile);
+}
+
+// Budget for --bench stream, in MB, unless given
+#define BENCH_STREAM_BUDGET 16
+
+// Every batch, put back together into one mesh with 32-bit indices
+struct StreamedOBJ{
+  std::vector<unsigned int> indices;
+  std::vector<PackedVertex> vertices;
+  size_t batchCount;
+};
+
+static bool collectBatch(const OBJBatch & batch, void * user){
+  StreamedOBJ & mesh = *(StreamedOBJ *)user;
+  if (batch.firstVertex != mesh.vertices.size() || batch.firstIndex != mesh.indices.size())
+    return false;
+  for (size_t i = 0; i < batch.indexCount; i++)
+    mesh.indices.push_back((unsigned int)batch.firstVertex + batch.indices[i]);
+  mesh.vertices.insert(mesh.vertices.end(), batch.vertices, batch.vertices + batch.vertexCount);
+  mesh.batchCount++;
+  return true;
+}
+
+// Stands in for the GPU or the cache : the batches go to a file
+static bool writeBatch(const OBJBatch & batch, void * user){
+  FILE * file = (FILE *)user;
+  return fwrite(batch.vertices, sizeof(PackedVertex), batch.vertexCount, file) == batch.vertexCount &&
+    fwrite(batch.indices, sizeof(unsigned int), batch.indexCount, file) == batch.indexCount;
+}
+
+// Loads the file once, whole (budget 0) or streamed, and reports the peak resident memory
+static int benchStreamChild(const char * path, int budgetMB){
+  size_t before = peakResidentBytes();
+  std::vector<unsigned int> indices;
+  std::vector<PackedVertex> vertices;
+  std::string outputPath = std::string(path) + ".batches.tmp";
+  FILE * output = NULL;
+  bool ok;
+  if (budgetMB == 0)
+    ok = loadIndexedOBJ(path, indices, vertices);
+  else{
+    output = fopen(outputPath.c_str(), "wb");
+    ok = output && streamOBJ(path, (size_t)budgetMB << 20, writeBatch, output);
+    if (output)
+      fclose(output);
+    remove(outputPath.c_str());
+  }
+  size_t peak = peakResidentBytes();
+
+  char name[64];
+  if (budgetMB == 0) sprintf(name, "loadIndexedOBJ");
+  else               sprintf(name, "streamOBJ, %d MB", budgetMB);
+  printf("  %-18s peak %8.1f MB, %8.1f MB above startup\n", name, peak / (1024.0 * 1024.0), (peak - before) / (1024.0 * 1024.0));
+  fflush(stdout);
+  return ok ? 0 : 1;
+}
+
+// The budget given on the command line
+static int benchBudgetMB = BENCH_STREAM_BUDGET;
+
+static bool benchStreamFile(const char * path){
+  int budgetMB = benchBudgetMB;
+  std::vector<unsigned int> indices;
+  std::vector<PackedVertex> vertices;
+  double wholeTime = benchTime();
+  bool ok = loadIndexedOBJ(path, indices, vertices);
+  wholeTime = benchTime() - wholeTime;
+
+  StreamedOBJ streamed;
+  streamed.batchCount = 0;
+  double streamTime = benchTime();
+  ok = streamOBJ(path, (size_t)budgetMB << 20, collectBatch, &streamed) && ok;
+  streamTime = benchTime() - streamTime;
+
+  // Batches repeat the vertices they share : compare corner by corner
+  bool same = ok && streamed.indices.size() == indices.size();
+  for (size_t i = 0; same && i < indices.size(); i++)
+    same = memcmp(&streamed.vertices[streamed.indices[i]], &vertices[indices[i]], sizeof(PackedVertex)) == 0;
+
+  printf("\n%s : %.1f MB, %u triangles, %u vertices\n", path, fileSize(path) / (1024.0 * 1024.0),
+    (unsigned int)(indices.size() / 3), (unsigned int)vertices.size());
+  printf("  loadIndexedOBJ              %9.2f ms\n", wholeTime * 1000.0);
+  printf("  streamOBJ, %3d MB budget    %9.2f ms, %u batches, %u vertices, corners %s\n", budgetMB, streamTime * 1000.0,
+    (unsigned int)streamed.batchCount, (unsigned int)streamed.vertices.size(), same ? "match" : "DIFFER");
+  fflush(stdout);
+
+  // Peak memory only ever grows : one process each
+  for (int child = 0; child < 2; child++){
+    char arguments[64];
+    sprintf(arguments, " child %d", child == 0 ? 0 : budgetMB);
+    std::string command = std::string("\"") + benchExecutable + "\" --bench stream \"" + path + "\"" + arguments;
+#if defined(_WIN32)
+    command = "\"" + command + "\""; // cmd.exe strips the outer quotes
+#endif
+    ok = system(command.c_str()) == 0 && ok;
+  }
+  return ok && same;
+}
+
+// --bench stream [file.obj] [grid side] [budget MB], or --bench stream file.obj child budget
+static int benchStream(int argc, char ** argv){
+  if (argc == 3 && strcmp(argv[1], "child") == 0)
+    return benchStreamChild(argv[0], atoi(argv[2]));
+
+  benchBudgetMB = argc > 2 ? atoi(argv[2]) : BENCH_STREAM_BUDGET;
+  if (benchBudgetMB < OBJ_STREAM_MIN_BUDGET >> 20)
+    benchBudgetMB = OBJ_STREAM_MIN_BUDGET >> 20;
+  return benchModelAndGrid(argc, argv, BENCH_SYNTHETIC_SIZE, benchStreamFile);
+}
+
+#define BENCH_TEXTURE_PATH      "../../assets/texture.bmp"
+#define BENCH_MIPMAP_SIZE       2048 // Side of the synthetic image
+
+// Average light of a level, 0..1
+static double averageLight(const unsigned char * chain, const MipLevel & level){
+  double sum = 0.0;
+  size_t rowSize = mipRowSize(level.width);
+  for (unsigned int y = 0; y < level.height; y++)
+    for (unsigned int i = 0; i < level.width * 3; i++){
+      double c = chain[level.offset + y * rowSize + i] / 255.0;
+      sum += c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+    }
+  return sum / ((double)level.width * level.height * 3);
+}
+
+static bool benchMipmapImage(const char * name, const DecodedImage & image, unsigned int threadCount){
+  std::vector<MipLevel> levels;
+  size_t chainSize = mipChainLayout(image.width, image.height, levels);
+  if (image.pixels.size() < levels[0].size){
+    printf("%s is shorter than its header says\n", name);
+    return false;
+  }
+
+  std::vector<unsigned char> chain(chainSize), serial(chainSize), reference(chainSize), encoded(chainSize);
+  double parallelTime = -1.0, serialTime = -1.0, referenceTime = -1.0, encodedTime = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    double start = benchTime();
+    generateMipChain(&image.pixels[0], &chain[0], levels, threadCount);
+    double afterParallel = benchTime();
+    generateMipChain(&image.pixels[0], &serial[0], levels, 1);
+    double afterSerial = benchTime();
+    generateMipChain_reference(&image.pixels[0], &reference[0], levels);
+    double afterReference = benchTime();
+    generateMipChain_encoded(&image.pixels[0], &encoded[0], levels);
+    double end = benchTime();
+    if (parallelTime < 0.0 || afterParallel - start < parallelTime)           parallelTime = afterParallel - start;
+    if (serialTime < 0.0 || afterSerial - afterParallel < serialTime)         serialTime = afterSerial - afterParallel;
+    if (referenceTime < 0.0 || afterReference - afterSerial < referenceTime)  referenceTime = afterReference - afterSerial;
+    if (encodedTime < 0.0 || end - afterReference < encodedTime)              encodedTime = end - afterReference;
+  }
+
+  int maxDifference = 0;
+  size_t different = 0;
+  for (size_t i = levels[1 % levels.size()].offset; i < chainSize; i++){
+    int difference = abs((int)chain[i] - (int)reference[i]);
+    maxDifference = std::max(maxDifference, difference);
+    different += difference != 0;
+  }
+  bool ok = maxDifference <= 1 && chain == serial;
+
+  printf("\n%s : %ux%u, %u levels, %u bytes\n", name, image.width, image.height, (unsigned int)levels.size(), (unsigned int)chainSize);
+  printf("  generateMipChain, %2u threads %9.3f ms\n", workerCount(threadCount), parallelTime * 1000.0);
+  printf("  generateMipChain,  1 thread  %9.3f ms, %.2fx\n", serialTime * 1000.0, serialTime / parallelTime);
+  printf("  generateMipChain_reference    %9.3f ms, %.2fx\n", referenceTime * 1000.0, referenceTime / parallelTime);
+  printf("  generateMipChain_encoded      %9.3f ms, %.2fx (what glGenerateMipmap does on GL_RGB8)\n", encodedTime * 1000.0, encodedTime / parallelTime);
+  printf("  %u bytes differ from the reference, by at most %d%s\n", (unsigned int)different, maxDifference,
+    chain == serial ? "" : ", threads CHANGE the result");
+
+  // A box filter must keep the light of the image, level after level
+  const MipLevel & last = levels.back();
+  printf("  average light : level 0 %.4f, 1x1 level %.4f in linear light, %.4f averaging encoded values\n",
+    averageLight(&chain[0], levels[0]), averageLight(&chain[0], last), averageLight(&encoded[0], last));
+  return ok;
+}
+
+// Alternating black and white texels, the worst case for averaging encoded
+// values : linear light averages them to sRGB 188, encoded values to 128
+static void makeCheckerImage(unsigned int side, DecodedImage & out_image){
+  out_image.width = out_image.height = side;
+  size_t rowSize = mipRowSize(side);
+  out_image.pixels.assign(rowSize * side, 0);
+  for (unsigned int y = 0; y < side; y++)
+    for (unsigned int x = 0; x < side; x++)
+      if ((x ^ y) & 1)
+        memset(&out_image.pixels[y * rowSize + x * 3], 255, 3);
+}
+
+// --bench mipmap [image.bmp] [side] [threads]
+static int benchMipmap(int argc, char ** argv){
+  const char * path = argc > 0 ? argv[0] : BENCH_TEXTURE_PATH;
+  int side = argc > 1 ? atoi(argv[1]) : BENCH_MIPMAP_SIZE;
+  unsigned int threadCount = argc > 2 ? atoi(argv[2]) : 0;
+
+  DecodedImage image;
+  bool ok = decodeBMP(path, image) && benchMipmapImage(path, image, threadCount);
+
+  char name[64];
+  sprintf(name, "%dx%d checkerboard", side, side);
+  makeCheckerImage(side, image);
+  ok = benchMipmapImage(name, image, threadCount) && ok;
+
+  return ok ? 0 : 1;
+}
+
+// Root mean square error of level l of blocks against the same level of chain
+static double blockError(const unsigned char * chain, const std::vector<MipLevel> & levels, const unsigned char * blocks,
+                         const std::vector<MipLevel> & blockLevels, BlockFormat format, size_t l){
+  const MipLevel & level = levels[l];
+  size_t rowSize = mipRowSize(level.width), bytes = blockBytes(format);
+  unsigned int blocksWide = (level.width + 3) / 4;
+  double sum = 0.0;
+  unsigned char pixels[16 * 3];
+  for (unsigned int y = 0; y < level.height; y += 4)
+    for (unsigned int x = 0; x < level.width; x += 4){
+      const unsigned char * block = blocks + blockLevels[l].offset + ((y / 4) * blocksWide + x / 4) * bytes;
+      if (format == BLOCK_BC1)
+        decompressBlockBC1(block, pixels);
+      else if (!decompressBlockBC7(block, pixels))
+        return -1.0;
+      for (unsigned int j = 0; j < 4 && y + j < level.height; j++)
+        for (unsigned int i = 0; i < 4 && x + i < level.width; i++)
+          for (int c = 0; c < 3; c++){
+            double d = (double)pixels[(j * 4 + i) * 3 + c] - chain[level.offset + (y + j) * rowSize + (x + i) * 3 + 2 - c];
+            sum += d * d;
+          }
+    }
+  return sqrt(sum / ((double)level.width * level.height * 3));
+}
+
+static bool benchBlockFormat(const char * path, BlockFormat format, unsigned int threadCount){
+  const char * name = format == BLOCK_BC1 ? "BC1" : "BC7";
+  DecodedImage image;
+  if (!decodeBMP(path, image))
+    return false;
+  std::vector<MipLevel> levels, blockLevels;
+  size_t chainSize = mipChainLayout(image.width, image.height, levels);
+  if (image.pixels.size() < levels[0].size){
+    printf("%s is shorter than its header says\n", path);
+    return false;
+  }
+  image.pixels.resize(chainSize);
+  generateMipChain(&image.pixels[0], &image.pixels[0], levels, 0);
+
+  std::vector<unsigned char> blocks(compressedChainLayout(levels, format, blockLevels)), serial(blocks.size());
+  double parallelTime = -1.0, serialTime = -1.0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++){
+    double start = benchTime();
+    compressMipChain(&image.pixels[0], levels, format, &blocks[0], blockLevels, threadCount);
+    double middle = benchTime();
+    compressMipChain(&image.pixels[0], levels, format, &serial[0], blockLevels, 1);
+    double end = benchTime();
+    if (parallelTime < 0.0 || middle - start < parallelTime) parallelTime = middle - start;
+    if (serialTime < 0.0 || end - middle < serialTime)       serialTime = end - middle;
+  }
+
+  // What a launch costs : compressing and writing the cache, then mapping it
+  std::string cachePath = textureCachePath(path, format);
+  remove(cachePath.c_str());
+  CompressedChain chain;
+  double coldTime = benchTime();
+  bool ok = loadCompressedChain(path, format, chain);
+  coldTime = benchTime() - coldTime;
+  bool cold = ok && !chain.built.empty();
+  closeCompressedChain(chain);
+  double warmTime = benchTime();
+  ok = loadCompressedChain(path, format, chain) && ok;
+  warmTime = benchTime() - warmTime;
+  bool warm = ok && chain.built.empty() && memcmp(chain.blocks, &blocks[0], blocks.size()) == 0;
+  closeCompressedChain(chain);
+  remove(cachePath.c_str());
+
+  double error = blockError(&image.pixels[0], levels, &blocks[0], blockLevels, format, 0);
+  printf("  %s : %u bytes, %.1f%% of the RGB8 chain, level 0 RMSE %.3f (PSNR %.2f dB)\n", name, (unsigned int)blocks.size(),
+    100.0 * blocks.size() / chainSize, error, 20.0 * log10(255.0 / error));
+  printf("    compressMipChain, %2u threads %9.3f ms\n", workerCount(threadCount), parallelTime * 1000.0);
+  printf("    compressMipChain,  1 thread  %9.3f ms, %.2fx\n", serialTime * 1000.0, serialTime / parallelTime);
+  printf("    loadCompressedChain, cold    %9.3f ms (decode, mip chain, compress, write the cache)\n", coldTime * 1000.0);
+  printf("    loadCompressedChain, warm    %9.3f ms (map the cache), %.0fx\n", warmTime * 1000.0, coldTime / warmTime);
+
+  ok = ok && error >= 0.0 && blocks == serial && cold && warm;
+  if (!ok)
+    printf("    FAILED : %s\n", error < 0.0 ? "blocks that are not mode 6" : blocks != serial ? "threads change the blocks" :
+      !cold ? "the cold load did not compress" : "the warm load did not map the same blocks");
+  return ok;
+}
+
+// --bench blocks [image.bmp] [threads]
+static int benchBlocks(int argc, char ** argv){
+  const char * path = argc > 0 ? argv[0] : BENCH_TEXTURE_PATH;
+  unsigned int threadCount = argc > 1 ? atoi(argv[1]) : 0;
+
+  printf("\n%s\n", path);
+  bool ok = benchBlockFormat(path, BLOCK_BC1, threadCount);
+  ok = benchBlockFormat(path, BLOCK_BC7, threadCount) && ok;
+  return ok ? 0 : 1;
+}
+
+#define BENCH_KTX_PATH          "bench_texture.ktx"
+
+static bool benchKTXFormat(const char * path, const char * name, GLenum internalFormat){
+  double convertTime = benchTime();
+  bool ok = convertBMPToKTX(path, BENCH_KTX_PATH, internalFormat);
+  convertTime = benchTime() - convertTime;
+  if (!ok)
+    return false;
+
+  // What the demo does with a BMP before it can upload : decode and mipmap, in
+  // linear light for the sRGB formats
+  KTXFormat format;
+  ktxFormat(internalFormat, GL_RGB, format);
+  DecodedImage image;
+  std::vector<MipLevel> levels;
+  double bmpTime = benchTime();
+  ok = decodeBMP(path, image);
+  size_t chainSize = mipChainLayout(image.width, image.height, levels);
+  image.pixels.resize(std::max(chainSize, image.pixels.size()));
+  if (format.srgb)
+    generateMipChain(&image.pixels[0], &image.pixels[0], levels, 0);
+  else
+    generateMipChain_encoded(&image.pixels[0], &image.pixels[0], levels);
+  bmpTime = benchTime() - bmpTime;
+
+  KTXImage ktx;
+  double ktxTime = benchTime();
+  ok = loadKTX(BENCH_KTX_PATH, ktx) && ok;
+  ktxTime = benchTime() - ktxTime;
+
+  // The levels must be the chain the BMP makes : byte for byte for RGB8, block
+  // for block for the compressed formats
+  bool same = ok && ktx.levels.size() == levels.size() && ktx.format.internalFormat == internalFormat;
+  std::vector<MipLevel> blockLevels;
+  std::vector<unsigned char> blocks;
+  if (same && ktx.format.compressed){
+    BlockFormat format = ktx.format.bytesPerPixel == 8 ? BLOCK_BC1 : BLOCK_BC7;
+    blocks.resize(compressedChainLayout(levels, format, blockLevels));
+    compressMipChain(&image.pixels[0], levels, format, &blocks[0], blockLevels, 0);
+  }
+  for (size_t l = 0; same && l < levels.size(); l++){
+    const unsigned char * level = (const unsigned char *)ktx.file.data + ktx.levels[l].offset;
+    if (ktx.format.compressed){
+      same = ktx.levels[l].size == blockLevels[l].size && memcmp(level, &blocks[blockLevels[l].offset], blockLevels[l].size) == 0;
+      continue;
+    }
+    size_t rowSize = mipRowSize(levels[l].width);
+    same = ktx.levels[l].size == levels[l].size;
+    for (unsigned int y = 0; same && y < levels[l].height; y++)
+      for (unsigned int x = 0; same && x < levels[l].width * 3; x++)
+        same = level[y * rowSize + x] == image.pixels[levels[l].offset + y * rowSize + (x / 3) * 3 + 2 - x % 3];
+  }
+
+  printf("  %-5s %9u bytes, convertBMPToKTX %9.3f ms, loadKTX %7.3f ms, decodeBMP + mip chain %8.3f ms, %s\n",
+    name, (unsigned int)ktx.file.size, convertTime * 1000.0, ktxTime * 1000.0, bmpTime * 1000.0,
+    same ? "same levels" : "levels DIFFER");
+  closeKTX(ktx);
+  remove(BENCH_KTX_PATH);
+  return ok && same;
+}
+
+// --bench ktx [image.bmp]
+static int benchKTX(int argc, char ** argv){
+  const char * path = argc > 0 ? argv[0] : BENCH_TEXTURE_PATH;
+
+  printf("\n%s\n", path);
+  bool ok = benchKTXFormat(path, "srgb8", GL_SRGB8);
+  ok = benchKTXFormat(path, "rgb8", GL_RGB8) && ok;
+  ok = benchKTXFormat(path, "bc1s", GL_COMPRESSED_SRGB_S3TC_DXT1_EXT) && ok;
+  ok = benchKTXFormat(path, "bc1", GL_COMPRESSED_RGB_S3TC_DXT1_EXT) && ok;
+  ok = benchKTXFormat(path, "bc7s", GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM) && ok;
+  ok = benchKTXFormat(path, "bc7", GL_COMPRESSED_RGBA_BPTC_UNORM) && ok;
+  return ok ? 0 : 1;
+}
+
+struct Benchmark{
+  const char * name;
+  const char * usage;
+  int(*run)(int argc, char ** argv);
+};
+
+static const Benchmark benchmarks[] = {
+  { "obj", "obj [file.obj] [grid side] [threads]    loadOBJ against the mapped, reserved and parallel loaders", benchOBJ },
+  { "indexedobj", "indexedobj [file.obj] [grid side]    loadOBJ + indexVBO against loadIndexedOBJ", benchIndexedOBJ },
+  { "index", "index [max corners]    indexVBO_slow and indexVBO_map against the hashed indexVBO", benchIndex },
+  { "weld", "weld [file.obj] [max corners]    indexVBO_slow against the grid-based indexVBO_welded", benchWeld },
+  { "pindex", "pindex [corners] [max threads]    indexVBO against indexVBO_parallel on 1, 2, 4... threads", benchParallelIndex },
+  { "vcache", "vcache [file.obj] [grid side]    ACMR/ATVR and vertex fetch of OBJ order against Tipsify + remap", benchVertexCache },
+  { "overdraw", "overdraw [file.obj] [grid side]    CPU rasterized overdraw of OBJ order, Tipsify and optimizeOverdraw", benchOverdraw },
+  { "quantize", "quantize [file.obj] [grid side]    SSE2 against glm vertex quantization, and its error", benchQuantize },
+  { "meshlets", "meshlets [file.obj] [grid side]    meshlet building, and how much cone and frustum culling drop from 6 views", benchMeshlets },
+  { "lod", "lod [file.obj] [grid side]    quadric simplification into levels of detail, serial against one thread per level", benchLOD },
+  { "tbn", "tbn [file.obj] [grid side] [threads]    parallel computeTangentBasis, and indexVBO_TBN against indexVBO_TBN_fast", benchTangents },
+  { "meshcache", "meshcache [file.obj] [grid side]    cold loadIndexedOBJ against a warm start from the binary mesh cache", benchMeshCache },
+  { "glb", "glb [file.obj] [grid side]    loadIndexedOBJ against loadGLB on the same mesh, separate and interleaved", benchGLB },
+  { "scan", "scan [file.obj] [grid side]    loadIndexedOBJ against loadPLY and loadSTL on the same mesh", benchScan },
+  { "stream", "stream [file.obj] [grid side] [budget MB]    loadIndexedOBJ against streamOBJ, time and peak resident memory", benchStream },
+  { "mipmap", "mipmap [image.bmp] [side] [threads]    generateMipChain against a powf reference and averaging encoded bytes", benchMipmap },
+  { "blocks", "blocks [image.bmp] [threads]    BC1 and BC7 compression of a mip chain, its error, and a cold against a cached load", benchBlocks },
+  { "ktx", "ktx [image.bmp]    convertBMPToKTX to RGB8, BC1 and BC7, linear and sRGB, and loadKTX against decoding and mipmapping the BMP", benchKTX },
+  { "objmem", "objmem [file.obj] [grid side] [threads] peak resident memory of every OBJ loader", benchOBJMemory },
+};
+
+int runBenchmarks(const char * executable, int argc, char ** argv){
+  benchExecutable = executable;
+
+  size_t count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+  for (size_t i = 0; i < count; i++){
+    if (argc > 0 && strcmp(argv[0], benchmarks[i].name) == 0)
+      return benchmarks[i].run(argc - 1, argv + 1);
+  }
+
+  printf("Usage: demo --bench <benchmark> [arguments]\n");
+  for (size_t i = 0; i < count; i++)
+    printf("  %s\n", benchmarks[i].usage);
+  return 1;
+}
@@ -0,0 +1,9 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Runs the loader benchmarks instead of the demo. executable is argv[0], some
+// benchmarks run themselves in a fresh process. args are whatever followed
+// "--bench" on the command line, e.g. "obj" or "obj path/to/file.obj".
+int runBenchmarks(const char * executable, int argc, char ** argv);
+
+#endif
@@ -0,0 +1,489 @@
+#include <vector>
+#include <algorithm>
+
+#include "blockcompress.h"
+#include "parallel.h"
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCKCOMPRESS_SSE2
+#include <emmintrin.h>
+#endif
+
+// Rounds of single steps tried on every endpoint channel, at most
+#define BLOCK_SEARCH_ROUNDS 2
+
+// Channel weights of the BC1 palette entries, and of BC7's 4-bit indices
+static const float bc1Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+static const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Bits of the BC1 endpoint channels, R G B
+static const int bc1Bits[3] = { 5, 6, 5 };
+static const int bc1Max[3] = { 31, 63, 31 };
+static const int bc7Max[3] = { 127, 127, 127 };
+
+// The 16 pixels of a block, one array per channel, for SSE2 to take 4 at a time
+struct BlockPixels{
+  float channels[3][16];
+};
+
+static void loadBlock(const unsigned char * pixels, BlockPixels & out_block){
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < 3; c++)
+      out_block.channels[c][i] = pixels[i * 3 + c];
+}
+
+// Squared error of the block when each pixel takes the nearest palette entry,
+// whose index goes to indices
+static float paletteError(const BlockPixels & block, const float (*palette)[3], int paletteSize, unsigned char * indices){
+  float total = 0.0f;
+#ifdef BLOCKCOMPRESS_SSE2
+  for (int group = 0; group < 16; group += 4){
+    __m128 r = _mm_loadu_ps(block.channels[0] + group);
+    __m128 g = _mm_loadu_ps(block.channels[1] + group);
+    __m128 b = _mm_loadu_ps(block.channels[2] + group);
+    __m128 best = _mm_set1_ps(FLT_MAX);
+    __m128i bestIndex = _mm_setzero_si128();
+    for (int k = 0; k < paletteSize; k++){
+      __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[k][0]));
+      __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[k][1]));
+      __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[k][2]));
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+      __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+      best = _mm_min_ps(best, distance);
+      bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)), _mm_andnot_si128(closer, bestIndex));
+    }
+
+    union { __m128 vector; float lanes[4]; } errors;
+    union { __m128i vector; int lanes[4]; } nearest;
+    errors.vector = best;
+    nearest.vector = bestIndex;
+    for (int i = 0; i < 4; i++){
+      total += errors.lanes[i];
+      indices[group + i] = (unsigned char)nearest.lanes[i];
+    }
+  }
+#else
+  for (int i = 0; i < 16; i++){
+    float best = FLT_MAX;
+    for (int k = 0; k < paletteSize; k++){
+      float distance = 0.0f;
+      for (int c = 0; c < 3; c++){
+        float d = block.channels[c][i] - palette[k][c];
+        distance += d * d;
+      }
+      if (distance < best){
+        best = distance;
+        indices[i] = (unsigned char)k;
+      }
+    }
+    total += best;
+  }
+#endif
+  return total;
+}
+
+// The ends of the principal axis of the block's colors, as far as its pixels
+// reach along it
+static void principalEndpoints(const BlockPixels & block, float * e0, float * e1){
+  float mean[3] = { 0.0f, 0.0f, 0.0f };
+  for (int c = 0; c < 3; c++){
+    for (int i = 0; i < 16; i++)
+      mean[c] += block.channels[c][i];
+    mean[c] /= 16.0f;
+  }
+
+  float covariance[3][3] = { { 0.0f } };
+  for (int i = 0; i < 16; i++){
+    float d[3];
+    for (int c = 0; c < 3; c++)
+      d[c] = block.channels[c][i] - mean[c];
+    for (int a = 0; a < 3; a++)
+      for (int b = 0; b < 3; b++)
+        covariance[a][b] += d[a] * d[b];
+  }
+
+  // Power iteration, from the row that varies most
+  int start = 0;
+  for (int c = 1; c < 3; c++)
+    if (covariance[c][c] > covariance[start][start])
+      start = c;
+  float axis[3] = { covariance[start][0], covariance[start][1], covariance[start][2] };
+  for (int iteration = 0; iteration < 8; iteration++){
+    float next[3];
+    for (int a = 0; a < 3; a++)
+      next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+    float length = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+    if (length < 1e-6f)
+      break;
+    for (int a = 0; a < 3; a++)
+      axis[a] = next[a] / length;
+  }
+  float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  if (length < 1e-6f){
+    // One color
+    for (int c = 0; c < 3; c++)
+      e0[c] = e1[c] = mean[c];
+    return;
+  }
+
+  float lowest = FLT_MAX, highest = -FLT_MAX;
+  for (int i = 0; i < 16; i++){
+    float t = 0.0f;
+    for (int c = 0; c < 3; c++)
+      t += (block.channels[c][i] - mean[c]) * axis[c] / length;
+    lowest = std::min(lowest, t);
+    highest = std::max(highest, t);
+  }
+  for (int c = 0; c < 3; c++){
+    e0[c] = mean[c] + axis[c] / length * highest;
+    e1[c] = mean[c] + axis[c] / length * lowest;
+  }
+}
+
+// The endpoints that minimize the error for these indices, a pixel being
+// (1 - w) e0 + w e1 with w = weights[index]. False when every pixel has the
+// same weight.
+static bool fitEndpoints(const BlockPixels & block, const unsigned char * indices, const float * weights, float * e0, float * e1){
+  float a00 = 0.0f, a01 = 0.0f, a11 = 0.0f;
+  float b0[3] = { 0.0f, 0.0f, 0.0f }, b1[3] = { 0.0f, 0.0f, 0.0f };
+  for (int i = 0; i < 16; i++){
+    float w = weights[indices[i]];
+    a00 += (1.0f - w) * (1.0f - w);
+    a01 += (1.0f - w) * w;
+    a11 += w * w;
+    for (int c = 0; c < 3; c++){
+      b0[c] += (1.0f - w) * block.channels[c][i];
+      b1[c] += w * block.channels[c][i];
+    }
+  }
+
+  float determinant = a00 * a11 - a01 * a01;
+  if (fabsf(determinant) < 1e-6f)
+    return false;
+  for (int c = 0; c < 3; c++){
+    e0[c] = std::min(std::max((a11 * b0[c] - a01 * b1[c]) / determinant, 0.0f), 255.0f);
+    e1[c] = std::min(std::max((a00 * b1[c] - a01 * b0[c]) / determinant, 0.0f), 255.0f);
+  }
+  return true;
+}
+
+// Moves each endpoint channel a step up or down while it lowers the error
+template <typename Error>
+static float nudgeEndpoints(int (*q)[3], const int * maxQ, float error, Error evaluate){
+  for (int round = 0; round < BLOCK_SEARCH_ROUNDS; round++){
+    bool improved = false;
+    for (int e = 0; e < 2; e++)
+      for (int c = 0; c < 3; c++)
+        for (int step = -1; step <= 1; step += 2){
+          int old = q[e][c];
+          if (old + step < 0 || old + step > maxQ[c])
+            continue;
+          q[e][c] = old + step;
+          float candidate = evaluate(q);
+          if (candidate < error){
+            error = candidate;
+            improved = true;
+          }
+          else
+            q[e][c] = old;
+        }
+    if (!improved)
+      break;
+  }
+  return error;
+}
+
+static int quantizeBits(float value, int bits){
+  int maximum = (1 << bits) - 1;
+  int q = (int)(value * maximum / 255.0f + 0.5f);
+  return std::min(std::max(q, 0), maximum);
+}
+
+// Replicates the high bits into the low ones, as the GPU does
+static int expandBits(int q, int bits){
+  return (q << (8 - bits)) | (q >> (2 * bits - 8));
+}
+
+static void bc1Palette(const int (*q)[3], float (*out_palette)[3]){
+  for (int c = 0; c < 3; c++){
+    int a = expandBits(q[0][c], bc1Bits[c]), b = expandBits(q[1][c], bc1Bits[c]);
+    out_palette[0][c] = (float)a;
+    out_palette[1][c] = (float)b;
+    out_palette[2][c] = (float)((2 * a + b) / 3);
+    out_palette[3][c] = (float)((a + 2 * b) / 3);
+  }
+}
+
+static float bc1Error(const BlockPixels & block, const int (*q)[3], unsigned char * indices){
+  float palette[4][3];
+  bc1Palette(q, palette);
+  return paletteError(block, palette, 4, indices);
+}
+
+static void quantizeBC1(const float * e0, const float * e1, int (*out_q)[3]){
+  for (int c = 0; c < 3; c++){
+    out_q[0][c] = quantizeBits(e0[c], bc1Bits[c]);
+    out_q[1][c] = quantizeBits(e1[c], bc1Bits[c]);
+  }
+}
+
+static unsigned short pack565(const int * q){
+  return (unsigned short)(q[0] << 11 | q[1] << 5 | q[2]);
+}
+
+void compressBlockBC1(const unsigned char * pixels, unsigned char * out_block){
+  BlockPixels block;
+  loadBlock(pixels, block);
+
+  // The very ends of the range are rarely worth a whole endpoint : pull them in
+  float e0[3], e1[3];
+  principalEndpoints(block, e0, e1);
+  for (int c = 0; c < 3; c++){
+    float inset = (e0[c] - e1[c]) / 16.0f;
+    e0[c] -= inset;
+    e1[c] += inset;
+  }
+
+  int q[2][3];
+  unsigned char indices[16], scratch[16];
+  quantizeBC1(e0, e1, q);
+  float error = bc1Error(block, q, indices);
+
+  int refit[2][3];
+  if (fitEndpoints(block, indices, bc1Weights, e0, e1)){
+    quantizeBC1(e0, e1, refit);
+    float refitError = bc1Error(block, refit, scratch);
+    if (refitError < error){
+      memcpy(q, refit, sizeof(q));
+      error = refitError;
+    }
+  }
+
+  nudgeEndpoints(q, bc1Max, error, [&](const int (*candidate)[3]){
+    return bc1Error(block, candidate, scratch);
+  });
+  bc1Error(block, q, indices);
+
+  // c0 > c1 picks the 4 color palette, swapping the endpoints mirrors it
+  unsigned short c0 = pack565(q[0]), c1 = pack565(q[1]);
+  if (c0 < c1){
+    std::swap(c0, c1);
+    for (int i = 0; i < 16; i++)
+      indices[i] ^= 1;
+  }
+  else if (c0 == c1)
+    memset(indices, 0, sizeof(indices));
+
+  unsigned int bits = 0;
+  for (int i = 0; i < 16; i++)
+    bits |= (unsigned int)indices[i] << (2 * i);
+  out_block[0] = (unsigned char)c0;
+  out_block[1] = (unsigned char)(c0 >> 8);
+  out_block[2] = (unsigned char)c1;
+  out_block[3] = (unsigned char)(c1 >> 8);
+  for (int i = 0; i < 4; i++)
+    out_block[4 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+void decompressBlockBC1(const unsigned char * block, unsigned char * out_pixels){
+  unsigned short c0 = (unsigned short)(block[0] | block[1] << 8), c1 = (unsigned short)(block[2] | block[3] << 8);
+  int q[2][3] = { { c0 >> 11, (c0 >> 5) & 63, c0 & 31 }, { c1 >> 11, (c1 >> 5) & 63, c1 & 31 } };
+  float palette[4][3];
+  bc1Palette(q, palette);
+  if (c0 <= c1){
+    // 3 colors and black
+    for (int c = 0; c < 3; c++){
+      palette[2][c] = (float)(((int)palette[0][c] + (int)palette[1][c]) / 2);
+      palette[3][c] = 0.0f;
+    }
+  }
+
+  unsigned int bits = block[4] | block[5] << 8 | block[6] << 16 | (unsigned int)block[7] << 24;
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < 3; c++)
+      out_pixels[i * 3 + c] = (unsigned char)palette[(bits >> (2 * i)) & 3][c];
+}
+
+// Mode 6 endpoints are 7 bits a channel, and a low bit shared by the channels
+// of each endpoint, alpha included
+static float bc7Error(const BlockPixels & block, const int (*q)[3], const int * p, unsigned char * indices){
+  float palette[16][3];
+  for (int c = 0; c < 3; c++){
+    int a = q[0][c] << 1 | p[0], b = q[1][c] << 1 | p[1];
+    for (int k = 0; k < 16; k++)
+      palette[k][c] = (float)(((64 - bc7Weights[k]) * a + bc7Weights[k] * b + 32) >> 6);
+  }
+  return paletteError(block, palette, 16, indices);
+}
+
+// The 7 bits of endpoints e0 and e1. The low bits are 1 : alpha shares them,
+// and only 127 << 1 | 1 is opaque. Choosing them for the colors instead would
+// only gain 0.25 dB.
+static float quantizeBC7(const BlockPixels & block, const float * e0, const float * e1, int (*out_q)[3], int * out_p, unsigned char * scratch){
+  out_p[0] = out_p[1] = 1;
+  for (int c = 0; c < 3; c++){
+    out_q[0][c] = std::min(std::max((int)floorf((e0[c] - 1.0f) / 2.0f + 0.5f), 0), 127);
+    out_q[1][c] = std::min(std::max((int)floorf((e1[c] - 1.0f) / 2.0f + 0.5f), 0), 127);
+  }
+  return bc7Error(block, out_q, out_p, scratch);
+}
+
+// Little endian bit stream over a block, as BC7 lays out its fields
+struct BlockBits{
+  unsigned char * bytes;
+  unsigned int position;
+};
+
+static void putBits(BlockBits & bits, unsigned int value, int count){
+  for (int i = 0; i < count; i++, bits.position++)
+    if ((value >> i) & 1)
+      bits.bytes[bits.position >> 3] |= (unsigned char)(1 << (bits.position & 7));
+}
+
+static unsigned int getBits(BlockBits & bits, int count){
+  unsigned int value = 0;
+  for (int i = 0; i < count; i++, bits.position++)
+    value |= (unsigned int)((bits.bytes[bits.position >> 3] >> (bits.position & 7)) & 1) << i;
+  return value;
+}
+
+void compressBlockBC7(const unsigned char * pixels, unsigned char * out_block){
+  BlockPixels block;
+  loadBlock(pixels, block);
+
+  float e0[3], e1[3];
+  principalEndpoints(block, e0, e1);
+
+  int q[2][3], p[2];
+  unsigned char indices[16], scratch[16];
+  float error = quantizeBC7(block, e0, e1, q, p, scratch);
+  bc7Error(block, q, p, indices);
+
+  float weights[16];
+  for (int k = 0; k < 16; k++)
+    weights[k] = bc7Weights[k] / 64.0f;
+  if (fitEndpoints(block, indices, weights, e0, e1)){
+    int refit[2][3], refitP[2];
+    float refitError = quantizeBC7(block, e0, e1, refit, refitP, scratch);
+    if (refitError < error){
+      memcpy(q, refit, sizeof(q));
+      memcpy(p, refitP, sizeof(p));
+      error = refitError;
+    }
+  }
+
+  nudgeEndpoints(q, bc7Max, error, [&](const int (*candidate)[3]){
+    return bc7Error(block, candidate, p, scratch);
+  });
+  bc7Error(block, q, p, indices);
+
+  // The first pixel's index has no top bit : keep it under 8 by swapping
+  // the endpoints
+  if (indices[0] >= 8){
+    for (int c = 0; c < 3; c++)
+      std::swap(q[0][c], q[1][c]);
+    std::swap(p[0], p[1]);
+    for (int i = 0; i < 16; i++)
+      indices[i] = (unsigned char)(15 - indices[i]);
+  }
+
+  memset(out_block, 0, 16);
+  BlockBits bits = { out_block, 0 };
+  putBits(bits, 1 << 6, 7); // Mode 6
+  for (int c = 0; c < 3; c++){
+    putBits(bits, q[0][c], 7);
+    putBits(bits, q[1][c], 7);
+  }
+  putBits(bits, 127, 7); // Opaque, with the low bits at 1
+  putBits(bits, 127, 7);
+  putBits(bits, p[0], 1);
+  putBits(bits, p[1], 1);
+  putBits(bits, indices[0], 3);
+  for (int i = 1; i < 16; i++)
+    putBits(bits, indices[i], 4);
+}
+
+bool decompressBlockBC7(const unsigned char * block, unsigned char * out_pixels){
+  if ((block[0] & 0x7f) != 1 << 6)
+    return false;
+
+  BlockBits bits = { (unsigned char *)block, 7 };
+  int endpoints[2][3];
+  for (int c = 0; c < 3; c++){
+    endpoints[0][c] = getBits(bits, 7);
+    endpoints[1][c] = getBits(bits, 7);
+  }
+  getBits(bits, 14); // Alpha
+  int p0 = getBits(bits, 1), p1 = getBits(bits, 1);
+  for (int c = 0; c < 3; c++){
+    endpoints[0][c] = endpoints[0][c] << 1 | p0;
+    endpoints[1][c] = endpoints[1][c] << 1 | p1;
+  }
+
+  for (int i = 0; i < 16; i++){
+    int w = bc7Weights[getBits(bits, i == 0 ? 3 : 4)];
+    for (int c = 0; c < 3; c++)
+      out_pixels[i * 3 + c] = (unsigned char)(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+  }
+  return true;
+}
+
+size_t compressedChainLayout(const std::vector<MipLevel> & levels, BlockFormat format, std::vector<MipLevel> & out_levels){
+  out_levels.resize(levels.size());
+  size_t offset = 0;
+  for (size_t l = 0; l < levels.size(); l++){
+    MipLevel & level = out_levels[l];
+    level.width = levels[l].width;
+    level.height = levels[l].height;
+    level.offset = offset;
+    level.size = (size_t)((level.width + 3) / 4) * ((level.height + 3) / 4) * blockBytes(format);
+    offset += level.size;
+  }
+  return offset;
+}
+
+void compressMipChain(
+  const unsigned char * chain,
+  const std::vector<MipLevel> & levels,
+  BlockFormat format,
+  unsigned char * blocks,
+  const std::vector<MipLevel> & blockLevels,
+  unsigned int threadCount
+  ){
+  // Every row of blocks of every level is a task, levels don't depend on each other
+  std::vector<unsigned int> rowLevels, rows;
+  for (size_t l = 0; l < levels.size(); l++)
+    for (unsigned int row = 0; row < (levels[l].height + 3) / 4; row++){
+      rowLevels.push_back((unsigned int)l);
+      rows.push_back(row);
+    }
+
+  size_t bytes = blockBytes(format);
+  parallelFor((unsigned int)rows.size(), threadCount, [&](unsigned int task){
+    const MipLevel & level = levels[rowLevels[task]];
+    unsigned char * out = blocks + blockLevels[rowLevels[task]].offset + (size_t)rows[task] * ((level.width + 3) / 4) * bytes;
+    size_t rowSize = mipRowSize(level.width);
+
+    // Blocks past the edge of a level repeat its last row and column
+    unsigned char pixels[16 * 3];
+    for (unsigned int x = 0; x < level.width; x += 4, out += bytes){
+      for (int j = 0; j < 4; j++)
+        for (int i = 0; i < 4; i++){
+          unsigned int px = std::min(x + i, level.width - 1), py = std::min(rows[task] * 4 + j, level.height - 1);
+          const unsigned char * bgr = chain + level.offset + py * rowSize + px * 3;
+          unsigned char * rgb = pixels + (j * 4 + i) * 3;
+          rgb[0] = bgr[2];
+          rgb[1] = bgr[1];
+          rgb[2] = bgr[0];
+        }
+      if (format == BLOCK_BC1)
+        compressBlockBC1(pixels, out);
+      else
+        compressBlockBC7(pixels, out);
+    }
+  });
+}
@@ -0,0 +1,54 @@
+#ifndef BLOCKCOMPRESS_H
+#define BLOCKCOMPRESS_H
+#include <vector>
+#include <stddef.h>
+
+#include "mipmap.h"
+
+// Block compression of mip chains, for the GPU to sample as they are : every
+// 4x4 pixels of a level become one fixed size block.
+//  - BC1 (S3TC DXT1) : 8 bytes, two RGB 5:6:5 endpoints and 2-bit indices
+//    between them, 1/6 of RGB8 (1/8 of the RGBX8 drivers tend to store it as)
+//  - BC7 (BPTC) : 16 bytes. Only mode 6 is written, two RGBA 7777 endpoints
+//    with one extra bit each, always 1 so that alpha is 255, and 4-bit
+//    indices, much finer than BC1.
+// Endpoints follow the principal axis of the block's colors, are fitted to its
+// indices by least squares, then nudged a step at a time while the error drops.
+//
+// Blocks hold the encoded bytes, the same blocks serve the linear and the sRGB
+// formats, as the bytes of an RGB8 image do.
+
+enum BlockFormat{
+  BLOCK_BC1,
+  BLOCK_BC7
+};
+
+inline size_t blockBytes(BlockFormat format){
+  return format == BLOCK_BC1 ? 8 : 16;
+}
+
+// Fills out_levels with where the blocks of each level of levels go, levels
+// smaller than a block taking one whole block, and returns their size in bytes
+size_t compressedChainLayout(const std::vector<MipLevel> & levels, BlockFormat format, std::vector<MipLevel> & out_levels);
+
+// Compresses every level of chain, laid out by levels, into blocks, laid out by
+// blockLevels. Blocks are spread over threadCount threads (0 = one per core).
+void compressMipChain(
+  const unsigned char * chain,
+  const std::vector<MipLevel> & levels,
+  BlockFormat format,
+  unsigned char * blocks,
+  const std::vector<MipLevel> & blockLevels,
+  unsigned int threadCount
+  );
+
+// One block, from and to 16 RGB pixels, row after row. Pixels are RGB, not the
+// BGR of the chains.
+void compressBlockBC1(const unsigned char * pixels, unsigned char * out_block);
+void compressBlockBC7(const unsigned char * pixels, unsigned char * out_block);
+void decompressBlockBC1(const unsigned char * block, unsigned char * out_pixels);
+
+// False for BC7 modes other than 6
+bool decompressBlockBC7(const unsigned char * block, unsigned char * out_pixels);
+
+#endif
@@ -0,0 +1,403 @@
+#include <vector>
+#include <GL/glew.h>
+
+#include "glb.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A JSON document as a flat array of nodes, children linked from their parent.
+// Strings are left in the text as they are, escapes included : everything the
+// loader looks up is plain ASCII.
+enum JsonType{
+  JSON_NULL,
+  JSON_BOOL,
+  JSON_NUMBER,
+  JSON_STRING,
+  JSON_ARRAY,
+  JSON_OBJECT
+};
+
+#define JSON_NONE      0xffffffffu
+#define JSON_MAX_DEPTH 64
+
+struct JsonNode{
+  JsonType type;
+  double number;          // Numbers, and 0 / 1 for booleans
+  const char * text;      // Strings, without the quotes
+  size_t length;
+  const char * key;       // Name in the parent object
+  size_t keyLength;
+  unsigned int firstChild;
+  unsigned int nextSibling;
+};
+
+struct JsonParser{
+  const char * p;
+  const char * end;
+  std::vector<JsonNode> nodes;
+
+  JsonParser(const char * text, const char * textEnd) : p(text), end(textEnd){}
+
+  void skipBlanks(){
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+      p++;
+  }
+
+  // Past the closing quote. Escapes are skipped, not decoded.
+  bool parseString(const char *& out_text, size_t & out_length){
+    if (p >= end || *p != '"')
+      return false;
+    const char * begin = ++p;
+    while (p < end && *p != '"'){
+      if (*p == '\\')
+        p++;
+      p++;
+    }
+    if (p >= end)
+      return false;
+    out_text = begin;
+    out_length = p - begin;
+    p++;
+    return true;
+  }
+
+  bool matchWord(const char * word){
+    size_t length = strlen(word);
+    if ((size_t)(end - p) < length || memcmp(p, word, length) != 0)
+      return false;
+    p += length;
+    return true;
+  }
+
+  // Appends the value at p and its children, returns its node or JSON_NONE
+  unsigned int parseValue(int depth){
+    skipBlanks();
+    if (p >= end || depth > JSON_MAX_DEPTH)
+      return JSON_NONE;
+
+    JsonNode node = { JSON_NULL, 0.0, NULL, 0, NULL, 0, JSON_NONE, JSON_NONE };
+    unsigned int index = (unsigned int)nodes.size();
+    char c = *p;
+    if (c == '{' || c == '['){
+      node.type = c == '{' ? JSON_OBJECT : JSON_ARRAY;
+      nodes.push_back(node);
+      p++;
+      skipBlanks();
+      char close = c == '{' ? '}' : ']';
+      unsigned int last = JSON_NONE;
+      if (p < end && *p == close){
+        p++;
+        return index;
+      }
+      while (true){
+        const char * key = NULL;
+        size_t keyLength = 0;
+        if (c == '{'){
+          skipBlanks();
+          if (!parseString(key, keyLength))
+            return JSON_NONE;
+          skipBlanks();
+          if (p >= end || *p++ != ':')
+            return JSON_NONE;
+        }
+        unsigned int child = parseValue(depth + 1);
+        if (child == JSON_NONE)
+          return JSON_NONE;
+        nodes[child].key = key;
+        nodes[child].keyLength = keyLength;
+        if (last == JSON_NONE) nodes[index].firstChild = child;
+        else                   nodes[last].nextSibling = child;
+        last = child;
+
+        skipBlanks();
+        if (p >= end)
+          return JSON_NONE;
+        if (*p == ','){
+          p++;
+          continue;
+        }
+        if (*p++ != close)
+          return JSON_NONE;
+        return index;
+      }
+    }
+
+    if (c == '"'){
+      node.type = JSON_STRING;
+      if (!parseString(node.text, node.length))
+        return JSON_NONE;
+    }
+    else if (matchWord("true"))  node.type = JSON_BOOL, node.number = 1.0;
+    else if (matchWord("false")) node.type = JSON_BOOL;
+    else if (matchWord("null"))  node.type = JSON_NULL;
+    else{
+      // strtod needs a terminator : copy the few characters a number can have
+      char buffer[64];
+      size_t length = 0;
+      while (p + length < end && length < sizeof(buffer) - 1 && strchr("+-0123456789.eE", p[length]))
+        length++;
+      if (length == 0)
+        return JSON_NONE;
+      memcpy(buffer, p, length);
+      buffer[length] = '\0';
+      char * parsed;
+      node.type = JSON_NUMBER;
+      node.number = strtod(buffer, &parsed);
+      if (parsed != buffer + length)
+        return JSON_NONE;
+      p += length;
+    }
+    nodes.push_back(node);
+    return index;
+  }
+};
+
+// Child of an object by name, or of an array by position. JSON_NONE if there is none.
+static unsigned int jsonChild(const std::vector<JsonNode> & nodes, unsigned int node, const char * key){
+  if (node == JSON_NONE || nodes[node].type != JSON_OBJECT)
+    return JSON_NONE;
+  size_t length = strlen(key);
+  for (unsigned int child = nodes[node].firstChild; child != JSON_NONE; child = nodes[child].nextSibling)
+    if (nodes[child].keyLength == length && memcmp(nodes[child].key, key, length) == 0)
+      return child;
+  return JSON_NONE;
+}
+
+static unsigned int jsonItem(const std::vector<JsonNode> & nodes, unsigned int node, double position){
+  if (node == JSON_NONE || nodes[node].type != JSON_ARRAY || position < 0.0)
+    return JSON_NONE;
+  unsigned int child = nodes[node].firstChild;
+  for (double i = 0.0; child != JSON_NONE && i < position; i += 1.0)
+    child = nodes[child].nextSibling;
+  return child;
+}
+
+// Number member of an object, or fallback when it has none
+static double jsonNumber(const std::vector<JsonNode> & nodes, unsigned int node, const char * key, double fallback){
+  unsigned int child = jsonChild(nodes, node, key);
+  return child != JSON_NONE && nodes[child].type == JSON_NUMBER ? nodes[child].number : fallback;
+}
+
+static bool jsonStringIs(const std::vector<JsonNode> & nodes, unsigned int node, const char * value){
+  return node != JSON_NONE && nodes[node].type == JSON_STRING && nodes[node].length == strlen(value) &&
+    memcmp(nodes[node].text, value, nodes[node].length) == 0;
+}
+
+#define GLB_MAGIC      0x46546c67 // "glTF"
+#define GLB_CHUNK_JSON 0x4e4f534a // "JSON"
+#define GLB_CHUNK_BIN  0x004e4942 // "BIN\0"
+
+#define GLTF_FLOAT          5126
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT   5125
+#define GLTF_TRIANGLES      4
+
+static unsigned int readWord(const char * p){
+  unsigned int word;
+  memcpy(&word, p, 4);
+  return word;
+}
+
+// Finds the bytes of accessor in bin, checking that it is componentType / type.
+// out_stride is the distance between elements.
+static bool findAccessor(
+  const std::vector<JsonNode> & nodes,
+  unsigned int root,
+  double accessorIndex,
+  int componentType,
+  const char * type,
+  size_t elementSize,
+  const GLBRange & bin,
+  GLBRange & out_range,
+  size_t & out_count,
+  size_t & out_stride
+  ){
+  unsigned int accessor = jsonItem(nodes, jsonChild(nodes, root, "accessors"), accessorIndex);
+  if (accessor == JSON_NONE)
+    return false;
+  if (jsonNumber(nodes, accessor, "componentType", 0) != componentType || !jsonStringIs(nodes, jsonChild(nodes, accessor, "type"), type)){
+    printf("glTF accessor %d is not %s of the expected component type\n", (int)accessorIndex, type);
+    return false;
+  }
+  unsigned int normalized = jsonChild(nodes, accessor, "normalized");
+  if (jsonChild(nodes, accessor, "sparse") != JSON_NONE || (normalized != JSON_NONE && nodes[normalized].number != 0.0)){
+    printf("glTF accessor %d is sparse or normalized\n", (int)accessorIndex);
+    return false;
+  }
+
+  unsigned int view = jsonItem(nodes, jsonChild(nodes, root, "bufferViews"), jsonNumber(nodes, accessor, "bufferView", -1));
+  if (view == JSON_NONE || jsonNumber(nodes, view, "buffer", -1) != 0){
+    printf("glTF accessor %d is not in the GLB buffer\n", (int)accessorIndex);
+    return false;
+  }
+
+  double count = jsonNumber(nodes, accessor, "count", 0);
+  double accessorOffset = jsonNumber(nodes, accessor, "byteOffset", 0);
+  double viewOffset = jsonNumber(nodes, view, "byteOffset", 0);
+  double viewLength = jsonNumber(nodes, view, "byteLength", 0);
+  double stride = jsonNumber(nodes, view, "byteStride", (double)elementSize);
+  double size = count > 0 ? stride * (count - 1) + elementSize : 0;
+  if (count < 0 || stride < elementSize || accessorOffset < 0 || viewOffset < 0 ||
+      viewOffset + viewLength > bin.size || accessorOffset + size > viewLength){
+    printf("glTF accessor %d is out of its buffer view\n", (int)accessorIndex);
+    return false;
+  }
+
+  out_range.data = bin.data + (size_t)(viewOffset + accessorOffset);
+  out_range.size = (size_t)size;
+  out_count = (size_t)count;
+  out_stride = (size_t)stride;
+  return true;
+}
+
+bool loadGLB(const char * path, GLBMesh & out_mesh){
+  out_mesh.primitives.clear();
+  if (!mapFile(path, out_mesh.file)){
+    printf("%s could not be opened.\n", path);
+    return false;
+  }
+
+  // Header, then the JSON chunk, then the BIN chunk, each 4-byte aligned
+  const MappedFile & file = out_mesh.file;
+  if (file.size < 20 || readWord(file.data) != GLB_MAGIC || readWord(file.data + 4) != 2){
+    printf("%s is not a glTF 2.0 binary file\n", path);
+    closeGLB(out_mesh);
+    return false;
+  }
+  size_t jsonLength = readWord(file.data + 12);
+  GLBRange bin = { NULL, 0 };
+  if (readWord(file.data + 16) != GLB_CHUNK_JSON || jsonLength > file.size - 20){
+    printf("%s has no JSON chunk\n", path);
+    closeGLB(out_mesh);
+    return false;
+  }
+  const char * json = file.data + 20;
+  size_t binHeader = 20 + jsonLength;
+  if (binHeader + 8 <= file.size && readWord(file.data + binHeader + 4) == GLB_CHUNK_BIN){
+    bin.data = file.data + binHeader + 8;
+    bin.size = readWord(file.data + binHeader);
+    if (bin.size > file.size - binHeader - 8)
+      bin.size = 0, bin.data = NULL;
+  }
+
+  JsonParser parser(json, json + jsonLength);
+  unsigned int root = parser.parseValue(0);
+  const std::vector<JsonNode> & nodes = parser.nodes;
+  if (root == JSON_NONE || nodes[root].type != JSON_OBJECT){
+    printf("%s has invalid JSON\n", path);
+    closeGLB(out_mesh);
+    return false;
+  }
+  unsigned int buffer = jsonItem(nodes, jsonChild(nodes, root, "buffers"), 0);
+  if (buffer == JSON_NONE || jsonChild(nodes, buffer, "uri") != JSON_NONE || !bin.data){
+    printf("%s keeps its buffer outside the file\n", path);
+    closeGLB(out_mesh);
+    return false;
+  }
+
+  // Every primitive of the first mesh
+  unsigned int primitives = jsonChild(nodes, jsonItem(nodes, jsonChild(nodes, root, "meshes"), 0), "primitives");
+  static const char * attributeNames[GLB_INDICES] = { "POSITION", "NORMAL", "TEXCOORD_0" };
+  static const char * attributeTypes[GLB_INDICES] = { "VEC3", "VEC3", "VEC2" };
+  static const size_t attributeSizes[GLB_INDICES] = { 12, 12, 8 };
+  bool ok = primitives != JSON_NONE && nodes[primitives].firstChild != JSON_NONE;
+  for (unsigned int p = ok ? nodes[primitives].firstChild : JSON_NONE; ok && p != JSON_NONE; p = nodes[p].nextSibling){
+    if (jsonNumber(nodes, p, "mode", GLTF_TRIANGLES) != GLTF_TRIANGLES){
+      printf("%s has a primitive that is not triangles\n", path);
+      ok = false;
+      break;
+    }
+
+    GLBPrimitive primitive;
+    unsigned int attributes = jsonChild(nodes, p, "attributes");
+    for (int a = 0; ok && a < GLB_INDICES; a++){
+      unsigned int attribute = jsonChild(nodes, attributes, attributeNames[a]);
+      size_t count, stride;
+      ok = attribute != JSON_NONE && nodes[attribute].type == JSON_NUMBER &&
+        findAccessor(nodes, root, nodes[attribute].number, GLTF_FLOAT, attributeTypes[a], attributeSizes[a], bin, primitive.streams[a], count, stride);
+      if (!ok){
+        printf("%s has a primitive without a usable %s\n", path, attributeNames[a]);
+        break;
+      }
+      if (a == GLB_POSITIONS)
+        primitive.vertexCount = (unsigned int)count;
+      if (out_mesh.primitives.empty())
+        out_mesh.strides[a] = (GLsizei)stride;
+      ok = count == primitive.vertexCount && (GLsizei)stride == out_mesh.strides[a];
+      if (!ok)
+        printf("%s has attributes of different counts or strides\n", path);
+    }
+    if (!ok)
+      break;
+
+    double indices = jsonNumber(nodes, p, "indices", -1);
+    unsigned int indexAccessor = jsonItem(nodes, jsonChild(nodes, root, "accessors"), indices);
+    int componentType = (int)jsonNumber(nodes, indexAccessor, "componentType", 0);
+    GLenum indexType = componentType == GLTF_UNSIGNED_SHORT ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    size_t indexSize = componentType == GLTF_UNSIGNED_SHORT ? 2 : 4;
+    size_t count, stride;
+    ok = indexAccessor != JSON_NONE && (componentType == GLTF_UNSIGNED_SHORT || componentType == GLTF_UNSIGNED_INT) &&
+      findAccessor(nodes, root, indices, componentType, "SCALAR", indexSize, bin, primitive.streams[GLB_INDICES], count, stride) &&
+      stride == indexSize && count % 3 == 0;
+    if (!ok){
+      printf("%s has a primitive without 16 or 32-bit triangle indices\n", path);
+      break;
+    }
+    if (out_mesh.primitives.empty())
+      out_mesh.indexType = indexType;
+    ok = indexType == out_mesh.indexType;
+    if (!ok){
+      printf("%s mixes 16 and 32-bit indices\n", path);
+      break;
+    }
+    primitive.indexCount = (unsigned int)count;
+    out_mesh.primitives.push_back(primitive);
+  }
+
+  if (!ok){
+    if (primitives == JSON_NONE)
+      printf("%s has no mesh\n", path);
+    closeGLB(out_mesh);
+  }
+  return ok;
+}
+
+void closeGLB(GLBMesh & mesh){
+  unmapFile(mesh.file);
+  mesh.primitives.clear();
+}
+
+void uploadGLBStream(GLenum target, GLuint buffer, const GLBMesh & mesh, GLBStream stream){
+  // Where every primitive's range goes : at its base vertex times the stride,
+  // or its first index
+  size_t unit = stream == GLB_INDICES ? indexTypeSize(mesh.indexType) : (size_t)mesh.strides[stream];
+  std::vector<size_t> offsets(mesh.primitives.size());
+  size_t total = 0;
+  for (size_t i = 0; i < mesh.primitives.size(); i++){
+    offsets[i] = total;
+    total += unit * (stream == GLB_INDICES ? mesh.primitives[i].indexCount : mesh.primitives[i].vertexCount);
+  }
+
+  glBindBuffer(target, buffer);
+  if (mesh.primitives.size() == 1){
+    glBufferData(target, mesh.primitives[0].streams[stream].size, mesh.primitives[0].streams[stream].data, GL_STATIC_DRAW);
+    return;
+  }
+  glBufferData(target, total, NULL, GL_STATIC_DRAW);
+  for (size_t i = 0; i < mesh.primitives.size(); i++)
+    glBufferSubData(target, offsets[i], mesh.primitives[i].streams[stream].size, mesh.primitives[i].streams[stream].data);
+}
+
+void glbSubMeshes(const GLBMesh & mesh, std::vector<SubMesh> & out_submeshes){
+  out_submeshes.clear();
+  unsigned int indexOffset = 0;
+  int baseVertex = 0;
+  for (size_t i = 0; i < mesh.primitives.size(); i++){
+    SubMesh submesh = { indexOffset, mesh.primitives[i].indexCount, baseVertex, mesh.primitives[i].vertexCount };
+    out_submeshes.push_back(submesh);
+    indexOffset += mesh.primitives[i].indexCount;
+    baseVertex += (int)mesh.primitives[i].vertexCount;
+  }
+}
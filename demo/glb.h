@@ -0,0 +1,59 @@
+#ifndef GLB_H
+#define GLB_H
+#include <vector>
+#include <GL/glew.h>
+
+#include "mapfile.h"
+#include "mesh.h"
+
+// Binary glTF 2.0 (.glb) : a JSON chunk that describes the meshes, and a BIN chunk
+// that holds their vertex and index buffers, ready for the GPU. The file is mapped
+// and the buffers go from the mapped pages to glBufferData, never through a
+// std::vector.
+//
+// Supported : the triangle primitives of the first mesh, indexed with unsigned
+// short or unsigned int, with float POSITION, NORMAL and TEXCOORD_0. Anything else
+// is refused with a message.
+
+enum GLBStream{
+  GLB_POSITIONS,
+  GLB_NORMALS,
+  GLB_UVS,
+  GLB_INDICES,
+  GLB_STREAM_COUNT
+};
+
+// Bytes of the mapped file
+struct GLBRange{
+  const char * data;
+  size_t size;
+};
+
+struct GLBPrimitive{
+  GLBRange streams[GLB_STREAM_COUNT];
+  unsigned int vertexCount;
+  unsigned int indexCount;
+};
+
+struct GLBMesh{
+  MappedFile file;
+  std::vector<GLBPrimitive> primitives;
+  GLenum indexType;                      // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, the same for every primitive
+  GLsizei strides[GLB_STREAM_COUNT - 1]; // Per vertex stream, the same for every primitive
+};
+
+// Maps path and finds the buffers of every primitive in it. The ranges stay valid
+// until closeGLB.
+bool loadGLB(const char * path, GLBMesh & out_mesh);
+
+void closeGLB(GLBMesh & mesh);
+
+// Fills buffer, bound to target, with stream for every primitive, one after the
+// other, straight from the mapped file. Vertex streams are laid out so that
+// glbSubMeshes' base vertices find them with the stream's stride.
+void uploadGLBStream(GLenum target, GLuint buffer, const GLBMesh & mesh, GLBStream stream);
+
+// One submesh per primitive, for buffers filled by uploadGLBStream
+void glbSubMeshes(const GLBMesh & mesh, std::vector<SubMesh> & out_submeshes);
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef HASHMAP_H
+#define HASHMAP_H
+#include <vector>
+#include <algorithm>
+#include <stddef.h>
+#include <string.h>
+
+// 32-bit finalizer from MurmurHash3 : cheap, and every input bit affects every output bit
+inline unsigned int mixHash(unsigned int h){
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+// Hashes the bit pattern of a POD value, 32 bits at a time. The words are
+// memcpy'd out, reading floats through an unsigned int pointer breaks aliasing rules.
+inline unsigned int hashWords(const void * data, size_t size){
+  const unsigned char * bytes = (const unsigned char *)data;
+  unsigned int h = 0x9747b28c;
+  for (size_t i = 0; i + 4 <= size; i += 4){
+    unsigned int word;
+    memcpy(&word, bytes + i, 4);
+    h = mixHash(h ^ word) * 5 + 0xe6546b64;
+  }
+  return mixHash(h);
+}
+
+// Numbers keys 0, 1, 2... in the order they are first seen, which is all the
+// vertex indexers need. Open addressing with linear probing over a flat array of
+// small (hash, index) slots, so a probe sequence usually stays within a single
+// cache line and nothing is allocated per entry. The keys themselves are stored
+// once, densely, in first-seen order, and are only read when the hashes match.
+// Traits provides
+//   static unsigned int hash(const Key &)
+//   static bool equal(const Key &, const Key &)
+template <typename Key, typename Traits>
+class IndexHashMap{
+public:
+  // Reserve room for expectedCount keys up front so that neither the table nor
+  // the keys grow
+  explicit IndexHashMap(size_t expectedCount = 0){
+    allocate(expectedCount);
+    keys.reserve(expectedCount);
+  }
+
+  // Returns the index of key. If key is new, it gets the next index and
+  // inserted is set.
+  unsigned int findOrInsert(const Key & key, bool & inserted){
+    return findOrInsert(key, Traits::hash(key), inserted);
+  }
+
+  // Same, when the caller already knows Traits::hash(key)
+  unsigned int findOrInsert(const Key & key, unsigned int hash, bool & inserted){
+    if ((keys.size() + 1) * 2 > slots.size())
+      grow();
+
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask){
+      Slot & slot = slots[i];
+      if (slot.index == EMPTY){
+        slot.hash = hash;
+        slot.index = (unsigned int)keys.size();
+        keys.push_back(key);
+        inserted = true;
+        return slot.index;
+      }
+      if (slot.hash == hash && Traits::equal(keys[slot.index], key)){
+        inserted = false;
+        return slot.index;
+      }
+    }
+  }
+
+  // Looks key up without inserting it
+  bool find(const Key & key, unsigned int & index) const{
+    unsigned int hash = Traits::hash(key);
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask; slots[i].index != EMPTY; i = (i + 1) & mask){
+      if (slots[i].hash == hash && Traits::equal(keys[slots[i].index], key)){
+        index = slots[i].index;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t size() const{
+    return keys.size();
+  }
+
+  // Forgets every key, keeping the memory for the next ones
+  void clear(){
+    keys.clear();
+    Slot empty = { 0, EMPTY };
+    std::fill(slots.begin(), slots.end(), empty);
+  }
+
+  const Key & key(unsigned int index) const{
+    return keys[index];
+  }
+
+private:
+  static const unsigned int EMPTY = 0xffffffffu;
+
+  struct Slot{
+    unsigned int hash;
+    unsigned int index;
+  };
+
+  // Power of two, at most half full
+  void allocate(size_t expectedCount){
+    size_t capacity = 16;
+    while (capacity < expectedCount * 2)
+      capacity *= 2;
+    Slot empty = { 0, EMPTY };
+    slots.assign(capacity, empty);
+  }
+
+  void grow(){
+    allocate(slots.size());
+    size_t mask = slots.size() - 1;
+    for (unsigned int k = 0; k < keys.size(); k++){
+      unsigned int hash = Traits::hash(keys[k]);
+      size_t i = hash & mask;
+      while (slots[i].index != EMPTY)
+        i = (i + 1) & mask;
+      slots[i].hash = hash;
+      slots[i].index = k;
+    }
+  }
+
+  std::vector<Slot> slots;
+  std::vector<Key> keys;
+};
+
+#endif
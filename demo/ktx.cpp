@@ -0,0 +1,267 @@
+#include <vector>
+#include <GL/glew.h>
+
+#include "ktx.h"
+#include "loader.h"
+#include "blockcompress.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const unsigned char ktxIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+#define KTX_ENDIANNESS 0x04030201
+
+struct KTXHeader{
+  unsigned char identifier[12];
+  unsigned int endianness;
+  unsigned int glType;
+  unsigned int glTypeSize;
+  unsigned int glFormat;
+  unsigned int glInternalFormat;
+  unsigned int glBaseInternalFormat;
+  unsigned int pixelWidth;
+  unsigned int pixelHeight;
+  unsigned int pixelDepth;
+  unsigned int numberOfArrayElements;
+  unsigned int numberOfFaces;
+  unsigned int numberOfMipmapLevels;
+  unsigned int bytesOfKeyValueData;
+};
+
+// Where level 0 is : KTX files say it, GL's own order, as in a BMP, is bottom up
+static const char ktxOrientation[] = "KTXorientation\0S=r,T=u";
+
+// The linear and sRGB formats the demo can read, bytes per pixel or per block
+struct KTXFormatPair{
+  GLenum linear, srgb;
+  GLenum baseFormat;
+  unsigned int bytes;
+  bool compressed;
+};
+
+static const KTXFormatPair ktxFormatPairs[] = {
+  { GL_RGB8, GL_SRGB8, GL_RGB, 3, false },
+  { GL_RGBA8, GL_SRGB8_ALPHA8, GL_RGBA, 4, false },
+  { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, GL_RGB, 8, true },
+  { GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, GL_RGBA, 8, true },
+  { GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, GL_RGBA, 16, true },
+  { GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, GL_RGBA, 16, true },
+};
+
+static const KTXFormatPair * findFormatPair(GLenum internalFormat){
+  for (size_t i = 0; i < sizeof(ktxFormatPairs) / sizeof(ktxFormatPairs[0]); i++)
+    if (ktxFormatPairs[i].linear == internalFormat || ktxFormatPairs[i].srgb == internalFormat)
+      return &ktxFormatPairs[i];
+  return NULL;
+}
+
+bool ktxFormat(GLenum internalFormat, GLenum format, KTXFormat & out_format){
+  const KTXFormatPair * pair = findFormatPair(internalFormat);
+  if (!pair)
+    return false;
+
+  out_format.internalFormat = internalFormat;
+  out_format.linearFormat = pair->linear;
+  out_format.srgbFormat = pair->srgb;
+  out_format.bytesPerPixel = pair->bytes;
+  out_format.compressed = pair->compressed;
+  out_format.srgb = internalFormat == pair->srgb;
+  out_format.format = pair->compressed ? 0 : format;
+  out_format.type = pair->compressed ? 0 : GL_UNSIGNED_BYTE;
+  if (pair->compressed)
+    return true;
+
+  // The components must be what the internal format holds, in either order
+  if (pair->bytes == 3)
+    return format == GL_RGB || format == GL_BGR;
+  return format == GL_RGBA || format == GL_BGRA;
+}
+
+bool ktxFormatSupported(const KTXFormat & format){
+  if (!format.compressed)
+    return true;
+  if (format.linearFormat == GL_COMPRESSED_RGBA_BPTC_UNORM)
+    return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+  return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB; // The sRGB S3TC formats come with the latter
+}
+
+// Bytes of a level, rows padded to 4 as with the default GL_UNPACK_ALIGNMENT
+static size_t ktxLevelSize(const KTXFormat & format, unsigned int width, unsigned int height){
+  if (format.compressed)
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * format.bytesPerPixel;
+  return (((size_t)width * format.bytesPerPixel + 3) & ~(size_t)3) * height;
+}
+
+bool loadKTX(const char * path, KTXImage & out_image){
+  out_image.levels.clear();
+  if (!mapFile(path, out_image.file)){
+    printf("%s could not be opened.\n", path);
+    return false;
+  }
+
+  const MappedFile & file = out_image.file;
+  KTXHeader header;
+  bool ok = file.size >= sizeof(KTXHeader);
+  if (ok)
+    memcpy(&header, file.data, sizeof(KTXHeader));
+  if (!ok || memcmp(header.identifier, ktxIdentifier, sizeof(ktxIdentifier)) != 0){
+    printf("%s is not a KTX 1.1 file\n", path);
+    closeKTX(out_image);
+    return false;
+  }
+
+  const char * refusal = NULL;
+  if (header.endianness != KTX_ENDIANNESS)
+    refusal = "is in the other byte order";
+  else if (header.pixelDepth > 1 || header.numberOfArrayElements > 0 || header.numberOfFaces != 1 || header.pixelWidth == 0 || header.pixelHeight == 0)
+    refusal = "is not a 2D texture";
+  else if (!ktxFormat(header.glInternalFormat, header.glFormat, out_image.format) ||
+           header.glType != out_image.format.type || (!out_image.format.compressed && header.glTypeSize != 1))
+    refusal = "is in a format that is not supported";
+  else if (header.bytesOfKeyValueData > file.size - sizeof(KTXHeader))
+    refusal = "is truncated";
+  if (refusal){
+    printf("%s %s\n", path, refusal);
+    closeKTX(out_image);
+    return false;
+  }
+
+  // 0 levels : level 0 only, GL builds the others
+  std::vector<MipLevel> fullChain;
+  mipChainLayout(header.pixelWidth, header.pixelHeight, fullChain);
+  unsigned int levelCount = header.numberOfMipmapLevels > 0 ? header.numberOfMipmapLevels : 1;
+  out_image.generateMipmaps = header.numberOfMipmapLevels == 0 && !out_image.format.compressed;
+  if (levelCount > fullChain.size()){
+    printf("%s has more levels than its size allows\n", path);
+    closeKTX(out_image);
+    return false;
+  }
+
+  size_t offset = sizeof(KTXHeader) + header.bytesOfKeyValueData;
+  for (unsigned int l = 0; l < levelCount; l++){
+    MipLevel level;
+    level.width = fullChain[l].width;
+    level.height = fullChain[l].height;
+    level.size = ktxLevelSize(out_image.format, level.width, level.height);
+
+    unsigned int imageSize = 0;
+    if (offset + 4 <= file.size)
+      memcpy(&imageSize, file.data + offset, 4);
+    level.offset = offset + 4;
+    if (offset + 4 > file.size || imageSize != level.size || level.size > file.size - level.offset){
+      printf("%s has a level %u of the wrong size, or is truncated\n", path, l);
+      closeKTX(out_image);
+      return false;
+    }
+    out_image.levels.push_back(level);
+    offset = level.offset + ((level.size + 3) & ~(size_t)3);
+  }
+  return true;
+}
+
+void closeKTX(KTXImage & image){
+  unmapFile(image.file);
+  image.levels.clear();
+}
+
+bool writeKTX(const char * path, const KTXFormat & format, const unsigned char * data, const std::vector<MipLevel> & levels){
+  const KTXFormatPair * pair = findFormatPair(format.internalFormat);
+  if (!pair || levels.empty())
+    return false;
+
+  FILE * file = fopen(path, "wb");
+  if (!file){
+    printf("%s could not be written\n", path);
+    return false;
+  }
+
+  unsigned int keyValueSize = sizeof(ktxOrientation); // With its terminating 0
+  unsigned int keyValuePadding = (4 - keyValueSize % 4) % 4;
+
+  KTXHeader header;
+  memcpy(header.identifier, ktxIdentifier, sizeof(ktxIdentifier));
+  header.endianness = KTX_ENDIANNESS;
+  header.glType = format.type;
+  header.glTypeSize = 1;
+  header.glFormat = format.format;
+  header.glInternalFormat = format.internalFormat;
+  header.glBaseInternalFormat = pair->baseFormat;
+  header.pixelWidth = levels[0].width;
+  header.pixelHeight = levels[0].height;
+  header.pixelDepth = 0;
+  header.numberOfArrayElements = 0;
+  header.numberOfFaces = 1;
+  header.numberOfMipmapLevels = (unsigned int)levels.size();
+  header.bytesOfKeyValueData = 4 + keyValueSize + keyValuePadding;
+
+  static const unsigned char padding[4] = { 0, 0, 0, 0 };
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(&keyValueSize, 4, 1, file) == 1 &&
+    fwrite(ktxOrientation, keyValueSize, 1, file) == 1 &&
+    fwrite(padding, 1, keyValuePadding, file) == keyValuePadding;
+
+  for (size_t l = 0; ok && l < levels.size(); l++){
+    unsigned int imageSize = (unsigned int)levels[l].size;
+    size_t levelPadding = (4 - levels[l].size % 4) % 4;
+    ok = fwrite(&imageSize, 4, 1, file) == 1 &&
+      fwrite(data + levels[l].offset, 1, levels[l].size, file) == levels[l].size &&
+      fwrite(padding, 1, levelPadding, file) == levelPadding;
+  }
+
+  ok = fclose(file) == 0 && ok;
+  if (!ok){
+    printf("%s could not be written\n", path);
+    remove(path);
+  }
+  return ok;
+}
+
+bool convertBMPToKTX(const char * bmpPath, const char * ktxPath, GLenum internalFormat){
+  KTXFormat format;
+  const KTXFormatPair * pair = findFormatPair(internalFormat);
+  bool rgb = pair && pair->linear == GL_RGB8;
+  bool bc1 = pair && pair->linear == GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  bool bc7 = pair && pair->linear == GL_COMPRESSED_RGBA_BPTC_UNORM;
+  if (!(rgb || bc1 || bc7) || !ktxFormat(internalFormat, GL_RGB, format)){
+    printf("BMP files can only be converted to RGB8, BC1 or BC7\n");
+    return false;
+  }
+
+  DecodedImage image;
+  if (!decodeBMP(bmpPath, image))
+    return false;
+  std::vector<MipLevel> levels;
+  size_t chainSize = mipChainLayout(image.width, image.height, levels);
+  if (image.pixels.size() < levels[0].size){
+    printf("%s is shorter than its header says\n", bmpPath);
+    return false;
+  }
+  image.pixels.resize(chainSize);
+  // sRGB pixels are averaged in linear light, linear ones as they are stored
+  if (format.srgb)
+    generateMipChain(&image.pixels[0], &image.pixels[0], levels, 0);
+  else
+    generateMipChain_encoded(&image.pixels[0], &image.pixels[0], levels);
+
+  if (rgb){
+    // BMP is BGR, plain RGB is what every reader takes
+    for (size_t l = 0; l < levels.size(); l++){
+      size_t rowSize = mipRowSize(levels[l].width);
+      for (unsigned int y = 0; y < levels[l].height; y++){
+        unsigned char * row = &image.pixels[levels[l].offset + y * rowSize];
+        for (unsigned int x = 0; x < levels[l].width; x++){
+          unsigned char blue = row[x * 3];
+          row[x * 3] = row[x * 3 + 2];
+          row[x * 3 + 2] = blue;
+        }
+      }
+    }
+    return writeKTX(ktxPath, format, &image.pixels[0], levels);
+  }
+
+  std::vector<MipLevel> blockLevels;
+  std::vector<unsigned char> blocks(compressedChainLayout(levels, bc1 ? BLOCK_BC1 : BLOCK_BC7, blockLevels));
+  compressMipChain(&image.pixels[0], levels, bc1 ? BLOCK_BC1 : BLOCK_BC7, &blocks[0], blockLevels, 0);
+  return writeKTX(ktxPath, format, &blocks[0], blockLevels);
+}
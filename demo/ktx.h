@@ -0,0 +1,58 @@
+#ifndef KTX_H
+#define KTX_H
+#include <vector>
+#include <GL/glew.h>
+
+#include "mapfile.h"
+#include "mipmap.h"
+
+// KTX 1.1 texture files : a header naming the GL format of the texture, then
+// every mip level as GL takes it, level 0 first. Unlike a BMP, the file says
+// whether its colors are sRGB, holds the mip chain, and may hold blocks. The file
+// is mapped and the levels go from the mapped pages to GL, never through a
+// std::vector.
+//
+// Supported : 2D textures, one face, no array, RGB8 and RGBA8 (RGB, BGR, RGBA
+// or BGRA order), BC1 (DXT1), BC3 (DXT5) and BC7, each linear or sRGB, in the
+// byte order of this machine.
+
+// The format of a KTX file, and its counterpart in the other color space, for
+// the demo to sample it both ways
+struct KTXFormat{
+  GLenum internalFormat;               // As the file says
+  GLenum linearFormat, srgbFormat;     // Its pair, one of which is internalFormat
+  GLenum format, type;                 // 0 when compressed
+  unsigned int bytesPerPixel;          // Or per 4x4 block, when compressed
+  bool compressed;
+  bool srgb;                           // internalFormat is srgbFormat
+};
+
+// The format for a GL internal format, false if KTX files in it are not supported
+bool ktxFormat(GLenum internalFormat, GLenum format, KTXFormat & out_format);
+
+// True when the context can sample format both as linear and as sRGB
+bool ktxFormatSupported(const KTXFormat & format);
+
+struct KTXImage{
+  MappedFile file;
+  KTXFormat format;
+  std::vector<MipLevel> levels;        // Offsets from the start of the file
+  bool generateMipmaps;                // The file has level 0 only and asks for the rest
+};
+
+// Maps path and finds its levels, checking that each is as big as its size
+// and format make it. The levels stay valid until closeKTX.
+bool loadKTX(const char * path, KTXImage & out_image);
+
+void closeKTX(KTXImage & image);
+
+// Writes levels, each laid out as GL takes it, rows padded to 4 bytes, to a
+// KTX file in format
+bool writeKTX(const char * path, const KTXFormat & format, const unsigned char * data, const std::vector<MipLevel> & levels);
+
+// Writes the BMP at bmpPath to ktxPath in internalFormat, which can be RGB8,
+// BC1 or BC7, linear or sRGB, with its mip chain built by generateMipChain for
+// the sRGB formats, and by generateMipChain_encoded for the linear ones
+bool convertBMPToKTX(const char * bmpPath, const char * ktxPath, GLenum internalFormat);
+
+#endif
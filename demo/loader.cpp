@@ -6,10 +6,16 @@
 #include <glm/glm.hpp>
 
 #include "loader.h"
+#include "mapfile.h"
+#include "parallel.h"
+#include "hashmap.h"
 
 #include <string.h> // for memcmp
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
 #include <string>
 #include <cstring>
 
@@ -120,6 +126,780 @@ bool loadOBJ(
   return true;
 }
 
+// Parsing helpers for the mapped OBJ loader below.
+// A mapped file is not null-terminated, so every one of them takes the end
+// of the buffer and never reads past it. They are also locale-independent,
+// which fscanf is not.
+
+static inline bool isBlank(char c){
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char * skipBlanks(const char * p, const char * end){
+  while (p < end && isBlank(*p))
+    p++;
+  return p;
+}
+
+// Returns the first character of the next line
+static inline const char * skipLine(const char * p, const char * end){
+  const char * newline = (const char *)memchr(p, '\n', end - p);
+  return newline ? newline + 1 : end;
+}
+
+// Exact powers of ten in single precision : 5^10 still fits in a 24-bit mantissa
+static const float powersOfTen[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+// Slow path : let the C library deal with long mantissas, big exponents, inf and nan.
+static bool parseFloat_slow(const char *& p, const char * end, float & result){
+  char token[64];
+  size_t length = 0;
+  while (p + length < end && !isBlank(p[length]) && p[length] != '\n'){
+    if (length == sizeof(token) - 1)
+      return false;
+    token[length] = p[length];
+    length++;
+  }
+  token[length] = '\0';
+
+  char * tokenEnd;
+  result = strtof(token, &tokenEnd);
+  if (tokenEnd == token)
+    return false;
+  p += tokenEnd - token;
+  return true;
+}
+
+// Parses a decimal float, e.g. "-0.437500" or "1.5e-3".
+// When both the mantissa and the power of ten are exact in single precision,
+// a single multiplication or division is correctly rounded, so the result is
+// bit-identical to strtof. Everything else takes the slow path.
+static bool parseFloat(const char *& p, const char * end, float & result){
+  const char * start = p;
+  const char * q = p;
+
+  bool negative = false;
+  if (q < end && (*q == '-' || *q == '+')){
+    negative = *q == '-';
+    q++;
+  }
+
+  unsigned long long mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+  int trailingZeros = 0;
+  bool any = false;
+
+  for (; q < end && *q >= '0' && *q <= '9'; q++){
+    any = true;
+    if (mantissa == 0 && *q == '0')
+      continue;
+    mantissa = mantissa * 10 + (*q - '0');
+    trailingZeros = *q == '0' ? trailingZeros + 1 : 0;
+    digits++;
+  }
+  if (q < end && *q == '.'){
+    q++;
+    for (; q < end && *q >= '0' && *q <= '9'; q++){
+      any = true;
+      exponent--;
+      if (mantissa == 0 && *q == '0')
+        continue;
+      mantissa = mantissa * 10 + (*q - '0');
+      trailingZeros = *q == '0' ? trailingZeros + 1 : 0;
+      digits++;
+    }
+  }
+  if (!any || digits > 18 || (q < end && (*q == 'e' || *q == 'E' || *q == 'n' || *q == 'N' || *q == 'i' || *q == 'I'))){
+    p = start;
+    return parseFloat_slow(p, end, result);
+  }
+
+  // "0.437500" is 4375e-4 : fewer digits means more numbers hit the fast path
+  for (; trailingZeros > 0 && exponent < 0; trailingZeros--){
+    mantissa /= 10;
+    exponent++;
+  }
+
+  if (mantissa > (1 << 24) || exponent < -10 || exponent > 10){
+    p = start;
+    return parseFloat_slow(p, end, result);
+  }
+
+  float value = (float)mantissa;
+  if (exponent < 0)
+    value /= powersOfTen[-exponent];
+  else
+    value *= powersOfTen[exponent];
+
+  result = negative ? -value : value;
+  p = q;
+  return true;
+}
+
+// Parses an OBJ index. Like the fscanf loader, negative (relative) indices are not supported.
+static bool parseIndex(const char *& p, const char * end, unsigned int & result){
+  const char * q = p;
+  unsigned int value = 0;
+  while (q < end && *q >= '0' && *q <= '9'){
+    value = value * 10 + (*q - '0');
+    q++;
+  }
+  if (q == p)
+    return false;
+  result = value;
+  p = q;
+  return true;
+}
+
+// Parses one "v/vt/vn" face corner
+static bool parseFaceCorner(const char *& p, const char * end, unsigned int & vertexIndex, unsigned int & uvIndex, unsigned int & normalIndex){
+  p = skipBlanks(p, end);
+  if (!parseIndex(p, end, vertexIndex) || p == end || *p++ != '/')
+    return false;
+  if (!parseIndex(p, end, uvIndex) || p == end || *p++ != '/')
+    return false;
+  return parseIndex(p, end, normalIndex);
+}
+
+// Everything an OBJ file contains before the faces are resolved
+struct OBJRecords{
+  std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+  std::vector<glm::vec3> temp_vertices;
+  std::vector<glm::vec2> temp_uvs;
+  std::vector<glm::vec3> temp_normals;
+};
+
+// Parses every line in [p, end). The range must start at the beginning of a line.
+static bool parseOBJRecords(const char * p, const char * end, OBJRecords & records){
+  while (p < end){
+    p = skipBlanks(p, end);
+    if (p == end)
+      break;
+
+    // Read the first word of the line. It has to be followed by a blank to be a keyword.
+    char c0 = *p;
+    char c1 = p + 1 < end ? p[1] : '\n';
+    char c2 = p + 2 < end ? p[2] : '\n';
+
+    if (c0 == 'v' && isBlank(c1)){
+      p += 2;
+      glm::vec3 vertex;
+      if (!parseFloat(p = skipBlanks(p, end), end, vertex.x) ||
+          !parseFloat(p = skipBlanks(p, end), end, vertex.y) ||
+          !parseFloat(p = skipBlanks(p, end), end, vertex.z)){
+        printf("File can't be read by our simple parser :-( Malformed vertex\n");
+        return false;
+      }
+      records.temp_vertices.push_back(vertex);
+    }
+    else if (c0 == 'v' && c1 == 't' && isBlank(c2)){
+      p += 3;
+      glm::vec2 uv;
+      if (!parseFloat(p = skipBlanks(p, end), end, uv.x) ||
+          !parseFloat(p = skipBlanks(p, end), end, uv.y)){
+        printf("File can't be read by our simple parser :-( Malformed texture coordinate\n");
+        return false;
+      }
+      uv.y = -uv.y; // Same V flip as loadOBJ
+      records.temp_uvs.push_back(uv);
+    }
+    else if (c0 == 'v' && c1 == 'n' && isBlank(c2)){
+      p += 3;
+      glm::vec3 normal;
+      if (!parseFloat(p = skipBlanks(p, end), end, normal.x) ||
+          !parseFloat(p = skipBlanks(p, end), end, normal.y) ||
+          !parseFloat(p = skipBlanks(p, end), end, normal.z)){
+        printf("File can't be read by our simple parser :-( Malformed normal\n");
+        return false;
+      }
+      records.temp_normals.push_back(normal);
+    }
+    else if (c0 == 'f' && isBlank(c1)){
+      p += 2;
+      unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
+      for (int i = 0; i < 3; i++){
+        if (!parseFaceCorner(p, end, vertexIndex[i], uvIndex[i], normalIndex[i])){
+          printf("File can't be read by our simple parser :-( Try exporting with other options\n");
+          return false;
+        }
+      }
+      records.vertexIndices.insert(records.vertexIndices.end(), vertexIndex, vertexIndex + 3);
+      records.uvIndices.insert(records.uvIndices.end(), uvIndex, uvIndex + 3);
+      records.normalIndices.insert(records.normalIndices.end(), normalIndex, normalIndex + 3);
+    }
+    // Anything else is a comment or something we don't support : the line is ignored
+
+    p = skipLine(p, end);
+  }
+  return true;
+}
+
+// Looks up the attributes of every face corner in `faces` and writes them to out_XXXX,
+// which must have room for them. The attribute arrays may come from other records
+// than the faces, which is how the parallel loader resolves its chunks.
+static bool resolveFaces(
+  const OBJRecords & faces,
+  const std::vector<glm::vec3> & vertices,
+  const std::vector<glm::vec2> & uvs,
+  const std::vector<glm::vec3> & normals,
+  glm::vec3 * out_vertices,
+  glm::vec2 * out_uvs,
+  glm::vec3 * out_normals
+  ){
+  size_t count = faces.vertexIndices.size();
+  for (size_t i = 0; i < count; i++){
+    unsigned int vertexIndex = faces.vertexIndices[i];
+    unsigned int uvIndex = faces.uvIndices[i];
+    unsigned int normalIndex = faces.normalIndices[i];
+
+    // Unlike loadOBJ, refuse to read outside of the arrays
+    if (vertexIndex - 1 >= vertices.size() ||
+        uvIndex - 1 >= uvs.size() ||
+        normalIndex - 1 >= normals.size()){
+      printf("File can't be read by our simple parser :-( Face index out of range\n");
+      return false;
+    }
+
+    out_vertices[i] = vertices[vertexIndex - 1];
+    out_uvs[i] = uvs[uvIndex - 1];
+    out_normals[i] = normals[normalIndex - 1];
+  }
+  return true;
+}
+
+// Expands the faces into one vertex/uv/normal per triangle corner, like loadOBJ does
+static bool resolveOBJRecords(
+  const OBJRecords & records,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  ){
+  size_t count = records.vertexIndices.size();
+  size_t first = out_vertices.size();
+  out_vertices.resize(first + count);
+  out_uvs.resize(first + count);
+  out_normals.resize(first + count);
+  if (count == 0)
+    return true;
+
+  return resolveFaces(records, records.temp_vertices, records.temp_uvs, records.temp_normals,
+                      &out_vertices[first], &out_uvs[first], &out_normals[first]);
+}
+
+// Same output as loadOBJ, but the file is mapped in memory and walked with
+// the hand-written parsers above instead of going through fscanf.
+bool loadOBJ_mapped(
+  const char * path,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  ){
+  printf("Loading OBJ file %s...\n", path);
+
+  MappedFile file;
+  if (!mapFile(path, file)){
+    printf("Impossible to open the file !\n");
+    return false;
+  }
+
+  OBJRecords records;
+  bool ok = parseOBJRecords(file.data, file.data + file.size, records) &&
+            resolveOBJRecords(records, out_vertices, out_uvs, out_normals);
+
+  unmapFile(file);
+  return ok;
+}
+
+// How many records of each kind parseOBJRecords will find in [p, end)
+struct OBJCounts{
+  size_t vertices, uvs, normals, faces;
+};
+
+// Cheap first pass : only looks at the first two characters of every line
+static void countOBJRecords(const char * p, const char * end, OBJCounts & counts){
+  memset(&counts, 0, sizeof(OBJCounts));
+  while (p < end){
+    p = skipBlanks(p, end);
+    if (p + 2 < end){
+      if (p[0] == 'v'){
+        if (isBlank(p[1]))                              counts.vertices++;
+        else if (p[1] == 't' && isBlank(p[2]))          counts.uvs++;
+        else if (p[1] == 'n' && isBlank(p[2]))          counts.normals++;
+      }
+      else if (p[0] == 'f' && isBlank(p[1]))            counts.faces++;
+    }
+    p = skipLine(p, end);
+  }
+}
+
+// Counts the records of a whole mapped file, allocates the record arrays at their
+// exact size, then parses into them
+static bool parseOBJRecords_reserved(const MappedFile & file, OBJRecords & records){
+  OBJCounts counts;
+  countOBJRecords(file.data, file.data + file.size, counts);
+
+  records.temp_vertices.reserve(counts.vertices);
+  records.temp_uvs.reserve(counts.uvs);
+  records.temp_normals.reserve(counts.normals);
+  records.vertexIndices.reserve(counts.faces * 3);
+  records.uvIndices.reserve(counts.faces * 3);
+  records.normalIndices.reserve(counts.faces * 3);
+
+  return parseOBJRecords(file.data, file.data + file.size, records);
+}
+
+// Same output as loadOBJ_mapped, but the file is scanned twice : once to count the
+// records, so that every array can be allocated at its exact final size, and once
+// to parse them. No buffer is ever regrown, so none is ever copied, and peak memory
+// is what the arrays need instead of up to twice that while a vector grows.
+bool loadOBJ_reserved(
+  const char * path,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  ){
+  printf("Loading OBJ file %s...\n", path);
+
+  MappedFile file;
+  if (!mapFile(path, file)){
+    printf("Impossible to open the file !\n");
+    return false;
+  }
+
+  OBJRecords records;
+  bool ok = parseOBJRecords_reserved(file, records);
+  if (ok){
+    out_vertices.reserve(out_vertices.size() + records.vertexIndices.size());
+    out_uvs.reserve(out_uvs.size() + records.vertexIndices.size());
+    out_normals.reserve(out_normals.size() + records.vertexIndices.size());
+    ok = resolveOBJRecords(records, out_vertices, out_uvs, out_normals);
+  }
+
+  unmapFile(file);
+  return ok;
+}
+
+// Don't bother spawning a thread for less text than this
+#define OBJ_MIN_CHUNK_SIZE (1 << 20)
+
+// Appends src to dst[offset...], dst must be big enough
+template <typename T>
+static void copyInto(std::vector<T> & dst, size_t offset, const std::vector<T> & src){
+  std::copy(src.begin(), src.end(), dst.begin() + offset);
+}
+
+// Same output as loadOBJ_mapped, bit for bit, but the text is split into line-aligned
+// chunks that are parsed on threadCount threads (0 = one per core) :
+//  1. every chunk parses its own v/vt/vn/f records
+//  2. a prefix sum over the per-chunk counts gives where each chunk's records start in
+//     the global arrays. The chunks are in file order, so concatenating them keeps the
+//     1-based OBJ indices valid
+//  3. every chunk copies its attributes into the global arrays, then resolves its faces
+//     straight into its slice of out_XXXX
+bool loadOBJ_parallel(
+  const char * path,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals,
+  unsigned int threadCount
+  ){
+  printf("Loading OBJ file %s...\n", path);
+
+  MappedFile file;
+  if (!mapFile(path, file)){
+    printf("Impossible to open the file !\n");
+    return false;
+  }
+
+  threadCount = workerCount(threadCount);
+  size_t chunkCount = file.size / OBJ_MIN_CHUNK_SIZE + 1;
+  if (chunkCount > threadCount)
+    chunkCount = threadCount;
+
+  // Split at newlines so that no record straddles two chunks
+  std::vector<const char *> bounds(chunkCount + 1);
+  const char * end = file.data + file.size;
+  bounds[0] = file.data;
+  bounds[chunkCount] = end;
+  for (size_t i = 1; i < chunkCount; i++){
+    const char * split = file.data + file.size / chunkCount * i;
+    if (split < bounds[i - 1])
+      split = bounds[i - 1];
+    bounds[i] = split > file.data && split[-1] == '\n' ? split : skipLine(split, end);
+  }
+
+  // 1. Parse
+  std::vector<OBJRecords> chunks(chunkCount);
+  std::vector<char> parsed(chunkCount);
+  parallelFor((unsigned int)chunkCount, threadCount, [&](unsigned int i){
+    parsed[i] = parseOBJRecords(bounds[i], bounds[i + 1], chunks[i]);
+  });
+
+  bool ok = true;
+  for (size_t i = 0; i < chunkCount; i++)
+    ok = ok && parsed[i];
+  if (!ok){
+    unmapFile(file);
+    return false;
+  }
+
+  // 2. Prefix sums
+  std::vector<size_t> vertexBase(chunkCount + 1, 0), uvBase(chunkCount + 1, 0), normalBase(chunkCount + 1, 0), cornerBase(chunkCount + 1, 0);
+  for (size_t i = 0; i < chunkCount; i++){
+    vertexBase[i + 1] = vertexBase[i] + chunks[i].temp_vertices.size();
+    uvBase[i + 1] = uvBase[i] + chunks[i].temp_uvs.size();
+    normalBase[i + 1] = normalBase[i] + chunks[i].temp_normals.size();
+    cornerBase[i + 1] = cornerBase[i] + chunks[i].vertexIndices.size();
+  }
+
+  // 3. Merge and resolve
+  std::vector<glm::vec3> vertices(vertexBase[chunkCount]);
+  std::vector<glm::vec2> uvs(uvBase[chunkCount]);
+  std::vector<glm::vec3> normals(normalBase[chunkCount]);
+  parallelFor((unsigned int)chunkCount, threadCount, [&](unsigned int i){
+    copyInto(vertices, vertexBase[i], chunks[i].temp_vertices);
+    copyInto(uvs, uvBase[i], chunks[i].temp_uvs);
+    copyInto(normals, normalBase[i], chunks[i].temp_normals);
+    std::vector<glm::vec3>().swap(chunks[i].temp_vertices);
+    std::vector<glm::vec2>().swap(chunks[i].temp_uvs);
+    std::vector<glm::vec3>().swap(chunks[i].temp_normals);
+  });
+
+  size_t first = out_vertices.size();
+  out_vertices.resize(first + cornerBase[chunkCount]);
+  out_uvs.resize(first + cornerBase[chunkCount]);
+  out_normals.resize(first + cornerBase[chunkCount]);
+  parallelFor((unsigned int)chunkCount, threadCount, [&](unsigned int i){
+    size_t at = first + cornerBase[i];
+    if (cornerBase[i + 1] > cornerBase[i])
+      parsed[i] = resolveFaces(chunks[i], vertices, uvs, normals, &out_vertices[at], &out_uvs[at], &out_normals[at]);
+  });
+
+  for (size_t i = 0; i < chunkCount; i++)
+    ok = ok && parsed[i];
+
+  unmapFile(file);
+  return ok;
+}
+
+// One face corner as the OBJ file spells it : "v/vt/vn"
+struct OBJCorner{
+  unsigned int vertexIndex, uvIndex, normalIndex;
+};
+
+struct OBJCornerTraits{
+  static unsigned int hash(const OBJCorner & corner){
+    return mixHash(corner.vertexIndex * 0x9e3779b1 ^ mixHash(corner.uvIndex * 0x85ebca77 ^ mixHash(corner.normalIndex)));
+  }
+  static bool equal(const OBJCorner & a, const OBJCorner & b){
+    return a.vertexIndex == b.vertexIndex && a.uvIndex == b.uvIndex && a.normalIndex == b.normalIndex;
+  }
+};
+
+// Where loadIndexedOBJ_impl and indexVBO_hashed put the vertices they find :
+// one array per attribute, or a single interleaved array
+struct SeparateVertices{
+  std::vector<glm::vec3> & vertices;
+  std::vector<glm::vec2> & uvs;
+  std::vector<glm::vec3> & normals;
+
+  size_t size() const{
+    return vertices.size();
+  }
+  void push_back(const glm::vec3 & vertex, const glm::vec2 & uv, const glm::vec3 & normal){
+    vertices.push_back(vertex);
+    uvs.push_back(uv);
+    normals.push_back(normal);
+  }
+};
+
+struct InterleavedVertices{
+  std::vector<PackedVertex> & vertices;
+
+  size_t size() const{
+    return vertices.size();
+  }
+  void push_back(const glm::vec3 & vertex, const glm::vec2 & uv, const glm::vec3 & normal){
+    PackedVertex packed = { vertex, uv, normal };
+    vertices.push_back(packed);
+  }
+};
+
+// loadOBJ followed by indexVBO, without the triangle soup in between.
+// The file already tells which corners share a vertex : they spell the same
+// v/vt/vn triple. So instead of expanding every corner into full attributes and
+// comparing those again in indexVBO, corners are deduplicated on their triple
+// while the faces are resolved, and the indexed buffers come out directly.
+// Corners that use different triples for identical values (rare in exported
+// files) stay separate vertices, where indexVBO would have merged them.
+template <typename Index, typename Vertices>
+static bool loadIndexedOBJ_impl(
+  const char * path,
+  std::vector<Index> & out_indices,
+  Vertices out_vertices
+  ){
+  printf("Loading OBJ file %s...\n", path);
+
+  MappedFile file;
+  if (!mapFile(path, file)){
+    printf("Impossible to open the file !\n");
+    return false;
+  }
+
+  OBJRecords records;
+  bool ok = parseOBJRecords_reserved(file, records);
+  unmapFile(file);
+  if (!ok)
+    return false;
+
+  size_t cornerCount = records.vertexIndices.size();
+  IndexHashMap<OBJCorner, OBJCornerTraits> cornerToOutIndex(cornerCount);
+  out_indices.reserve(out_indices.size() + cornerCount);
+
+  unsigned int first = (unsigned int)out_vertices.size();
+  for (size_t i = 0; i < cornerCount; i++){
+    OBJCorner corner = { records.vertexIndices[i], records.uvIndices[i], records.normalIndices[i] };
+
+    bool inserted;
+    unsigned int index = cornerToOutIndex.findOrInsert(corner, inserted);
+
+    if (inserted){ // First time we see this triple : it becomes a new vertex
+      if (corner.vertexIndex - 1 >= records.temp_vertices.size() ||
+          corner.uvIndex - 1 >= records.temp_uvs.size() ||
+          corner.normalIndex - 1 >= records.temp_normals.size()){
+        printf("File can't be read by our simple parser :-( Face index out of range\n");
+        return false;
+      }
+      out_vertices.push_back(
+        records.temp_vertices[corner.vertexIndex - 1],
+        records.temp_uvs[corner.uvIndex - 1],
+        records.temp_normals[corner.normalIndex - 1]);
+    }
+    out_indices.push_back((Index)(first + index));
+  }
+
+  return true;
+}
+
+bool loadIndexedOBJ(
+  const char * path,
+  std::vector<unsigned short> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  ){
+  SeparateVertices vertices = { out_vertices, out_uvs, out_normals };
+  if (!loadIndexedOBJ_impl(path, out_indices, vertices))
+    return false;
+  // The indices would have wrapped around
+  if (out_vertices.size() > 65536){
+    printf("Too many vertices for 16-bit indices (%u), use 32-bit indices\n", (unsigned int)out_vertices.size());
+    return false;
+  }
+  return true;
+}
+
+bool loadIndexedOBJ(
+  const char * path,
+  std::vector<unsigned int> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  ){
+  SeparateVertices vertices = { out_vertices, out_uvs, out_normals };
+  return loadIndexedOBJ_impl(path, out_indices, vertices);
+}
+
+bool loadIndexedOBJ(
+  const char * path,
+  std::vector<unsigned int> & out_indices,
+  std::vector<PackedVertex> & out_vertices
+  ){
+  InterleavedVertices vertices = { out_vertices };
+  return loadIndexedOBJ_impl(path, out_indices, vertices);
+}
+
+// How much a vertex of a streamOBJ batch costs : the vertex, its triple, up to
+// 4 slots of the hash table, and about 6 indices
+#define OBJ_STREAM_VERTEX_BYTES (sizeof(PackedVertex) + sizeof(OBJCorner) + 4 * 8 + 6 * sizeof(unsigned int))
+
+enum OBJScratch{ SCRATCH_VERTICES, SCRATCH_UVS, SCRATCH_NORMALS, SCRATCH_CORNERS, SCRATCH_COUNT };
+
+// Appends a chunk of records to a scratch file
+template <typename T>
+static bool writeScratch(FILE * file, const std::vector<T> & records){
+  return records.empty() || fwrite(&records[0], sizeof(T), records.size(), file) == records.size();
+}
+
+// Reads the whole file through a window of memoryBudget / 8 bytes and writes what
+// every chunk of whole lines holds to the scratch files : attributes as they
+// are, faces as v/vt/vn triples
+static bool streamOBJRecords(FILE * file, size_t memoryBudget, FILE * scratch[SCRATCH_COUNT]){
+  std::vector<char> window(memoryBudget / 8);
+  size_t filled = 0;
+  OBJRecords records;
+  std::vector<OBJCorner> corners;
+  while (true){
+    filled += fread(&window[filled], 1, window.size() - filled, file);
+    bool last = filled < window.size();
+    if (filled == 0)
+      return true;
+
+    // Whole lines only, the rest of the last one waits for the next read
+    size_t chunk = filled;
+    if (!last){
+      while (chunk > 0 && window[chunk - 1] != '\n')
+        chunk--;
+      if (chunk == 0){
+        printf("File can't be read by our simple parser :-( Line longer than the window\n");
+        return false;
+      }
+    }
+
+    records.vertexIndices.clear(), records.uvIndices.clear(), records.normalIndices.clear();
+    records.temp_vertices.clear(), records.temp_uvs.clear(), records.temp_normals.clear();
+    if (!parseOBJRecords(&window[0], &window[0] + chunk, records))
+      return false;
+    corners.resize(records.vertexIndices.size());
+    for (size_t i = 0; i < corners.size(); i++){
+      OBJCorner corner = { records.vertexIndices[i], records.uvIndices[i], records.normalIndices[i] };
+      corners[i] = corner;
+    }
+    if (!writeScratch(scratch[SCRATCH_VERTICES], records.temp_vertices) || !writeScratch(scratch[SCRATCH_UVS], records.temp_uvs) ||
+        !writeScratch(scratch[SCRATCH_NORMALS], records.temp_normals) || !writeScratch(scratch[SCRATCH_CORNERS], corners)){
+      printf("Could not write the scratch files\n");
+      return false;
+    }
+
+    memmove(&window[0], &window[chunk], filled - chunk);
+    filled -= chunk;
+    if (last && filled == 0)
+      return true;
+  }
+}
+
+// Indexes the triples, read through a window of windowSize triangles, in batches
+// of at most maxVertices vertices and hands them out. The attributes are looked
+// up in the mapped scratch files.
+static bool streamOBJBatches(
+  const MappedFile scratch[SCRATCH_COUNT],
+  FILE * cornerFile,
+  size_t windowSize,
+  size_t maxVertices,
+  OBJBatchCallback callback,
+  void * user
+  ){
+  const glm::vec3 * positions = (const glm::vec3 *)scratch[SCRATCH_VERTICES].data;
+  const glm::vec2 * uvs = (const glm::vec2 *)scratch[SCRATCH_UVS].data;
+  const glm::vec3 * normals = (const glm::vec3 *)scratch[SCRATCH_NORMALS].data;
+  size_t positionCount = scratch[SCRATCH_VERTICES].size / sizeof(glm::vec3);
+  size_t uvCount = scratch[SCRATCH_UVS].size / sizeof(glm::vec2);
+  size_t normalCount = scratch[SCRATCH_NORMALS].size / sizeof(glm::vec3);
+  size_t maxIndices = maxVertices * 6;
+  IndexHashMap<OBJCorner, OBJCornerTraits> cornerToBatchIndex(maxVertices);
+  std::vector<PackedVertex> vertices;
+  std::vector<unsigned int> indices;
+  vertices.reserve(maxVertices);
+  indices.reserve(maxIndices);
+
+  OBJBatch batch = { NULL, 0, NULL, 0, 0, 0 };
+  auto handOut = [&](){
+    batch.indices = &indices[0], batch.indexCount = indices.size();
+    batch.vertices = &vertices[0], batch.vertexCount = vertices.size();
+    bool ok = callback(batch, user);
+    batch.firstIndex += indices.size(), batch.firstVertex += vertices.size();
+    indices.clear(), vertices.clear(), cornerToBatchIndex.clear();
+    return ok;
+  };
+
+  std::vector<OBJCorner> corners(windowSize * 3);
+  size_t cornerCount;
+  do{
+    cornerCount = fread(&corners[0], sizeof(OBJCorner), corners.size(), cornerFile);
+    for (size_t i = 0; i + 3 <= cornerCount; i += 3){
+      // Hand the batch out when the next triangle may not fit
+      if (vertices.size() + 3 > maxVertices || indices.size() + 3 > maxIndices){
+        if (!handOut())
+          return false;
+      }
+
+      for (size_t c = i; c < i + 3; c++){
+        const OBJCorner & corner = corners[c];
+        bool inserted;
+        unsigned int index = cornerToBatchIndex.findOrInsert(corner, inserted);
+        if (inserted){
+          if (corner.vertexIndex - 1 >= positionCount || corner.uvIndex - 1 >= uvCount || corner.normalIndex - 1 >= normalCount){
+            printf("File can't be read by our simple parser :-( Face index out of range\n");
+            return false;
+          }
+          PackedVertex vertex = { positions[corner.vertexIndex - 1], uvs[corner.uvIndex - 1], normals[corner.normalIndex - 1] };
+          vertices.push_back(vertex);
+        }
+        indices.push_back(index);
+      }
+    }
+  } while (cornerCount == corners.size());
+
+  return indices.empty() || handOut();
+}
+
+bool streamOBJ(
+  const char * path,
+  size_t memoryBudget,
+  OBJBatchCallback callback,
+  void * user
+  ){
+  printf("Streaming OBJ file %s...\n", path);
+  if (memoryBudget < OBJ_STREAM_MIN_BUDGET)
+    memoryBudget = OBJ_STREAM_MIN_BUDGET;
+
+  FILE * file = fopen(path, "rb");
+  if (!file){
+    printf("Impossible to open the file !\n");
+    return false;
+  }
+
+  // First pass : the text into binary scratch files
+  static const char * scratchSuffixes[SCRATCH_COUNT] = { ".v.tmp", ".vt.tmp", ".vn.tmp", ".f.tmp" };
+  std::string scratchPaths[SCRATCH_COUNT];
+  FILE * scratchFiles[SCRATCH_COUNT];
+  bool ok = true;
+  for (int i = 0; i < SCRATCH_COUNT; i++){
+    scratchPaths[i] = std::string(path) + scratchSuffixes[i];
+    scratchFiles[i] = fopen(scratchPaths[i].c_str(), "wb");
+    ok = ok && scratchFiles[i];
+  }
+  if (!ok)
+    printf("Could not write the scratch files\n");
+  ok = ok && streamOBJRecords(file, memoryBudget, scratchFiles);
+  fclose(file);
+  for (int i = 0; i < SCRATCH_COUNT; i++)
+    if (scratchFiles[i])
+      ok = fclose(scratchFiles[i]) == 0 && ok;
+
+  // Second pass : the faces, read in order through a window again, into half the
+  // budget worth of batch. The attributes are looked up anywhere, they are mapped.
+  // Only the attributes are mapped, the corners are read through cornerFile
+  MappedFile scratch[SCRATCH_COUNT];
+  int mappedCount = 0;
+  for (int i = 0; ok && i < SCRATCH_CORNERS; i++){
+    ok = mapFile(scratchPaths[i].c_str(), scratch[i]);
+    mappedCount += ok;
+  }
+  FILE * cornerFile = ok ? fopen(scratchPaths[SCRATCH_CORNERS].c_str(), "rb") : NULL;
+  ok = cornerFile && streamOBJBatches(scratch, cornerFile, memoryBudget / 8 / (3 * sizeof(OBJCorner)),
+                                      memoryBudget / 2 / OBJ_STREAM_VERTEX_BYTES, callback, user);
+  if (cornerFile)
+    fclose(cornerFile);
+
+  for (int i = 0; i < mappedCount; i++)
+    unmapFile(scratch[i]);
+  for (int i = 0; i < SCRATCH_COUNT; i++)
+    remove(scratchPaths[i].c_str());
+  return ok;
+}
+
 // Returns true iif v1 can be considered equal to v2
 bool is_near(float v1, float v2){
   return fabs(v1 - v2) < 0.01f;
@@ -187,15 +967,147 @@ void indexVBO_slow(
   }
 }
 
-struct PackedVertex{
-  glm::vec3 position;
-  glm::vec2 uv;
-  glm::vec3 normal;
-  bool operator<(const PackedVertex that) const{
-    return memcmp((void*)this, (void*)&that, sizeof(PackedVertex))>0;
-  };
+// A uniform grid over the positions of the vertices emitted so far, so that
+// getSimilarVertexIndex doesn't have to look at all of them. Cells are as wide
+// as the tolerance (plus a hair for rounding), so any vertex is_near a position lies in the position's
+// cell or one of its 26 neighbours ; those are the only candidates tested.
+// Only occupied cells exist, numbered through a hash map.
+struct WeldCell{
+  int x, y, z;
+};
+
+static const unsigned int NONE = 0xffffffffu; // End of a cell list
+
+struct WeldCellTraits{
+  static unsigned int hash(const WeldCell & cell){
+    return mixHash(cell.x * 0x8da6b343 ^ cell.y * 0xd8163841 ^ cell.z * 0xcb1ab31f);
+  }
+  static bool equal(const WeldCell & a, const WeldCell & b){
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+  }
+};
+
+class VertexWeldGrid{
+public:
+  VertexWeldGrid(float tolerance, size_t expectedCount) : cellSize(tolerance * 1.001), cells(expectedCount){
+  }
+
+  // Same answer as getSimilarVertexIndex : the first vertex of out_XXXX that is near in_XXXX
+  bool find(
+    const glm::vec3 & in_vertex,
+    const glm::vec2 & in_uv,
+    const glm::vec3 & in_normal,
+    const std::vector<glm::vec3> & out_vertices,
+    const std::vector<glm::vec2> & out_uvs,
+    const std::vector<glm::vec3> & out_normals,
+    unsigned int & result
+    ) const{
+    WeldCell center = cellOf(in_vertex);
+    bool found = false;
+    for (int dz = -1; dz <= 1; dz++)
+      for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -1; dx <= 1; dx++){
+          WeldCell cell = { center.x + dx, center.y + dy, center.z + dz };
+          unsigned int cellIndex;
+          if (!cells.find(cell, cellIndex))
+            continue;
+
+          // Lists are in index order and the lowest index must win, like in the
+          // linear search : stop at the first match, or once past a match from another cell
+          for (unsigned int i = heads[cellIndex]; i != NONE && (!found || i < result); i = next[i]){
+            if (
+              is_near(in_vertex.x, out_vertices[i].x) &&
+              is_near(in_vertex.y, out_vertices[i].y) &&
+              is_near(in_vertex.z, out_vertices[i].z) &&
+              is_near(in_uv.x, out_uvs[i].x) &&
+              is_near(in_uv.y, out_uvs[i].y) &&
+              is_near(in_normal.x, out_normals[i].x) &&
+              is_near(in_normal.y, out_normals[i].y) &&
+              is_near(in_normal.z, out_normals[i].z)
+              ){
+              result = i;
+              found = true;
+              break;
+            }
+          }
+        }
+    return found;
+  }
+
+  // Registers the vertex that was just appended to out_XXXX, at index out_vertices.size() - 1
+  void add(const glm::vec3 & vertex){
+    unsigned int index = (unsigned int)next.size();
+    next.push_back(NONE);
+
+    bool inserted;
+    unsigned int cellIndex = cells.findOrInsert(cellOf(vertex), inserted);
+    if (inserted){
+      heads.push_back(index);
+      tails.push_back(index);
+    }
+    else{
+      next[tails[cellIndex]] = index;
+      tails[cellIndex] = index;
+    }
+  }
+
+private:
+  int coordinate(float value) const{
+    double cell = floor(value / cellSize);
+    // Far away (or nan) coordinates share the outermost cells, which only costs time
+    if (!(cell > -2e9)) return -2000000000;
+    if (!(cell < 2e9))  return 2000000000;
+    return (int)cell;
+  }
+
+  WeldCell cellOf(const glm::vec3 & vertex) const{
+    WeldCell cell = { coordinate(vertex.x), coordinate(vertex.y), coordinate(vertex.z) };
+    return cell;
+  }
+
+  double cellSize;
+  IndexHashMap<WeldCell, WeldCellTraits> cells;
+  std::vector<unsigned int> heads; // First vertex of every cell
+  std::vector<unsigned int> tails; // Last vertex of every cell
+  std::vector<unsigned int> next;  // Next vertex in the same cell, for every vertex
 };
 
+// Same output as indexVBO_slow, in near-linear time : similar vertices are
+// looked for through a VertexWeldGrid instead of a linear search.
+void indexVBO_welded(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
+  std::vector<unsigned short> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  ){
+  VertexWeldGrid grid(0.01f, in_vertices.size());
+  for (unsigned int i = 0; i < out_vertices.size(); i++)
+    grid.add(out_vertices[i]);
+
+  // For each input vertex
+  for (unsigned int i = 0; i<in_vertices.size(); i++){
+
+    // Try to find a similar vertex in out_XXXX
+    unsigned int index;
+    bool found = grid.find(in_vertices[i], in_uvs[i], in_normals[i], out_vertices, out_uvs, out_normals, index);
+
+    if (found){ // A similar vertex is already in the VBO, use it instead !
+      out_indices.push_back((unsigned short)index);
+    }
+    else{ // If not, it needs to be added in the output data.
+      out_vertices.push_back(in_vertices[i]);
+      out_uvs.push_back(in_uvs[i]);
+      out_normals.push_back(in_normals[i]);
+      out_indices.push_back((unsigned short)out_vertices.size() - 1);
+      grid.add(in_vertices[i]);
+    }
+  }
+}
+
 bool getSimilarVertexIndex_fast(
   PackedVertex & packed,
   std::map<PackedVertex, unsigned short> & VertexToOutIndex,
@@ -211,7 +1123,8 @@ bool getSimilarVertexIndex_fast(
   }
 }
 
-void indexVBO(
+// The original std::map indexer, kept as a reference for the benchmarks
+void indexVBO_map(
   std::vector<glm::vec3> & in_vertices,
   std::vector<glm::vec2> & in_uvs,
   std::vector<glm::vec3> & in_normals,
@@ -247,6 +1160,215 @@ void indexVBO(
   }
 }
 
+// Two vertices are the same if they have exactly the same bits, like with
+// the memcmp in PackedVertex::operator<. PackedVertex is 8 floats, no padding.
+struct PackedVertexTraits{
+  static unsigned int hash(const PackedVertex & vertex){
+    return hashWords(&vertex, sizeof(PackedVertex));
+  }
+  static bool equal(const PackedVertex & a, const PackedVertex & b){
+    return memcmp(&a, &b, sizeof(PackedVertex)) == 0;
+  }
+};
+
+// Same output as indexVBO_map, but duplicates are found through an
+// open-addressing hash table whose slots are sized for the worst case (every
+// vertex unique) up front : no rehashing, and a lookup is usually a single
+// cache line plus one key compare instead of log2(n) scattered tree nodes.
+template <typename Index, typename Vertices>
+static void indexVBO_hashed(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
+  std::vector<Index> & out_indices,
+  Vertices out_vertices
+  ){
+  IndexHashMap<PackedVertex, PackedVertexTraits> VertexToOutIndex(in_vertices.size());
+  out_indices.reserve(out_indices.size() + in_vertices.size());
+  unsigned int first = (unsigned int)out_vertices.size();
+
+  // For each input vertex
+  for (unsigned int i = 0; i<in_vertices.size(); i++){
+
+    PackedVertex packed = { in_vertices[i], in_uvs[i], in_normals[i] };
+
+    // Look for the same vertex in out_XXXX. New vertices are numbered in the
+    // order they are found, which is the order they are added below.
+    bool inserted;
+    unsigned int index = first + VertexToOutIndex.findOrInsert(packed, inserted);
+
+    if (inserted) // If not, it needs to be added in the output data.
+      out_vertices.push_back(in_vertices[i], in_uvs[i], in_normals[i]);
+    out_indices.push_back((Index)index);
+  }
+}
+
+void indexVBO(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
+  std::vector<unsigned short> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  ){
+  SeparateVertices vertices = { out_vertices, out_uvs, out_normals };
+  indexVBO_hashed(in_vertices, in_uvs, in_normals, out_indices, vertices);
+  // The indices have wrapped around
+  if (out_vertices.size() > 65536)
+    printf("Too many vertices for 16-bit indices (%u), use 32-bit indices\n", (unsigned int)out_vertices.size());
+}
+
+void indexVBO(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
+  std::vector<unsigned int> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  ){
+  SeparateVertices vertices = { out_vertices, out_uvs, out_normals };
+  indexVBO_hashed(in_vertices, in_uvs, in_normals, out_indices, vertices);
+}
+
+void indexVBO(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
+  std::vector<unsigned int> & out_indices,
+  std::vector<PackedVertex> & out_vertices
+  ){
+  InterleavedVertices vertices = { out_vertices };
+  indexVBO_hashed(in_vertices, in_uvs, in_normals, out_indices, vertices);
+}
+
+// Corners are split into this many shards by hash, whatever the thread count
+#define INDEX_SHARD_COUNT 256
+// and are scanned and scattered in blocks of this many
+#define INDEX_BLOCK_SIZE (1 << 16)
+
+// Same vertices and same indices as indexVBO, but 32-bit and built on threadCount
+// threads (0 = one per core) :
+//  1. every corner is hashed, and counted in the shard the top bits of its hash pick
+//  2. corners are scattered into per-shard lists that stay in input order
+//  3. every shard is deduplicated on its own : each corner learns the first corner
+//     that has the same vertex. Equal vertices always share a shard.
+//  4. the corners that came first are numbered in input order, with a prefix sum
+//     over blocks, which is the order indexVBO discovers vertices in
+//  5. every corner takes the number of its first corner
+// None of the steps depends on how work is spread over threads, so the output is
+// the same on every run and for any thread count.
+void indexVBO_parallel(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
+  std::vector<unsigned int> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals,
+  unsigned int threadCount
+  ){
+  size_t cornerCount = in_vertices.size();
+  unsigned int blockCount = (unsigned int)((cornerCount + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE);
+  threadCount = workerCount(threadCount);
+
+  // 1. Hash and count
+  std::vector<unsigned int> hashes(cornerCount);
+  std::vector<size_t> shardOffsets((size_t)blockCount * INDEX_SHARD_COUNT, 0); // [shard][block]
+  parallelFor(blockCount, threadCount, [&](unsigned int block){
+    size_t begin = (size_t)block * INDEX_BLOCK_SIZE, end = std::min(begin + INDEX_BLOCK_SIZE, cornerCount);
+    for (size_t i = begin; i < end; i++){
+      PackedVertex packed = { in_vertices[i], in_uvs[i], in_normals[i] };
+      hashes[i] = PackedVertexTraits::hash(packed);
+      shardOffsets[(hashes[i] >> 24) * blockCount + block]++;
+    }
+  });
+
+  // 2. Scatter into shards. Shard-major prefix sum : shard s, block b starts at shardOffsets[s][b]
+  std::vector<size_t> shardBegin(INDEX_SHARD_COUNT + 1);
+  size_t total = 0;
+  for (unsigned int shard = 0; shard < INDEX_SHARD_COUNT; shard++){
+    shardBegin[shard] = total;
+    for (unsigned int block = 0; block < blockCount; block++){
+      size_t count = shardOffsets[shard * blockCount + block];
+      shardOffsets[shard * blockCount + block] = total;
+      total += count;
+    }
+  }
+  shardBegin[INDEX_SHARD_COUNT] = total;
+
+  std::vector<unsigned int> shardCorners(cornerCount);
+  parallelFor(blockCount, threadCount, [&](unsigned int block){
+    size_t begin = (size_t)block * INDEX_BLOCK_SIZE, end = std::min(begin + INDEX_BLOCK_SIZE, cornerCount);
+    for (size_t i = begin; i < end; i++)
+      shardCorners[shardOffsets[(hashes[i] >> 24) * blockCount + block]++] = (unsigned int)i;
+  });
+
+  // 3. Deduplicate every shard : firstCorners[i] is the first corner with the same vertex as corner i
+  std::vector<unsigned int> firstCorners(cornerCount);
+  parallelFor(INDEX_SHARD_COUNT, threadCount, [&](unsigned int shard){
+    size_t begin = shardBegin[shard], end = shardBegin[shard + 1];
+    IndexHashMap<PackedVertex, PackedVertexTraits> vertexToFirst(end - begin);
+    std::vector<unsigned int> firsts;
+    for (size_t j = begin; j < end; j++){
+      unsigned int i = shardCorners[j];
+      PackedVertex packed = { in_vertices[i], in_uvs[i], in_normals[i] };
+      bool inserted;
+      unsigned int unique = vertexToFirst.findOrInsert(packed, hashes[i], inserted);
+      if (inserted)
+        firsts.push_back(i);
+      firstCorners[i] = firsts[unique];
+    }
+  });
+  std::vector<unsigned int>().swap(shardCorners);
+  std::vector<unsigned int>().swap(hashes);
+
+  // 4. Number the first corners in input order
+  std::vector<size_t> blockFirst(blockCount + 1, 0);
+  parallelFor(blockCount, threadCount, [&](unsigned int block){
+    size_t begin = (size_t)block * INDEX_BLOCK_SIZE, end = std::min(begin + INDEX_BLOCK_SIZE, cornerCount);
+    for (size_t i = begin; i < end; i++)
+      blockFirst[block + 1] += firstCorners[i] == i;
+  });
+  for (unsigned int block = 0; block < blockCount; block++)
+    blockFirst[block + 1] += blockFirst[block];
+
+  size_t first = out_vertices.size();
+  size_t uniqueCount = blockFirst[blockCount];
+  out_vertices.resize(first + uniqueCount);
+  out_uvs.resize(first + uniqueCount);
+  out_normals.resize(first + uniqueCount);
+
+  std::vector<unsigned int> vertexIndices(cornerCount);
+  parallelFor(blockCount, threadCount, [&](unsigned int block){
+    size_t begin = (size_t)block * INDEX_BLOCK_SIZE, end = std::min(begin + INDEX_BLOCK_SIZE, cornerCount);
+    size_t next = first + blockFirst[block];
+    for (size_t i = begin; i < end; i++){
+      if (firstCorners[i] != i)
+        continue;
+      out_vertices[next] = in_vertices[i];
+      out_uvs[next] = in_uvs[i];
+      out_normals[next] = in_normals[i];
+      vertexIndices[i] = (unsigned int)next++;
+    }
+  });
+
+  // 5. Every corner uses the vertex of its first corner
+  size_t firstIndex = out_indices.size();
+  out_indices.resize(firstIndex + cornerCount);
+  parallelFor(blockCount, threadCount, [&](unsigned int block){
+    size_t begin = (size_t)block * INDEX_BLOCK_SIZE, end = std::min(begin + INDEX_BLOCK_SIZE, cornerCount);
+    for (size_t i = begin; i < end; i++)
+      out_indices[firstIndex + i] = vertexIndices[firstCorners[i]];
+  });
+}
+
 void indexVBO_TBN(
   std::vector<glm::vec3> & in_vertices,
   std::vector<glm::vec2> & in_uvs,
@@ -261,15 +1383,19 @@ void indexVBO_TBN(
   std::vector<glm::vec3> & out_tangents,
   std::vector<glm::vec3> & out_bitangents
   ){
+  VertexWeldGrid grid(0.01f, in_vertices.size());
+  for (unsigned int i = 0; i < out_vertices.size(); i++)
+    grid.add(out_vertices[i]);
+
   // For each input vertex
   for (unsigned int i = 0; i<in_vertices.size(); i++){
 
     // Try to find a similar vertex in out_XXXX
-    unsigned short index;
-    bool found = getSimilarVertexIndex(in_vertices[i], in_uvs[i], in_normals[i], out_vertices, out_uvs, out_normals, index);
+    unsigned int index;
+    bool found = grid.find(in_vertices[i], in_uvs[i], in_normals[i], out_vertices, out_uvs, out_normals, index);
 
     if (found){ // A similar vertex is already in the VBO, use it instead !
-      out_indices.push_back(index);
+      out_indices.push_back((unsigned short)index);
 
       // Average the tangents and the bitangents
       out_tangents[index] += in_tangents[i];
@@ -282,60 +1408,149 @@ void indexVBO_TBN(
       out_tangents.push_back(in_tangents[i]);
       out_bitangents.push_back(in_bitangents[i]);
       out_indices.push_back((unsigned short)out_vertices.size() - 1);
+      grid.add(in_vertices[i]);
     }
   }
 }
 
-GLuint loadBMP(const char * imagepath, GLint internalFormat){
+// A corner for indexVBO_TBN_fast : its vertex, and whether its bitangent is
+// cross(normal, tangent) (1) or the opposite (-1). Mirrored uvs flip it, and
+// corners on either side of a mirror must not average their tangents.
+// 9 floats, no padding.
+struct TBNCorner{
+  PackedVertex vertex;
+  float handedness;
+};
 
-  printf("Reading image %s\n", imagepath);
+struct TBNCornerTraits{
+  static unsigned int hash(const TBNCorner & corner){
+    return hashWords(&corner, sizeof(TBNCorner));
+  }
+  static bool equal(const TBNCorner & a, const TBNCorner & b){
+    return memcmp(&a, &b, sizeof(TBNCorner)) == 0;
+  }
+};
+
+void indexVBO_TBN_fast(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+  std::vector<glm::vec3> & in_tangents,
+  std::vector<glm::vec3> & in_bitangents,
+
+  std::vector<unsigned int> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals,
+  std::vector<glm::vec3> & out_tangents,
+  std::vector<glm::vec3> & out_bitangents
+  ){
+  IndexHashMap<TBNCorner, TBNCornerTraits> cornerToOutIndex(in_vertices.size());
+  out_indices.reserve(out_indices.size() + in_vertices.size());
+  unsigned int first = (unsigned int)out_vertices.size();
+
+  // For each input vertex
+  for (unsigned int i = 0; i < in_vertices.size(); i++){
+    float handedness = glm::dot(glm::cross(in_normals[i], in_tangents[i]), in_bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+    TBNCorner corner = { { in_vertices[i], in_uvs[i], in_normals[i] }, handedness };
+
+    bool inserted;
+    unsigned int index = first + cornerToOutIndex.findOrInsert(corner, inserted);
+    if (inserted){ // If not, it needs to be added in the output data.
+      out_vertices.push_back(in_vertices[i]);
+      out_uvs.push_back(in_uvs[i]);
+      out_normals.push_back(in_normals[i]);
+      out_tangents.push_back(in_tangents[i]);
+      out_bitangents.push_back(in_bitangents[i]);
+    }
+    else{ // Sum the tangents and the bitangents
+      out_tangents[index] += in_tangents[i];
+      out_bitangents[index] += in_bitangents[i];
+    }
+    out_indices.push_back(index);
+  }
+
+  // Make the sums an orthonormal basis around the normal (Gram-Schmidt), the
+  // bitangent only keeping its side
+  for (size_t v = first; v < out_vertices.size(); v++){
+    glm::vec3 normal = out_normals[v];
+    if (glm::length(normal) > 0.0f)
+      normal = glm::normalize(normal);
+    glm::vec3 tangent = out_tangents[v] - normal * glm::dot(normal, out_tangents[v]);
+    if (glm::length(tangent) == 0.0f) // Only degenerate corners, pick any tangent
+      tangent = glm::cross(normal, fabsf(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+    if (glm::length(tangent) > 0.0f)
+      tangent = glm::normalize(tangent);
+    float handedness = glm::dot(glm::cross(normal, tangent), out_bitangents[v]) < 0.0f ? -1.0f : 1.0f;
+    out_tangents[v] = tangent;
+    out_bitangents[v] = glm::cross(normal, tangent) * handedness;
+  }
+}
 
+bool readBMPInfo(FILE * file, BMPInfo & out_info){
   // Data read from the header of the BMP file
   unsigned char header[54];
-  unsigned int dataPos;
-  unsigned int imageSize;
-  unsigned int width, height;
-  // Actual RGB data
-  unsigned char * data;
-
-  // Open the file
-  FILE * file = fopen(imagepath, "rb");
-  if (!file)							    { printf("%s could not be opened.\n", imagepath); return 0; }
 
   // Read the header, i.e. the 54 first bytes
 
   // If less than 54 bytes are read, problem
-  if (fread(header, 1, 54, file) != 54){
-    printf("Not a correct BMP file\n");
-    return 0;
-  }
   // A BMP files always begins with "BM"
-  if (header[0] != 'B' || header[1] != 'M'){
+  // Make sure this is a 24bpp file
+  if (fread(header, 1, 54, file) != 54 || header[0] != 'B' || header[1] != 'M' ||
+      *(int*)&(header[0x1E]) != 0 || *(int*)&(header[0x1C]) != 24){
     printf("Not a correct BMP file\n");
-    return 0;
+    return false;
   }
-  // Make sure this is a 24bpp file
-  if (*(int*)&(header[0x1E]) != 0)         { printf("Not a correct BMP file\n");    return 0; }
-  if (*(int*)&(header[0x1C]) != 24)         { printf("Not a correct BMP file\n");    return 0; }
 
   // Read the information about the image
-  dataPos = *(int*)&(header[0x0A]);
-  imageSize = *(int*)&(header[0x22]);
-  width = *(int*)&(header[0x12]);
-  height = *(int*)&(header[0x16]);
+  out_info.dataPos = *(int*)&(header[0x0A]);
+  out_info.imageSize = *(int*)&(header[0x22]);
+  out_info.width = *(int*)&(header[0x12]);
+  out_info.height = *(int*)&(header[0x16]);
 
   // Some BMP files are misformatted, guess missing information
-  if (imageSize == 0)    imageSize = width*height * 3; // 3 : one byte for each Red, Green and Blue component
-  if (dataPos == 0)      dataPos = 54; // The BMP header is done that way
+  if (out_info.imageSize == 0)    out_info.imageSize = out_info.width*out_info.height * 3; // 3 : one byte for each Red, Green and Blue component
+  if (out_info.dataPos == 0)      out_info.dataPos = 54; // The BMP header is done that way
+
+  // Leave the file where the pixels are
+  if (out_info.imageSize == 0 || fseek(file, out_info.dataPos, SEEK_SET) != 0){
+    printf("Not a correct BMP file\n");
+    return false;
+  }
+  return true;
+}
+
+bool decodeBMP(const char * imagepath, DecodedImage & out_image){
 
-  // Create a buffer
-  data = new unsigned char[imageSize];
+  printf("Reading image %s\n", imagepath);
+
+  // Open the file
+  FILE * file = fopen(imagepath, "rb");
+  if (!file)							    { printf("%s could not be opened.\n", imagepath); return false; }
+
+  BMPInfo info;
+  if (!readBMPInfo(file, info)){
+    fclose(file);
+    return false;
+  }
 
   // Read the actual data from the file into the buffer
-  fread(data, 1, imageSize, file);
+  out_image.width = info.width;
+  out_image.height = info.height;
+  out_image.pixels.resize(info.imageSize);
+  bool ok = fread(&out_image.pixels[0], 1, info.imageSize, file) == info.imageSize;
 
   // Everything is in memory now, the file wan be closed
   fclose(file);
+  if (!ok)
+    printf("Not a correct BMP file\n");
+  return ok;
+}
+
+GLuint loadBMP(const char * imagepath, GLint internalFormat){
+  DecodedImage image;
+  if (!decodeBMP(imagepath, image))
+    return 0;
 
   // Create one OpenGL texture
   GLuint textureID;
@@ -345,10 +1560,7 @@ GLuint loadBMP(const char * imagepath, GLint internalFormat){
   glBindTexture(GL_TEXTURE_2D, textureID);
 
   // Give the image to OpenGL
-  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-
-  // OpenGL has now copied the data. Free our own version
-  delete[] data;
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, GL_BGR, GL_UNSIGNED_BYTE, &image.pixels[0]);
 
   // Poor filtering, or ...
   //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -363,4 +1575,4 @@ GLuint loadBMP(const char * imagepath, GLint internalFormat){
 
   // Return the ID of the texture we just created
   return textureID;
-}
\ No newline at end of file
+}
@@ -2,8 +2,21 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
 #include <vector>
+#include <string.h>
+#include <stdio.h>
 #include <glm/glm.hpp>
 
+// One vertex with all of its attributes, laid out the way an interleaved vertex
+// buffer stores them : 8 floats, no padding
+struct PackedVertex{
+  glm::vec3 position;
+  glm::vec2 uv;
+  glm::vec3 normal;
+  bool operator<(const PackedVertex that) const{
+    return memcmp((void*)this, (void*)&that, sizeof(PackedVertex))>0;
+  };
+};
+
 bool loadOBJ(
   const char * path,
   std::vector<glm::vec3> & out_vertices,
@@ -11,17 +24,233 @@ bool loadOBJ(
   std::vector<glm::vec3> & out_normals
   );
 
+// Same as loadOBJ, but maps the file instead of reading it through fscanf
+bool loadOBJ_mapped(
+  const char * path,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  );
+
+// Same output as loadOBJ_mapped, but counts the records first so that
+// no array is ever regrown
+bool loadOBJ_reserved(
+  const char * path,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  );
+
+// Same output as loadOBJ_mapped, parsed in line-aligned chunks on
+// threadCount threads (0 = one per core)
+bool loadOBJ_parallel(
+  const char * path,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals,
+  unsigned int threadCount = 0
+  );
+
+// loadOBJ followed by indexVBO in one go : corners are deduplicated on their
+// v/vt/vn indices while parsing, the expanded triangle soup never exists.
+// Fails if the mesh ends up with more than 65536 vertices.
+bool loadIndexedOBJ(
+  const char * path,
+  std::vector<unsigned short> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  );
+
+// Same, with 32-bit indices for meshes that have more than 65536 vertices
+bool loadIndexedOBJ(
+  const char * path,
+  std::vector<unsigned int> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  );
+
+// Same, with interleaved vertices for a single vertex buffer
+bool loadIndexedOBJ(
+  const char * path,
+  std::vector<unsigned int> & out_indices,
+  std::vector<PackedVertex> & out_vertices
+  );
+
+// A piece of the mesh streamOBJ hands out : whole triangles, and the vertices
+// they use numbered from 0. The batches follow each other in the vertex and index
+// buffers they fill, so a batch is drawn with firstVertex as its base vertex.
+struct OBJBatch{
+  const unsigned int * indices;
+  size_t indexCount;
+  const PackedVertex * vertices;
+  size_t vertexCount;
+  size_t firstIndex;  // Indices of the batches before this one
+  size_t firstVertex; // Vertices of the batches before this one
+};
+
+// Gets every batch, in order. The arrays are only valid during the call.
+// Returning false stops the stream.
+typedef bool (*OBJBatchCallback)(const OBJBatch & batch, void * user);
+
+// Smallest memoryBudget streamOBJ works with
+#define OBJ_STREAM_MIN_BUDGET (4 << 20)
+
+// Same vertices as loadIndexedOBJ, with 32-bit indices, for meshes too big to hold
+// in memory. The file is read through a window, its attributes and faces are
+// written to scratch files next to it in binary, then the faces are indexed in
+// batches that are handed to callback as soon as they are full. What the loader
+// allocates stays within memoryBudget bytes however big the file is, apart from
+// the attributes' scratch files, which are mapped and can be paged out by the OS.
+// Triples used by several batches are repeated in each of them.
+bool streamOBJ(
+  const char * path,
+  size_t memoryBudget,
+  OBJBatchCallback callback,
+  void * user
+  );
+
+// Merges identical vertices, using a hash table. Warns if the mesh ends up with
+// more than 65536 vertices, the indices have wrapped around then.
+void indexVBO(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
+  std::vector<unsigned short> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  );
+
+// Same, with 32-bit indices for meshes that have more than 65536 vertices
+void indexVBO(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
+  std::vector<unsigned int> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  );
+
+// Same, with interleaved vertices for a single vertex buffer
 void indexVBO(
   std::vector<glm::vec3> & in_vertices,
   std::vector<glm::vec2> & in_uvs,
   std::vector<glm::vec3> & in_normals,
 
+  std::vector<unsigned int> & out_indices,
+  std::vector<PackedVertex> & out_vertices
+  );
+
+// Same as indexVBO, using the original std::map lookup
+void indexVBO_map(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
+  std::vector<unsigned short> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  );
+
+// Same vertices and indices as indexVBO, but with 32-bit indices and built on
+// threadCount threads (0 = one per core). The output doesn't depend on threadCount.
+void indexVBO_parallel(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
+  std::vector<unsigned int> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals,
+  unsigned int threadCount = 0
+  );
+
+// Merges vertices that are within 0.01 of each other, with a quadratic linear search
+void indexVBO_slow(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
+  std::vector<unsigned short> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals
+  );
+
+// Same output as indexVBO_slow, searching through a spatial grid in near-linear time
+void indexVBO_welded(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+
   std::vector<unsigned short> & out_indices,
   std::vector<glm::vec3> & out_vertices,
   std::vector<glm::vec2> & out_uvs,
   std::vector<glm::vec3> & out_normals
   );
 
+// Same as indexVBO_welded, also summing the tangents and bitangents of the
+// corners that become one vertex
+void indexVBO_TBN(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+  std::vector<glm::vec3> & in_tangents,
+  std::vector<glm::vec3> & in_bitangents,
+
+  std::vector<unsigned short> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals,
+  std::vector<glm::vec3> & out_tangents,
+  std::vector<glm::vec3> & out_bitangents
+  );
+
+// Same idea with exact matches through a hash table, in linear time like indexVBO,
+// and 32-bit indices. Corners with mirrored uvs stay apart. The sums, from
+// computeTangentBasis, end up as an orthonormal basis around each normal, with
+// bitangent = cross(normal, tangent) or its opposite.
+void indexVBO_TBN_fast(
+  std::vector<glm::vec3> & in_vertices,
+  std::vector<glm::vec2> & in_uvs,
+  std::vector<glm::vec3> & in_normals,
+  std::vector<glm::vec3> & in_tangents,
+  std::vector<glm::vec3> & in_bitangents,
+
+  std::vector<unsigned int> & out_indices,
+  std::vector<glm::vec3> & out_vertices,
+  std::vector<glm::vec2> & out_uvs,
+  std::vector<glm::vec3> & out_normals,
+  std::vector<glm::vec3> & out_tangents,
+  std::vector<glm::vec3> & out_bitangents
+  );
+
+// What the header of a 24-bit BMP says
+struct BMPInfo{
+  unsigned int dataPos;   // Where the pixels begin in the file
+  unsigned int imageSize; // Bytes of pixels
+  unsigned int width, height;
+};
+
+// Reads the header of the BMP open in file, and leaves file at its pixels
+bool readBMPInfo(FILE * file, BMPInfo & out_info);
+
+// A 24-bit BMP as it is in the file : BGR rows, bottom up
+struct DecodedImage{
+  unsigned int width, height;
+  std::vector<unsigned char> pixels;
+};
+
+bool decodeBMP(const char * imagepath, DecodedImage & out_image);
+
+// decodeBMP, then a mipmapped texture of internalFormat
 GLuint loadBMP(const char * imagepath, GLint internalFormat);
 
 #endif
\ No newline at end of file
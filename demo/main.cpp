@@ -11,8 +11,21 @@
 #endif
 #include <GLFW/glfw3.h>
 #include "loader.h"
+#include "mesh.h"
+#include "meshopt.h"
+#include "quantize.h"
+#include "meshlet.h"
+#include "simplify.h"
+#include "meshcache.h"
+#include "glb.h"
+#include "scan.h"
+#include "texture.h"
+#include "texstream.h"
+#include "bench.h"
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <cstddef>
 #include <malloc.h>
 
 #include <glm/gtc/matrix_transform.hpp>
@@ -26,21 +39,189 @@
 
 GLFWwindow *window;
 
-GLuint modelVAO, modelPositionBuffer, modelNormalBuffer, modelUVBuffer, modelIndexBuffer,
+GLuint modelVAO, modelVertexBuffer, modelPositionBuffer, modelNormalBuffer, modelUVBuffer, modelIndexBuffer,
        vertexShader, fragmentShader, mainProgram,
        texture_nc, texture_c, spheremap_c, spheremap_nc,
-       modelViewProjUniform, modelUniform, viewUniform, lightPositionUniform, texSampler, modelViewUniform, normalMatrixUniform, sphereMapSampler, light2PositionUniform;
+       modelViewProjUniform, modelUniform, viewUniform, lightPositionUniform, texSampler, modelViewUniform, normalMatrixUniform, sphereMapSampler, light2PositionUniform,
+       positionOffsetUniform, positionScaleUniform;
 
 double lightAngle, light2Angle;
 
+/* What the vertex shader turns positions into model space with */
+QuantizationBounds positionBounds;
+
 #define ROTATION_SPEED                   -12
 #define LIGHT1_ROTATION_SPEED            (0.5)
 #define LIGHT1_ROTATION_RADIUS           3.6
 #define LIGHT2_ROTATION_SPEED            (-1.5)
 #define LIGHT2_ROTATION_RADIUS           4.6
 
+/* Set to 1 to keep 16-bit indices for models with more than 65536 vertices, by
+ * cutting them into submeshes drawn with a base vertex each. Left at 0, such
+ * models simply get 32-bit indices. */
+#define SPLIT_16BIT_SUBMESHES            0
+
+/* Set to 0 to draw the triangles in the order of the OBJ file, and compare the
+ * vertex cache report printed at startup */
+#define OPTIMIZE_VERTEX_CACHE            1
+
+/* Set to 0 to keep the vertex cache order, and compare the fragment counts that
+ * render() prints. Needs OPTIMIZE_VERTEX_CACHE. */
+#define OPTIMIZE_OVERDRAW                1
+
+/* Set to 0 to upload positions, UVs and normals to three separate buffers
+ * rather than interleaved in one, and compare the frame times printed */
+#define INTERLEAVED_VERTICES             1
+
+/* Set to 1 to upload 16-byte quantized vertices instead of 32-byte float ones :
+ * 16-bit positions in the bounding box, 10:10:10:2 normals and half float UVs.
+ * The quantization error is printed at startup. Needs INTERLEAVED_VERTICES. */
+#define QUANTIZED_VERTICES               1
+
+#if QUANTIZED_VERTICES && !INTERLEAVED_VERTICES
+#error QUANTIZED_VERTICES needs INTERLEAVED_VERTICES
+#endif
+
+/* Set to 0 to let the frame rate run free when comparing frame times */
+#define VSYNC                            1
+
+/* Frames averaged into each fragment count and frame time report */
+#define SAMPLES_REPORT_FRAMES            300
+
+/* Set to 0 to keep the vertices in the order the loader found them, rather than
+ * in the order the triangles first use them */
+#define OPTIMIZE_VERTEX_FETCH            1
+
+/* Set to 0 to draw the whole model every frame, rather than only the meshlets
+ * that face the camera and are inside the view frustum */
+#define MESHLET_CULLING                  1
+
+/* Set to 0 to always draw the full model, rather than the simplified level of
+ * detail whose error stays under LOD_PIXEL_ERROR pixels on screen. The levels
+ * are ranges of one index buffer, which SPLIT_16BIT_SUBMESHES would cut up. */
+#define GENERATE_LODS                    1
+#define LOD_PIXEL_ERROR                  1.0f
+
+#if GENERATE_LODS && SPLIT_16BIT_SUBMESHES
+#error "GENERATE_LODS needs SPLIT_16BIT_SUBMESHES off"
+#endif
+
+/* Set to 1 to stream the OBJ through batches that fit in STREAM_MEMORY_BUDGET
+ * bytes, for models bigger than memory, instead of loading it whole. The batches
+ * go to the cache, or straight into the buffers without MODEL_CACHE, and are
+ * drawn as they are : one submesh each, none of the optimizations above. */
+#define STREAM_MODEL                     0
+#define STREAM_MEMORY_BUDGET             (64 << 20)
+
+#if STREAM_MODEL && (QUANTIZED_VERTICES || !INTERLEAVED_VERTICES)
+#error STREAM_MODEL needs INTERLEAVED_VERTICES on and QUANTIZED_VERTICES off
+#endif
+
+/* Set to 0 to build the model from the OBJ on every run, rather than keep the
+ * final buffers in MODEL_PATH.meshcache and map them from there while the OBJ
+ * and the settings above stay the same */
+#define MODEL_CACHE                      1
+#define MODEL_CACHE_VERSION              2 /* Bump whenever the buffers built from the same OBJ change */
+#define MODEL_CACHE_OPTIONS              (SPLIT_16BIT_SUBMESHES | OPTIMIZE_VERTEX_CACHE << 1 | OPTIMIZE_OVERDRAW << 2 | \
+                                          INTERLEAVED_VERTICES << 3 | QUANTIZED_VERTICES << 4 | OPTIMIZE_VERTEX_FETCH << 5 | \
+                                          MESHLET_CULLING << 6 | GENERATE_LODS << 7 | STREAM_MODEL << 8 | MODEL_CACHE_VERSION << 16)
+
+/* An .obj, or a binary .ply or .stl scan */
+#define MODEL_PATH                       "../../assets/model.obj"
+
+/* Set to 1 to draw GLB_MODEL_PATH instead, its buffers going from the mapped
+ * file straight into buffer objects. It is drawn as it is : one submesh per
+ * primitive, no meshlets, no simplified levels. Needs the separate float
+ * buffers, ie. INTERLEAVED_VERTICES off. */
+#define MODEL_FORMAT_GLB                 0
+#define GLB_MODEL_PATH                   "../../assets/model.glb"
+
+#if MODEL_FORMAT_GLB && INTERLEAVED_VERTICES
+#error MODEL_FORMAT_GLB needs INTERLEAVED_VERTICES off
+#endif
+
+/* Set to 0 to load the textures before the first frame, rather than have a
+ * decode thread stream them in through pixel unpack buffers of
+ * TEXTURE_STREAM_SLOT_SIZE bytes while a grey placeholder stands in */
+#define TEXTURE_STREAMING                1
+#define TEXTURE_STREAM_SLOT_SIZE         (4 << 20)
+
+/* Set to 0 to have glGenerateMipmap build the mip chains of the textures,
+ * rather than generateMipChain on the CPU, in linear light, and compare the
+ * texture times printed */
+#define CPU_MIPMAPS                      1
+
+/* Set to 1 to upload the textures block compressed to TEXTURE_BLOCK_FORMAT,
+ * BLOCK_BC1 or BLOCK_BC7 (finer, GL 4.2), with mip chains from the CPU. The
+ * blocks are cached next to each image, only the first run compresses. Left
+ * uncompressed if the context can't sample the format. */
+#define COMPRESS_TEXTURES                0
+#define TEXTURE_BLOCK_FORMAT             BLOCK_BC1
+
+/* .bmp files, or .ktx ones made from them with "demo --ktx", which are uploaded
+ * as they are, mip chain, color space and blocks included, whatever the
+ * settings above */
+#define TEXTURE_PATH                     "../../assets/texture.bmp"
+#define SPHEREMAP_PATH                   "../../assets/spheremap.bmp"
+
 int correctTextures, correctFramebuffer;
-size_t indexCount;
+#if TEXTURE_STREAMING
+TextureStreamer textureStreamer;
+size_t textureHandle, spheremapHandle;
+int texturesStreamed; /* Every texture has arrived, or failed to */
+double textureStart;
+#else
+TextureCache textures; /* Every image, decoded once */
+#endif
+GLenum indexType; /* GL_UNSIGNED_SHORT or GL_UNSIGNED_INT */
+std::vector<SubMesh> submeshes; /* One draw call each */
+GLsizei positionStride, normalStride, uvStride; /* Of the separate vertex buffers, 0 when tightly packed */
+
+/* Culled on the CPU every frame, the survivors drawn with a single call */
+std::vector<Meshlet> meshlets;
+std::vector<GLsizei> meshletCounts;
+std::vector<GLvoid*> meshletOffsets;
+std::vector<GLint> meshletBaseVertices;
+size_t meshletsDrawn;
+int meshletFrames;
+
+/* Levels of detail, lods[0] being the full model, and the one drawn this frame */
+std::vector<MeshLOD> lods;
+size_t lodLevel;
+glm::vec3 modelCenter;
+
+/* Counts the fragments that pass the depth test, ie. that run the fragment shader */
+GLuint samplesQuery;
+int samplesQueryPending;
+GLuint64 samplesTotal;
+int samplesFrames;
+
+/* What the model cache holds */
+enum ModelCacheBlock
+{
+  CACHE_MODEL_INFO, CACHE_VERTICES, CACHE_POSITIONS, CACHE_NORMALS, CACHE_UVS,
+  CACHE_INDICES, CACHE_SUBMESHES, CACHE_MESHLETS, CACHE_LODS
+};
+
+/* The globals that go with the buffers */
+struct ModelInfo
+{
+  GLenum indexType;
+  QuantizationBounds positionBounds;
+  glm::vec3 modelCenter;
+};
+
+/* The model the way the GPU gets it, before it goes into buffer objects */
+struct ModelData
+{
+  std::vector<glm::vec3> positions, normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<PackedVertex> vertices;
+  std::vector<QuantizedVertex> quantized;
+  std::vector<unsigned int> indices;
+  std::vector<unsigned short> shortIndices;
+  ModelInfo info;
+};
 
 glm::mat4x4 model, view, proj, modelView, modelViewProj;
 glm::mat3x3 normalMatrix;
@@ -52,8 +233,14 @@ char* file_to_buffer(const char*);
 void init_all();
 void setup_stage();
 void update(double);
+void update_textures();
+TextureOptions texture_options();
+const char* texture_layout_name(const TextureOptions&);
+int convert_to_ktx(int, char**);
 void render();
-void load_model(const char*);
+void load_model(const char*, ModelData&);
+bool stream_model(const char*, const char*);
+void stream_model_to_buffers(const char*);
 void main_loop();
 void key_callback(GLFWwindow*, int, int, int, int);
 
@@ -152,6 +339,8 @@ void init_all()
   if (glewInit() != GLEW_OK) /* Try to init GLEW */
     fatal("could not initialize GLEW");
 
+  glfwSwapInterval(VSYNC);
+
   /* Set the key callback so we can respond to key presses */
   glfwSetKeyCallback(window, &key_callback);
 
@@ -229,8 +418,455 @@ void render()
 
   glUniform1i(sphereMapSampler, 1); /* Set the spheremap sampler to use texture unit 1 */
 
-  /* Issue the actual draw command */
-  glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, (void*)0);
+  /* Collect last query's result if the GPU is done with it, without waiting */
+  if (samplesQueryPending) {
+    GLuint available = 0;
+    glGetQueryObjectuiv(samplesQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      GLuint64 samples;
+      glGetQueryObjectui64v(samplesQuery, GL_QUERY_RESULT, &samples);
+      samplesTotal += samples, samplesFrames++, samplesQueryPending = 0;
+    }
+  }
+  if (samplesFrames == SAMPLES_REPORT_FRAMES) {
+    printf("Fragments shaded per frame: %.0f (overdraw ordering: %s)\n",
+           (double)samplesTotal / samplesFrames, OPTIMIZE_VERTEX_CACHE && OPTIMIZE_OVERDRAW ? "yes" : "no");
+#if MESHLET_CULLING
+    printf("Meshlets drawn per frame: %.1f of %u\n", (double)meshletsDrawn / meshletFrames, (unsigned int)meshlets.size());
+    meshletsDrawn = 0, meshletFrames = 0;
+#endif
+#if GENERATE_LODS
+    printf("Level of detail drawn: %u, %u triangles\n", (unsigned int)lodLevel, lods[lodLevel].indexCount / 3);
+#endif
+    samplesTotal = 0, samplesFrames = 0;
+  }
+
+#if GENERATE_LODS
+  /* The coarsest level that looks the same from here */
+  lodLevel = selectLOD(lods, modelCenter, modelView, proj, (float)SCREENHEIGHT, LOD_PIXEL_ERROR);
+#endif
+
+#if MESHLET_CULLING
+  /* Keep the meshlets that can be seen, in model space. They only cover the
+   * full model. */
+  MeshletCulling culling;
+  setupMeshletCulling(modelView, modelViewProj, culling);
+  meshletCounts.clear();
+  meshletOffsets.clear();
+  meshletBaseVertices.clear();
+  for (size_t i = 0; i < meshlets.size() && lodLevel == 0; i++)
+  {
+    if (!isMeshletVisible(meshlets[i], culling))
+      continue;
+    meshletCounts.push_back(meshlets[i].indexCount);
+    meshletOffsets.push_back((GLvoid*)(meshlets[i].indexOffset * indexTypeSize(indexType)));
+    meshletBaseVertices.push_back(meshlets[i].baseVertex);
+  }
+  meshletsDrawn += meshletCounts.size(), meshletFrames++;
+#endif
+
+  /* Issue the actual draw commands : one per submesh, one for all the meshlets,
+   * or one for a simplified level */
+  if (!samplesQueryPending)
+    glBeginQuery(GL_SAMPLES_PASSED, samplesQuery);
+  if (lodLevel > 0)
+    glDrawElements(GL_TRIANGLES, lods[lodLevel].indexCount, indexType, (void*)(lods[lodLevel].indexOffset * indexTypeSize(indexType)));
+  else
+  {
+#if MESHLET_CULLING
+    if (!meshlets.empty())
+    {
+      if (!meshletCounts.empty())
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, &meshletCounts[0], indexType, &meshletOffsets[0],
+                                      (GLsizei)meshletCounts.size(), &meshletBaseVertices[0]);
+    }
+    else
+#endif
+    for (size_t i = 0; i < submeshes.size(); i++)
+      glDrawElementsBaseVertex(GL_TRIANGLES, submeshes[i].indexCount, indexType,
+                               (void*)(submeshes[i].indexOffset * indexTypeSize(indexType)), submeshes[i].baseVertex);
+  }
+  if (!samplesQueryPending)
+    glEndQuery(GL_SAMPLES_PASSED), samplesQueryPending = 1;
+}
+
+/* Prints the vertex cache and fetch stats of the triangles the submeshes draw,
+ * as they will be drawn. The fetches are those of the position buffer. */
+void report_vertex_order(const char* order, const std::vector<unsigned int>& indices, size_t vertexCount)
+{
+  std::vector<unsigned int> drawn;
+  for (size_t i = 0; i < submeshes.size(); i++)
+    for (unsigned int k = 0; k < submeshes[i].indexCount; k++)
+      drawn.push_back(submeshes[i].baseVertex + indices[submeshes[i].indexOffset + k]);
+  VertexCacheStats cacheStats = analyzeVertexCache(&drawn[0], drawn.size(), vertexCount);
+  VertexFetchStats fetchStats = analyzeVertexFetch(&drawn[0], drawn.size(), vertexCount, sizeof(glm::vec3));
+  printf("Final triangles, %s : ACMR %.3f, ATVR %.3f, overfetch %.3f\n", order, cacheStats.acmr, cacheStats.atvr, fetchStats.overfetch);
+}
+
+/* optimizeVertexFetch on each submesh, whose indices are its own. The range of
+ * a submesh runs to the next one, so that the levels of detail after the last
+ * one are renumbered along with it. Fills remap for every vertex and moves the
+ * base vertices of the submeshes and meshlets to where their vertices go. */
+size_t optimize_vertex_fetch(std::vector<unsigned int>& indices, size_t vertexCount, std::vector<unsigned int>& remap)
+{
+  std::vector<unsigned int> submeshRemap;
+  unsigned int usedVertexCount = 0;
+  remap.assign(vertexCount, 0xffffffffu);
+  for (size_t i = 0; i < submeshes.size(); i++)
+  {
+    SubMesh& submesh = submeshes[i];
+    size_t end = i + 1 < submeshes.size() ? submeshes[i + 1].indexOffset : indices.size();
+    size_t used = optimizeVertexFetch(&indices[submesh.indexOffset], end - submesh.indexOffset, submesh.vertexCount, submeshRemap);
+    for (size_t v = 0; v < submeshRemap.size(); v++)
+      if (submeshRemap[v] != 0xffffffffu)
+        remap[submesh.baseVertex + v] = usedVertexCount + submeshRemap[v];
+#if MESHLET_CULLING
+    for (size_t m = 0; m < meshlets.size(); m++)
+      if (meshlets[m].indexOffset >= submesh.indexOffset && meshlets[m].indexOffset < end)
+        meshlets[m].baseVertex = usedVertexCount;
+#endif
+    submesh.baseVertex = usedVertexCount;
+    submesh.vertexCount = (unsigned int)used;
+    usedVertexCount += (unsigned int)used;
+  }
+  return usedVertexCount;
+}
+
+/*
+ * This function loads the model at path and turns it into the final buffers
+ * that setup_stage uploads, filling in the globals that go with them
+ */
+void load_model(const char* path, ModelData& data)
+{
+  /* Buffers to hold our final model data */
+  std::vector<glm::vec3> &fpositions = data.positions;
+  std::vector<PackedVertex> &fvertices = data.vertices;
+  std::vector<unsigned int> &findices = data.indices;
+#if !INTERLEAVED_VERTICES
+  std::vector<glm::vec3> &fnormals = data.normals;
+  std::vector<glm::vec2> &fuvs = data.uvs;
+#endif
+
+  /* Ask the loader component to load the model and compile the final, indexed data
+   * in one go, without expanding every triangle corner in between. Binary PLY and
+   * STL scans come out of their loaders indexed and interleaved. */
+  const char* extension = strrchr(path, '.');
+  int ply = extension && strcmp(extension, ".ply") == 0, stl = extension && strcmp(extension, ".stl") == 0;
+#if INTERLEAVED_VERTICES
+  if (!(ply ? loadPLY(path, findices, fvertices) : stl ? loadSTL(path, findices, fvertices) : loadIndexedOBJ(path, findices, fvertices)))
+    fatal("could not load model");
+
+  /* The optimizations below only need the positions */
+  fpositions.resize(fvertices.size());
+  for (size_t i = 0; i < fvertices.size(); i++)
+    fpositions[i] = fvertices[i].position;
+#else
+  if (ply || stl)
+  {
+    if (!(ply ? loadPLY(path, findices, fvertices) : loadSTL(path, findices, fvertices)))
+      fatal("could not load model");
+    fpositions.resize(fvertices.size());
+    fuvs.resize(fvertices.size());
+    fnormals.resize(fvertices.size());
+    for (size_t i = 0; i < fvertices.size(); i++)
+      fpositions[i] = fvertices[i].position, fuvs[i] = fvertices[i].uv, fnormals[i] = fvertices[i].normal;
+    fvertices.clear();
+  }
+  else if (!loadIndexedOBJ(path, findices, fpositions, fuvs, fnormals))
+    fatal("could not load model");
+#endif
+
+  /* Reorder the triangles so that the post-transform cache spares us most vertex
+   * shader runs, and tell how many it saves */
+  VertexCacheStats cacheStats = analyzeVertexCache(&findices[0], findices.size(), fpositions.size());
+  printf("Vertex cache, OBJ order : ACMR %.3f, ATVR %.3f\n", cacheStats.acmr, cacheStats.atvr);
+#if OPTIMIZE_VERTEX_CACHE
+  optimizeVertexCache(&findices[0], findices.size(), fpositions.size());
+  cacheStats = analyzeVertexCache(&findices[0], findices.size(), fpositions.size());
+  printf("Vertex cache, optimized : ACMR %.3f, ATVR %.3f\n", cacheStats.acmr, cacheStats.atvr);
+#if OPTIMIZE_OVERDRAW
+  /* Then draw the outer parts of the model first, so that they hide the inner
+   * ones from the fragment shader, for a few percent of that ACMR */
+  optimizeOverdraw(&findices[0], findices.size(), fpositions);
+  cacheStats = analyzeVertexCache(&findices[0], findices.size(), fpositions.size());
+  printf("Vertex cache, overdraw ordered : ACMR %.3f, ATVR %.3f\n", cacheStats.acmr, cacheStats.atvr);
+#endif
+#endif
+
+#if GENERATE_LODS
+  /* Simplified copies of the model for when it is small on screen. They go after
+   * it in the index buffer and draw from the same vertices. */
+  generateLODs(findices, fpositions, lods);
+  for (size_t i = 0; i < lods.size(); i++)
+    printf("Level of detail %u : %u triangles, error %g\n", (unsigned int)i, lods[i].indexCount / 3, lods[i].error);
+
+  glm::vec3 minimum = fpositions[0], maximum = fpositions[0];
+  for (size_t i = 1; i < fpositions.size(); i++)
+    minimum = glm::min(minimum, fpositions[i]), maximum = glm::max(maximum, fpositions[i]);
+  modelCenter = (minimum + maximum) * 0.5f;
+#endif
+
+  /* A single draw of the whole model, unless it gets split below */
+  SubMesh whole = { 0, (unsigned int)findices.size(), 0, (unsigned int)fpositions.size() };
+#if GENERATE_LODS
+  whole.indexCount = lods[0].indexCount;
+#endif
+  submeshes.assign(1, whole);
+
+#if SPLIT_16BIT_SUBMESHES
+  if (fpositions.size() > MAX_16BIT_VERTICES)
+  {
+    std::vector<unsigned int> localIndices, vertexSource;
+    submeshes.clear();
+    splitMesh16(findices, fpositions.size(), localIndices, vertexSource, submeshes);
+    findices.swap(localIndices);
+    gatherVertices(fpositions, vertexSource);
+#if INTERLEAVED_VERTICES
+    gatherVertices(fvertices, vertexSource);
+#else
+    gatherVertices(fuvs, vertexSource);
+    gatherVertices(fnormals, vertexSource);
+#endif
+    printf("Split model into %u submeshes with 16-bit indices\n", (unsigned int)submeshes.size());
+  }
+#endif
+
+#if MESHLET_CULLING
+  /* Regroups the triangles of each submesh, which only moves them around within it */
+  meshlets.clear();
+  for (size_t i = 0; i < submeshes.size(); i++)
+    buildMeshlets(findices, fpositions, submeshes[i], meshlets);
+  printf("Built %u meshlets of up to %d vertices and %d triangles\n",
+         (unsigned int)meshlets.size(), MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+#endif
+
+  /* Lay the vertices out in the order the final triangles use them, so that
+   * fetching them walks the buffers forward */
+  report_vertex_order("vertices as loaded", findices, fpositions.size());
+#if OPTIMIZE_VERTEX_FETCH
+  std::vector<unsigned int> remap;
+  size_t usedVertexCount = optimize_vertex_fetch(findices, fpositions.size(), remap);
+  remapVertices(fpositions, remap, usedVertexCount);
+#if INTERLEAVED_VERTICES
+  remapVertices(fvertices, remap, usedVertexCount);
+#else
+  remapVertices(fuvs, remap, usedVertexCount);
+  remapVertices(fnormals, remap, usedVertexCount);
+#endif
+  report_vertex_order("vertices in first use order", findices, fpositions.size());
+#endif
+
+#if SPLIT_16BIT_SUBMESHES
+  indexType = GL_UNSIGNED_SHORT;
+  for (size_t i = 0; i < submeshes.size(); i++)
+    if (chooseIndexType(submeshes[i].vertexCount) != GL_UNSIGNED_SHORT)
+      indexType = GL_UNSIGNED_INT;
+#else
+  /* Half the index memory and bandwidth whenever the model is small enough */
+  indexType = chooseIndexType(fpositions.size());
+#endif
+
+  /* The vertices as the vertex buffer gets them */
+#if QUANTIZED_VERTICES
+  /* Half the size of the floats, for an error well below a pixel */
+  std::vector<QuantizedVertex> &fquantized = data.quantized;
+  positionBounds = computeQuantizationBounds(fvertices);
+  quantizeVertices(fvertices, positionBounds, fquantized);
+  QuantizationError quantizationError = measureQuantizationError(fvertices, fquantized, positionBounds);
+  printf("Quantized vertices : %u bytes instead of %u, error max %g (position), %.3f degrees (normal), %g (uv)\n",
+         (unsigned int)(fquantized.size() * sizeof(QuantizedVertex)), (unsigned int)(fvertices.size() * sizeof(PackedVertex)),
+         quantizationError.maxPosition, quantizationError.maxNormal, quantizationError.maxUV);
+#else
+  /* Float positions go through the shader untouched */
+  positionBounds.offset = glm::vec3(0.0f);
+  positionBounds.scale = glm::vec3(1.0f);
+#endif
+
+  /* And the indices as the index buffer gets them */
+  if (indexType == GL_UNSIGNED_SHORT)
+    narrowIndices(findices, data.shortIndices);
+
+  data.info.indexType = indexType;
+  data.info.positionBounds = positionBounds;
+  data.info.modelCenter = modelCenter;
+}
+
+/* The buffers of the model, as the blocks of its cache */
+void model_blocks(ModelData& data, std::vector<MeshCacheBlock>& blocks)
+{
+  MeshCacheBlock info = { CACHE_MODEL_INFO, &data.info, sizeof(ModelInfo) };
+  blocks.push_back(info);
+#if QUANTIZED_VERTICES
+  blocks.push_back(meshCacheBlock(CACHE_VERTICES, data.quantized));
+#elif INTERLEAVED_VERTICES
+  blocks.push_back(meshCacheBlock(CACHE_VERTICES, data.vertices));
+#else
+  blocks.push_back(meshCacheBlock(CACHE_POSITIONS, data.positions));
+  blocks.push_back(meshCacheBlock(CACHE_NORMALS, data.normals));
+  blocks.push_back(meshCacheBlock(CACHE_UVS, data.uvs));
+#endif
+  if (data.info.indexType == GL_UNSIGNED_SHORT)
+    blocks.push_back(meshCacheBlock(CACHE_INDICES, data.shortIndices));
+  else blocks.push_back(meshCacheBlock(CACHE_INDICES, data.indices));
+  blocks.push_back(meshCacheBlock(CACHE_SUBMESHES, submeshes));
+  blocks.push_back(meshCacheBlock(CACHE_MESHLETS, meshlets));
+  blocks.push_back(meshCacheBlock(CACHE_LODS, lods));
+}
+
+/* The block with that id, which a valid cache always has */
+const MeshCacheBlock& model_block(const std::vector<MeshCacheBlock>& blocks, unsigned int id)
+{
+  const MeshCacheBlock* block = findMeshCacheBlock(blocks, id);
+  if (!block)
+    fatal("model cache is missing a block");
+  return *block;
+}
+
+/* Copies a block of the cache back into a vector */
+template <typename T>
+void restore_block(const std::vector<MeshCacheBlock>& blocks, unsigned int id, std::vector<T>& out)
+{
+  const MeshCacheBlock& block = model_block(blocks, id);
+  const T* first = (const T*)block.data;
+  out.assign(first, first + block.size / sizeof(T));
+}
+
+/* Binds buffer to target and fills it straight from a block */
+void upload_block(GLenum target, GLuint buffer, const std::vector<MeshCacheBlock>& blocks, unsigned int id)
+{
+  const MeshCacheBlock& block = model_block(blocks, id);
+  glBindBuffer(target, buffer);
+  glBufferData(target, block.size, block.data, GL_STATIC_DRAW);
+}
+
+/* What the streamed batches add up to, besides their vertices and indices */
+struct StreamedModel
+{
+  MeshCacheWriter cache;
+  FILE* indices; /* Wait here for the vertices to be written */
+  size_t vertexBytes, vertexCapacity, indexBytes, indexCapacity;
+  glm::vec3 minimum, maximum;
+};
+
+/* Adds a batch's submesh, and its vertices to the bounding box */
+void add_streamed_batch(const OBJBatch& batch, StreamedModel& model)
+{
+  SubMesh submesh = { (unsigned int)batch.firstIndex, (unsigned int)batch.indexCount, (int)batch.firstVertex, (unsigned int)batch.vertexCount };
+  submeshes.push_back(submesh);
+  if (batch.firstVertex == 0)
+    model.minimum = model.maximum = batch.vertices[0].position;
+  for (size_t i = 0; i < batch.vertexCount; i++)
+  {
+    model.minimum = glm::min(model.minimum, batch.vertices[i].position);
+    model.maximum = glm::max(model.maximum, batch.vertices[i].position);
+  }
+}
+
+/* Everything but the buffers, once the last batch is in */
+void finish_streamed_model(const StreamedModel& model)
+{
+  indexType = GL_UNSIGNED_INT;
+  positionBounds.offset = glm::vec3(0.0f);
+  positionBounds.scale = glm::vec3(1.0f);
+  modelCenter = (model.minimum + model.maximum) * 0.5f;
+  MeshLOD whole = { 0, (unsigned int)(model.indexBytes / sizeof(unsigned int)), 0.0f };
+  lods.assign(1, whole);
+  meshlets.clear();
+}
+
+bool stream_batch_to_cache(const OBJBatch& batch, void* user)
+{
+  StreamedModel& model = *(StreamedModel*)user;
+  add_streamed_batch(batch, model);
+  writeMeshCacheData(model.cache, batch.vertices, batch.vertexCount * sizeof(PackedVertex));
+  model.indexBytes += batch.indexCount * sizeof(unsigned int);
+  return model.cache.ok && fwrite(batch.indices, sizeof(unsigned int), batch.indexCount, model.indices) == batch.indexCount;
+}
+
+/*
+ * This function streams the OBJ at path into a cache at cachePath, without ever
+ * holding all of it : the vertices go to the cache as they come, the indices
+ * to a file of their own and then after the vertices
+ */
+bool stream_model(const char* path, const char* cachePath)
+{
+  StreamedModel model;
+  model.indexBytes = 0;
+  submeshes.clear();
+  std::string indicesPath = std::string(cachePath) + ".indices.tmp";
+  if (!beginMeshCache(model.cache, cachePath, path, MODEL_CACHE_OPTIONS, 6))
+    return false;
+  model.indices = fopen(indicesPath.c_str(), "w+b");
+  beginMeshCacheBlock(model.cache, CACHE_VERTICES);
+  bool ok = model.indices && streamOBJ(path, STREAM_MEMORY_BUDGET, stream_batch_to_cache, &model);
+
+  beginMeshCacheBlock(model.cache, CACHE_INDICES);
+  if (ok)
+  {
+    std::vector<char> window(STREAM_MEMORY_BUDGET / 8);
+    rewind(model.indices);
+    for (size_t read; (read = fread(&window[0], 1, window.size(), model.indices)) > 0;)
+      writeMeshCacheData(model.cache, &window[0], read);
+  }
+  if (model.indices)
+    fclose(model.indices);
+  remove(indicesPath.c_str());
+
+  /* Then the little that goes with them */
+  ok = ok && !submeshes.empty();
+  if (ok)
+    finish_streamed_model(model);
+  ModelInfo info = { indexType, positionBounds, modelCenter };
+  beginMeshCacheBlock(model.cache, CACHE_SUBMESHES);
+  writeMeshCacheData(model.cache, submeshes.empty() ? NULL : &submeshes[0], submeshes.size() * sizeof(SubMesh));
+  beginMeshCacheBlock(model.cache, CACHE_MESHLETS);
+  beginMeshCacheBlock(model.cache, CACHE_LODS);
+  writeMeshCacheData(model.cache, lods.empty() ? NULL : &lods[0], lods.size() * sizeof(MeshLOD));
+  beginMeshCacheBlock(model.cache, CACHE_MODEL_INFO);
+  writeMeshCacheData(model.cache, &info, sizeof(ModelInfo));
+  model.cache.ok = model.cache.ok && ok;
+  return finishMeshCache(model.cache);
+}
+
+/* Appends to a buffer object, doubling it on the GPU when it is full */
+void append_buffer(GLuint& buffer, size_t& size, size_t& capacity, const void* data, size_t bytes)
+{
+  if (size + bytes > capacity)
+  {
+    size_t grownCapacity = capacity * 2 > size + bytes ? capacity * 2 : size + bytes;
+    GLuint grown;
+    glGenBuffers(1, &grown);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glBufferData(GL_COPY_WRITE_BUFFER, grownCapacity, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    if (size > 0)
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+    glDeleteBuffers(1, &buffer);
+    buffer = grown, capacity = grownCapacity;
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, size, bytes, data);
+  size += bytes;
+}
+
+bool stream_batch_to_buffers(const OBJBatch& batch, void* user)
+{
+  StreamedModel& model = *(StreamedModel*)user;
+  add_streamed_batch(batch, model);
+  append_buffer(modelVertexBuffer, model.vertexBytes, model.vertexCapacity, batch.vertices, batch.vertexCount * sizeof(PackedVertex));
+  append_buffer(modelIndexBuffer, model.indexBytes, model.indexCapacity, batch.indices, batch.indexCount * sizeof(unsigned int));
+  return true;
+}
+
+/* This function streams the OBJ at path straight into the model's buffers */
+void stream_model_to_buffers(const char* path)
+{
+  StreamedModel model;
+  model.vertexBytes = model.vertexCapacity = model.indexBytes = model.indexCapacity = 0;
+  submeshes.clear();
+  if (!streamOBJ(path, STREAM_MEMORY_BUDGET, stream_batch_to_buffers, &model) || submeshes.empty())
+    fatal("could not stream model");
+  finish_streamed_model(model);
 }
 
 /* 
@@ -248,40 +884,104 @@ void setup_stage()
   glBindVertexArray(modelVAO);
 
   /* Now let's create real buffer objects to put our model data inside */
+#if INTERLEAVED_VERTICES
+  glGenBuffers(1, &modelVertexBuffer);
+#else
   glGenBuffers(1, &modelPositionBuffer);
   glGenBuffers(1, &modelNormalBuffer);
   glGenBuffers(1, &modelUVBuffer);
+#endif
   glGenBuffers(1, &modelIndexBuffer);
-
-  /* Buffers to hold our final model data */
-  std::vector<glm::vec3> fpositions, fnormals;
-  std::vector<glm::vec2> fuvs;
-  std::vector<char16_t> findices;
+  glGenQueries(1, &samplesQuery);
+
+  double modelStart = glfwGetTime();
+#if MODEL_FORMAT_GLB
+  /* The buffer views of the .glb are ready as they are : each one goes from the
+   * mapped file to its buffer object */
+  GLBMesh glb;
+  if (!loadGLB(GLB_MODEL_PATH, glb))
+    fatal("could not load the .glb model");
+  uploadGLBStream(GL_ARRAY_BUFFER, modelPositionBuffer, glb, GLB_POSITIONS);
+  uploadGLBStream(GL_ARRAY_BUFFER, modelNormalBuffer, glb, GLB_NORMALS);
+  uploadGLBStream(GL_ARRAY_BUFFER, modelUVBuffer, glb, GLB_UVS);
+  uploadGLBStream(GL_ELEMENT_ARRAY_BUFFER, modelIndexBuffer, glb, GLB_INDICES);
+  indexType = glb.indexType;
+  positionStride = glb.strides[GLB_POSITIONS];
+  normalStride = glb.strides[GLB_NORMALS];
+  uvStride = glb.strides[GLB_UVS];
+  glbSubMeshes(glb, submeshes);
+  closeGLB(glb);
+
+  /* Full float positions, and a single level covering every index */
+  positionBounds.offset = glm::vec3(0.0f);
+  positionBounds.scale = glm::vec3(1.0f);
+  MeshLOD whole = { 0, submeshes.back().indexOffset + submeshes.back().indexCount, 0.0f };
+  lods.assign(1, whole);
+  printf("Model ready in %.2f ms, %u primitives from the .glb\n", (glfwGetTime() - modelStart) * 1000.0,
+         (unsigned int)submeshes.size());
+#elif STREAM_MODEL && !MODEL_CACHE
+  /* Batch after batch into the buffers, which grow as they fill */
+  stream_model_to_buffers(MODEL_PATH);
+  printf("Model ready in %.2f ms, streamed in %u batches\n", (glfwGetTime() - modelStart) * 1000.0,
+         (unsigned int)submeshes.size());
+#else
+  /* The final model buffers come from the cache next to the model when it is up
+   * to date. Otherwise the model is built from the OBJ, and cached for next time. */
+  std::string cachePath = meshCachePath(MODEL_PATH);
+  MeshCache cache;
+  ModelData data;
+  std::vector<MeshCacheBlock> blocks;
+  bool warm = MODEL_CACHE && openMeshCache(cachePath.c_str(), MODEL_PATH, MODEL_CACHE_OPTIONS, cache);
+#if STREAM_MODEL
+  /* A streamed model only ever goes to the cache, which is then read as usual */
+  bool streamed = !warm;
+  if (streamed && !(stream_model(MODEL_PATH, cachePath.c_str()) && openMeshCache(cachePath.c_str(), MODEL_PATH, MODEL_CACHE_OPTIONS, cache)))
+    fatal("could not stream the model into its cache");
+  warm = true;
+#endif
+  if (warm)
   {
-    /* Ask the loader component to first load data we need... */
-    std::vector<glm::vec3> positions, normals;
-    std::vector<glm::vec2> uvs;
-    if (!loadOBJ("../../assets/model.obj", positions, uvs, normals))
-      fatal("could not load model");
-
-    /* Now ask the VBO indexer to compile the final, indexed data */
-    indexVBO(positions, uvs, normals, findices, fpositions, fuvs, fnormals);
-    indexCount = findices.size();
-  } /* Here the auxiliary buffers go out of scope, freeing memory */
-
-  /* Bind all of our buffers consecutively and fill them with data */
-  glBindBuffer(GL_ARRAY_BUFFER, modelPositionBuffer);
-  glBufferData(GL_ARRAY_BUFFER, fpositions.size() * sizeof(glm::vec3), &fpositions[0], GL_STATIC_DRAW);
-
-  glBindBuffer(GL_ARRAY_BUFFER, modelNormalBuffer);
-  glBufferData(GL_ARRAY_BUFFER, fnormals.size() * sizeof(glm::vec3), &fnormals[0], GL_STATIC_DRAW);
+    blocks = cache.blocks;
+    const ModelInfo* info = (const ModelInfo*)model_block(blocks, CACHE_MODEL_INFO).data;
+    indexType = info->indexType;
+    positionBounds = info->positionBounds;
+    modelCenter = info->modelCenter;
+    restore_block(blocks, CACHE_SUBMESHES, submeshes);
+    restore_block(blocks, CACHE_MESHLETS, meshlets);
+    restore_block(blocks, CACHE_LODS, lods);
+  }
+  else
+  {
+    load_model(MODEL_PATH, data);
+    model_blocks(data, blocks);
+#if MODEL_CACHE
+    writeMeshCache(cachePath.c_str(), MODEL_PATH, MODEL_CACHE_OPTIONS, blocks);
+#endif
+  }
 
-  glBindBuffer(GL_ARRAY_BUFFER, modelUVBuffer);
-  glBufferData(GL_ARRAY_BUFFER, fuvs.size() * sizeof(glm::vec2), &fuvs[0], GL_STATIC_DRAW);
+  /* Bind all of our buffers consecutively and fill them with data, straight
+   * from the mapped cache when there is one */
+#if INTERLEAVED_VERTICES
+  upload_block(GL_ARRAY_BUFFER, modelVertexBuffer, blocks, CACHE_VERTICES);
+#else
+  upload_block(GL_ARRAY_BUFFER, modelPositionBuffer, blocks, CACHE_POSITIONS);
+  upload_block(GL_ARRAY_BUFFER, modelNormalBuffer, blocks, CACHE_NORMALS);
+  upload_block(GL_ARRAY_BUFFER, modelUVBuffer, blocks, CACHE_UVS);
+#endif
 
   /* Do the same for the index buffer as well */
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, modelIndexBuffer);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, findices.size() * sizeof(char16_t), &findices[0], GL_STATIC_DRAW);
+  upload_block(GL_ELEMENT_ARRAY_BUFFER, modelIndexBuffer, blocks, CACHE_INDICES);
+
+  if (warm)
+    closeMeshCache(cache);
+#if STREAM_MODEL
+  printf("Model ready in %.2f ms, %s\n", (glfwGetTime() - modelStart) * 1000.0,
+         streamed ? "streamed into the cache" : "warm start from the cache");
+#else
+  printf("Model ready in %.2f ms, %s\n", (glfwGetTime() - modelStart) * 1000.0,
+         warm ? "warm start from the cache" : "cold start from the model file");
+#endif
+#endif
 
   /* Create shader programs*/
   vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -339,15 +1039,28 @@ void setup_stage()
   glDeleteShader(vertexShader);
   glDeleteShader(fragmentShader);
 
-  /* Load the textures in two variants: with an RGB8 internal format and an SRGB8 one */
-  texture_nc = loadBMP("../../assets/texture.bmp", GL_RGB8); /* Ordinary diffuse texture */
-  texture_c = loadBMP("../../assets/texture.bmp", GL_SRGB8);
-  spheremap_nc = loadBMP("../../assets/spheremap.bmp", GL_RGB8); /* Sphere map texture, using for reflectance */
-  spheremap_c = loadBMP("../../assets/spheremap.bmp", GL_SRGB8);
-
-  /* Check if the loading failed for some reason */
-  if (!texture_c || !texture_nc)
-    fatal("could not load textures");
+  /* Load the textures in two variants: with an RGB8 internal format and an SRGB8 one.
+   * Each image is decoded once, and both variants share its memory where views are supported. */
+#if TEXTURE_STREAMING
+  /* They arrive over the first frames, update_textures() swaps them in */
+  textureStart = glfwGetTime();
+  startTextureStreamer(textureStreamer, TEXTURE_STREAM_SLOT_SIZE, texture_options());
+  textureHandle = requestTexture(textureStreamer, TEXTURE_PATH); /* Ordinary diffuse texture */
+  spheremapHandle = requestTexture(textureStreamer, SPHEREMAP_PATH); /* Sphere map texture, using for reflectance */
+  update_textures();
+#else
+  double textureStart = glfwGetTime();
+  TexturePair texture, spheremap;
+  textures.options = texture_options();
+  if (!loadTexturePair(textures, TEXTURE_PATH, texture) || /* Ordinary diffuse texture */
+      !loadTexturePair(textures, SPHEREMAP_PATH, spheremap)) /* Sphere map texture, using for reflectance */
+    fatal("could not load textures"); /* Check if the loading failed for some reason */
+  texture_nc = texture.linear, texture_c = texture.srgb;
+  spheremap_nc = spheremap.linear, spheremap_c = spheremap.srgb;
+  printf("Textures ready in %.2f ms, %s, %s\n", (glfwGetTime() - textureStart) * 1000.0,
+         GLEW_ARB_texture_view ? "RGB8 and SRGB8 views of one allocation" : "separate RGB8 and SRGB8 copies",
+         texture_layout_name(textures.options));
+#endif
 
   /* Bind our shader program */
   glUseProgram(mainProgram);
@@ -362,6 +1075,12 @@ void setup_stage()
   lightPositionUniform = glGetUniformLocation(mainProgram, "lightPosWorld"); /* Light 1 position in world space */
   light2PositionUniform = glGetUniformLocation(mainProgram, "light2PosWorld"); /* Light 2 position in world space */
   normalMatrixUniform = glGetUniformLocation(mainProgram, "normalMatrix"); /* 3x3 truncated inverse-transpose of the model view matrix, for transforming normals */
+  positionOffsetUniform = glGetUniformLocation(mainProgram, "positionOffset"); /* Dequantization of the positions */
+  positionScaleUniform = glGetUniformLocation(mainProgram, "positionScale");
+
+  /* These never change */
+  glUniform3f(positionOffsetUniform, positionBounds.offset.x, positionBounds.offset.y, positionBounds.offset.z);
+  glUniform3f(positionScaleUniform, positionBounds.scale.x, positionBounds.scale.y, positionBounds.scale.z);
 
   /* Create base matrixes */
   view = glm::lookAt(
@@ -400,6 +1119,73 @@ void setup_stage()
   modelViewProj = proj * modelView;
 
   /* Now give the shader some data to work with */
+#if QUANTIZED_VERTICES
+  /* Same single buffer, with the packed formats GL unpacks for us */
+  glBindBuffer(GL_ARRAY_BUFFER, modelVertexBuffer);
+
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(
+    0, /* Attribute set 0 */
+    3, /* 3 components in one item */
+    GL_SHORT, /* 16-bit integer components */
+    GL_FALSE, /* Read as plain integers, positionScale brings them back */
+    sizeof(QuantizedVertex), /* Distance from one vertex to the next */
+    (void*)offsetof(QuantizedVertex, position) /* Where the position sits inside a vertex */
+  );
+
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(
+    1, /* Attribute set 1 */
+    2, /* 2 components in one item */
+    GL_HALF_FLOAT, /* 16-bit floating point components */
+    GL_FALSE, /* These are not normalized */
+    sizeof(QuantizedVertex), /* Distance from one vertex to the next */
+    (void*)offsetof(QuantizedVertex, uv) /* Where the UV sits inside a vertex */
+  );
+
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(
+    2, /* Attribute set 2 */
+    4, /* Packed formats always have 4 components, the shader only reads 3 */
+    GL_INT_2_10_10_10_REV, /* 10-bit x, y and z, 2-bit w */
+    GL_TRUE, /* Normalized to -1..1 */
+    sizeof(QuantizedVertex), /* Distance from one vertex to the next */
+    (void*)offsetof(QuantizedVertex, normal) /* Where the normal sits inside a vertex */
+  );
+#elif INTERLEAVED_VERTICES
+  /* All three attributes come from the same buffer, one vertex every sizeof(PackedVertex) bytes */
+  glBindBuffer(GL_ARRAY_BUFFER, modelVertexBuffer);
+
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(
+    0, /* Attribute set 0 */
+    3, /* 3 components in one item */
+    GL_FLOAT, /* 32-bit floating point components */
+    GL_FALSE, /* These are not normalized */
+    sizeof(PackedVertex), /* Distance from one vertex to the next */
+    (void*)offsetof(PackedVertex, position) /* Where the position sits inside a vertex */
+  );
+
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(
+    1, /* Attribute set 1 */
+    2, /* 2 components in one item */
+    GL_FLOAT, /* 32-bit floating point components */
+    GL_FALSE, /* These are not normalized */
+    sizeof(PackedVertex), /* Distance from one vertex to the next */
+    (void*)offsetof(PackedVertex, uv) /* Where the UV sits inside a vertex */
+  );
+
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(
+    2, /* Attribute set 2 */
+    3, /* 3 components in one item */
+    GL_FLOAT, /* 32-bit floating point components */
+    GL_TRUE, /* These are normals, so they're normalized */
+    sizeof(PackedVertex), /* Distance from one vertex to the next */
+    (void*)offsetof(PackedVertex, normal) /* Where the normal sits inside a vertex */
+  );
+#else
   glEnableVertexAttribArray(0);
   glBindBuffer(GL_ARRAY_BUFFER, modelPositionBuffer);
   glVertexAttribPointer(
@@ -407,7 +1193,7 @@ void setup_stage()
     3, /* 3 components in one item */
     GL_FLOAT, /* 32-bit floating point components */
     GL_FALSE, /* These are not normalized */
-    0, /* No stride since we're neatly packing them */
+    positionStride, /* 0 when we're neatly packing them, the .glb may not */
     (void*)0 /* No buffer offset, see docs for details on this one */
   );
 
@@ -418,7 +1204,7 @@ void setup_stage()
     2, /* 2 components in one item */
     GL_FLOAT, /* 32-bit floating point components */
     GL_FALSE, /* These are not normalized */
-    0, /* No stride since we're neatly packing them */
+    uvStride, /* 0 when we're neatly packing them, the .glb may not */
     (void*)0 /* No buffer offset, see docs for details on this one */
     );
 
@@ -429,17 +1215,87 @@ void setup_stage()
     3, /* 3 components in one item */
     GL_FLOAT, /* 32-bit floating point components */
     GL_TRUE, /* These are normals, so they're normalized */
-    0, /* No stride since we're neatly packing them */
+    normalStride, /* 0 when we're neatly packing them, the .glb may not */
     (void*)0 /* No buffer offset, see docs for details on this one */
   );
+#endif
 
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, modelIndexBuffer); /* Bind the index buffer */
 
 }
+/* How the textures are built, as far as the context allows */
+TextureOptions texture_options()
+{
+  TextureOptions options;
+  options.cpuMipmaps = CPU_MIPMAPS != 0;
+  options.compressed = COMPRESS_TEXTURES && blockFormatSupported(TEXTURE_BLOCK_FORMAT);
+  options.blockFormat = TEXTURE_BLOCK_FORMAT;
+  if (COMPRESS_TEXTURES && !options.compressed)
+    printf("%s textures are not supported, leaving them uncompressed\n", TEXTURE_BLOCK_FORMAT == BLOCK_BC1 ? "BC1" : "BC7");
+  return options;
+}
+
+const char* texture_layout_name(const TextureOptions& options)
+{
+  if (options.compressed)
+    return options.blockFormat == BLOCK_BC1 ? "BC1 blocks" : "BC7 blocks";
+  return options.cpuMipmaps ? "mip chains from the CPU" : "mip chains from glGenerateMipmap";
+}
+
+/* "demo --ktx <image.bmp> <texture.ktx> [rgb8 | bc1 | bc7] [linear]" writes the
+ * BMP, with its mip chain, to a KTX file that TEXTURE_PATH or SPHEREMAP_PATH can
+ * name. sRGB unless told it is linear. */
+int convert_to_ktx(int argc, char** argv)
+{
+  static const struct { const char* name; GLenum linear, srgb; } formats[] = {
+    { "rgb8", GL_RGB8, GL_SRGB8 },
+    { "bc1", GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT },
+    { "bc7", GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM },
+  };
+
+  const char* name = argc > 2 ? argv[2] : "bc7";
+  int linear = argc > 3 && strcmp(argv[3], "linear") == 0;
+  for (size_t i = 0; argc >= 2 && i < sizeof(formats) / sizeof(formats[0]); i++)
+    if (strcmp(name, formats[i].name) == 0) {
+      if (!convertBMPToKTX(argv[0], argv[1], linear ? formats[i].linear : formats[i].srgb))
+        return 1;
+      printf("Wrote %s, %s %s\n", argv[1], linear ? "linear" : "sRGB", name);
+      return 0;
+    }
+
+  printf("Usage: demo --ktx <image.bmp> <texture.ktx> [rgb8 | bc1 | bc7] [linear]\n");
+  return 1;
+}
+
+/* Moves the streamed textures along and binds whatever stands for them this frame */
+void update_textures()
+{
+#if TEXTURE_STREAMING
+  updateTextureStreamer(textureStreamer);
+
+  const TexturePair& texture = streamedTexture(textureStreamer, textureHandle);
+  const TexturePair& spheremap = streamedTexture(textureStreamer, spheremapHandle);
+  texture_nc = texture.linear, texture_c = texture.srgb;
+  spheremap_nc = spheremap.linear, spheremap_c = spheremap.srgb;
+
+  if (!texturesStreamed && textureStreamerIdle(textureStreamer)) {
+    if (textureStreamer.textures[textureHandle].state == STREAMED_TEXTURE_FAILED ||
+        textureStreamer.textures[spheremapHandle].state == STREAMED_TEXTURE_FAILED)
+      fatal("could not load textures");
+    texturesStreamed = 1;
+    printf("Textures streamed in %.2f ms, %s, %s\n", (glfwGetTime() - textureStart) * 1000.0,
+           textureStreamer.persistent ? "through persistently mapped buffers" : "through buffers mapped per image",
+           texture_layout_name(textureStreamer.options));
+  }
+#endif
+}
+
 /* This function will run the main loop and take care of user's input */
 void main_loop()
 {
   double previous = glfwGetTime(), current, dt; /* Record the initial time */
+  double frameTimeTotal = 0.0; /* For the frame time report */
+  int frames = 0;
 
   /* Loop while the user has not pressed the "close" button */
   while (!glfwWindowShouldClose(window)) {
@@ -450,8 +1306,17 @@ void main_loop()
     dt = current - previous;
     previous = current;
 
+    /* Every so often, tell how long frames take with this vertex layout */
+    frameTimeTotal += dt, frames++;
+    if (frames == SAMPLES_REPORT_FRAMES) {
+      printf("Average frame time: %.3f ms (interleaved vertices: %s)\n",
+             frameTimeTotal * 1000.0 / frames, INTERLEAVED_VERTICES ? "yes" : "no");
+      frameTimeTotal = 0.0, frames = 0;
+    }
+
     /* Update the viewport and render to it */
     update(dt);
+    update_textures();
     render();
 
     /* Ask GLFW to present what we rendered to the screen and to do the regular
@@ -463,8 +1328,23 @@ void main_loop()
 
 int main(int argc, char** argv)
 {
+  /* "demo --bench ..." runs the loader benchmarks instead, they don't need a window */
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+    return runBenchmarks(argv[0], argc - 2, argv + 2);
+
+  /* Nor does "demo --ktx ...", which converts textures */
+  if (argc > 1 && strcmp(argv[1], "--ktx") == 0)
+    return convert_to_ktx(argc - 2, argv + 2);
+
   init_all();
   main_loop();
 
+  /* Let go of the textures while the context is still there */
+#if TEXTURE_STREAMING
+  stopTextureStreamer(textureStreamer);
+#else
+  releaseTextureCache(textures);
+#endif
+
   return(0);
 }
\ No newline at end of file
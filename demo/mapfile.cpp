@@ -0,0 +1,97 @@
+#include "mapfile.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+bool mapFile(const char * path, MappedFile & out_file){
+  out_file = MappedFile();
+
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)){
+    CloseHandle(file);
+    return false;
+  }
+
+  out_file.fileHandle = file;
+  out_file.size = (size_t)size.QuadPart;
+  if (out_file.size == 0) // CreateFileMapping refuses empty files
+    return true;
+
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping == NULL){
+    unmapFile(out_file);
+    return false;
+  }
+  out_file.mappingHandle = mapping;
+
+  out_file.data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (out_file.data == NULL){
+    unmapFile(out_file);
+    return false;
+  }
+
+  return true;
+}
+
+void unmapFile(MappedFile & file){
+  if (file.data)          UnmapViewOfFile(file.data);
+  if (file.mappingHandle) CloseHandle((HANDLE)file.mappingHandle);
+  if (file.fileHandle)    CloseHandle((HANDLE)file.fileHandle);
+  file = MappedFile();
+}
+
+#else
+
+bool mapFile(const char * path, MappedFile & out_file){
+  out_file = MappedFile();
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0){
+    close(fd);
+    return false;
+  }
+
+  out_file.fd = fd;
+  out_file.size = (size_t)st.st_size;
+  if (out_file.size == 0) // mmap refuses empty files
+    return true;
+
+  void * data = mmap(NULL, out_file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED){
+    unmapFile(out_file);
+    return false;
+  }
+  // We read front to back, let the kernel read ahead aggressively
+  madvise(data, out_file.size, MADV_SEQUENTIAL);
+  out_file.data = (const char *)data;
+
+  return true;
+}
+
+void unmapFile(MappedFile & file){
+  if (file.data)    munmap((void *)file.data, file.size);
+  if (file.fd >= 0) close(file.fd);
+  file = MappedFile();
+}
+
+#endif
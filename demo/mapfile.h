@@ -0,0 +1,35 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+#include <stddef.h>
+
+// A read-only view of a whole file, mapped into memory by the OS.
+// The contents are NOT null-terminated : always stop at data + size.
+struct MappedFile{
+  const char * data;
+  size_t size;
+#if defined(_WIN32)
+  void * fileHandle;
+  void * mappingHandle;
+#else
+  int fd;
+#endif
+
+  // Unmapped : nothing for unmapFile to release
+  MappedFile() : data(NULL), size(0),
+#if defined(_WIN32)
+    fileHandle(NULL), mappingHandle(NULL)
+#else
+    fd(-1)
+#endif
+    {}
+};
+
+// Maps the file at path. An empty file maps successfully with data == NULL.
+bool mapFile(const char * path, MappedFile & out_file);
+
+// Releases everything mapFile acquired, and leaves file unmapped. Safe to call
+// on an unmapped MappedFile : default constructed, released, or after mapFile
+// failed.
+void unmapFile(MappedFile & file);
+
+#endif
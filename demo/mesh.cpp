@@ -0,0 +1,73 @@
+#include <vector>
+#include <GL/glew.h>
+
+#include "mesh.h"
+
+GLenum chooseIndexType(size_t vertexCount){
+  return vertexCount <= MAX_16BIT_VERTICES ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+size_t indexTypeSize(GLenum indexType){
+  return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+void splitMesh16(
+  const std::vector<unsigned int> & in_indices,
+  size_t vertexCount,
+  std::vector<unsigned int> & out_indices,
+  std::vector<unsigned int> & out_vertexSource,
+  std::vector<SubMesh> & out_submeshes
+  ){
+  // localIndex[v] is only valid if owner[v] is the current submesh, so nothing
+  // has to be cleared when a new submesh starts
+  std::vector<unsigned int> localIndex(vertexCount);
+  std::vector<unsigned int> owner(vertexCount, 0xffffffffu);
+
+  out_indices.resize(in_indices.size());
+  out_vertexSource.clear();
+
+  SubMesh current = { 0, 0, 0, 0 };
+  unsigned int submesh = 0;
+
+  for (size_t t = 0; t + 2 < in_indices.size(); t += 3){
+    // How many vertices does this triangle add to the current submesh ?
+    unsigned int added = 0;
+    for (int c = 0; c < 3; c++){
+      unsigned int v = in_indices[t + c];
+      bool seen = owner[v] == submesh;
+      for (int d = 0; d < c; d++)
+        seen = seen || in_indices[t + d] == v;
+      added += !seen;
+    }
+
+    // Doesn't fit : close the current submesh and start a new one
+    if (current.vertexCount + added > MAX_16BIT_VERTICES){
+      out_submeshes.push_back(current);
+      submesh++;
+      current.indexOffset += current.indexCount;
+      current.indexCount = 0;
+      current.baseVertex = (int)out_vertexSource.size();
+      current.vertexCount = 0;
+    }
+
+    for (int c = 0; c < 3; c++){
+      unsigned int v = in_indices[t + c];
+      if (owner[v] != submesh){
+        owner[v] = submesh;
+        localIndex[v] = current.vertexCount++;
+        out_vertexSource.push_back(v);
+      }
+      out_indices[t + c] = localIndex[v];
+    }
+    current.indexCount += 3;
+  }
+
+  if (current.indexCount > 0)
+    out_submeshes.push_back(current);
+}
+
+void narrowIndices(const std::vector<unsigned int> & in_indices, std::vector<unsigned short> & out_indices){
+  out_indices.resize(in_indices.size());
+  for (size_t i = 0; i < in_indices.size(); i++)
+    out_indices[i] = (unsigned short)in_indices[i];
+}
@@ -0,0 +1,53 @@
+#ifndef MESH_H
+#define MESH_H
+#include <vector>
+#include <GL/glew.h>
+
+// What to do with the indexed buffers once indexVBO / loadIndexedOBJ made them :
+// choosing the index format and splitting into draws.
+
+// A range of the index buffer drawn with one glDrawElementsBaseVertex call
+struct SubMesh{
+  unsigned int indexOffset; // In indices, not bytes
+  unsigned int indexCount;
+  int baseVertex;           // Added to every index of the range
+  unsigned int vertexCount; // Vertices from baseVertex on that the range uses
+};
+
+// Most vertices a 16-bit index buffer can address
+#define MAX_16BIT_VERTICES 65536
+
+// GL_UNSIGNED_SHORT if every index of a mesh with vertexCount vertices fits in 16 bits,
+// GL_UNSIGNED_INT otherwise
+GLenum chooseIndexType(size_t vertexCount);
+
+// Bytes per index of GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+size_t indexTypeSize(GLenum indexType);
+
+// Cuts a mesh into consecutive submeshes of at most MAX_16BIT_VERTICES vertices
+// each, so that it can keep 16-bit indices however big it is. Triangles keep their
+// order. Vertices used by several submeshes are duplicated :
+//  - out_indices are relative to the baseVertex of their submesh
+//  - out_vertexSource tells, for every output vertex, which input vertex it is a
+//    copy of. Apply it to every vertex attribute with gatherVertices.
+void splitMesh16(
+  const std::vector<unsigned int> & in_indices,
+  size_t vertexCount,
+  std::vector<unsigned int> & out_indices,
+  std::vector<unsigned int> & out_vertexSource,
+  std::vector<SubMesh> & out_submeshes
+  );
+
+// Replaces vertices with { vertices[source[0]], vertices[source[1]], ... }
+template <typename T>
+void gatherVertices(std::vector<T> & vertices, const std::vector<unsigned int> & source){
+  std::vector<T> gathered(source.size());
+  for (size_t i = 0; i < source.size(); i++)
+    gathered[i] = vertices[source[i]];
+  vertices.swap(gathered);
+}
+
+// Copies 32-bit indices that are known to fit into 16 bits
+void narrowIndices(const std::vector<unsigned int> & in_indices, std::vector<unsigned short> & out_indices);
+
+#endif
@@ -0,0 +1,246 @@
+#include <vector>
+#include <string>
+
+#include "meshcache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+struct MeshCacheHeader{
+  char magic[4];                 // "MSHC"
+  unsigned int version;          // MESH_CACHE_VERSION
+  unsigned int options;
+  unsigned int blockCount;
+  unsigned long long sourceSize;
+  unsigned long long sourceTime; // Modification time, in whatever unit stat gives
+  unsigned long long sourceHash;
+};
+
+struct MeshCacheEntry{
+  unsigned int id;
+  unsigned int padding;
+  unsigned long long offset;     // From the start of the file
+  unsigned long long size;
+};
+
+static const char meshCacheMagic[4] = { 'M', 'S', 'H', 'C' };
+
+// What a cache remembers of its source
+struct SourceStamp{
+  unsigned long long size;
+  unsigned long long time;
+  unsigned long long hash;
+};
+
+static inline unsigned long long rotate64(unsigned long long x, int bits){
+  return (x << bits) | (x >> (64 - bits));
+}
+
+// 64-bit finalizer from MurmurHash3
+static inline unsigned long long mixHash64(unsigned long long h){
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// Hashes the contents 8 bytes at a time, a few GB/s : much cheaper than what
+// the cache saves, so it is fine to do on every start
+static unsigned long long hashContents(const char * data, size_t size){
+  unsigned long long h = 0x9e3779b97f4a7c15ull ^ size;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8){
+    unsigned long long word;
+    memcpy(&word, data + i, 8);
+    word *= 0x87c37b91114253d5ull;
+    word = rotate64(word, 31) * 0x4cf5ad432745937full;
+    h = rotate64(h ^ word, 27) * 5 + 0x52dce729;
+  }
+  unsigned long long tail = 0;
+  for (size_t shift = 0; i < size; i++, shift += 8)
+    tail |= (unsigned long long)(unsigned char)data[i] << shift;
+  return mixHash64(h ^ mixHash64(tail));
+}
+
+static bool stampSource(const char * path, SourceStamp & out_stamp){
+#if defined(_WIN32)
+  struct _stat64 st;
+  if (_stat64(path, &st) != 0)
+    return false;
+#else
+  struct stat st;
+  if (stat(path, &st) != 0)
+    return false;
+#endif
+  out_stamp.size = (unsigned long long)st.st_size;
+  out_stamp.time = (unsigned long long)st.st_mtime;
+
+  MappedFile source;
+  if (!mapFile(path, source))
+    return false;
+  out_stamp.hash = hashContents(source.data, source.size);
+  unmapFile(source);
+  return true;
+}
+
+static size_t alignCacheOffset(size_t offset){
+  return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(size_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+std::string meshCachePath(const char * sourcePath){
+  return std::string(sourcePath) + ".meshcache";
+}
+
+bool beginMeshCache(
+  MeshCacheWriter & out_writer,
+  const char * cachePath,
+  const char * sourcePath,
+  unsigned int options,
+  unsigned int blockCount
+  ){
+  out_writer.cachePath = cachePath;
+  out_writer.temporaryPath = std::string(cachePath) + ".tmp";
+  out_writer.sourcePath = sourcePath;
+  out_writer.options = options;
+  out_writer.blockCount = blockCount;
+  out_writer.blocks.clear();
+  out_writer.offset = sizeof(MeshCacheHeader) + blockCount * sizeof(MeshCacheEntry);
+  out_writer.file = fopen(out_writer.temporaryPath.c_str(), "wb");
+  if (!out_writer.file){
+    printf("Could not write %s\n", out_writer.temporaryPath.c_str());
+    return false;
+  }
+
+  // The header and the table are only known at the end : zeros until then
+  std::vector<char> zeros(out_writer.offset, 0);
+  out_writer.ok = fwrite(&zeros[0], 1, zeros.size(), out_writer.file) == zeros.size();
+  return true;
+}
+
+void beginMeshCacheBlock(MeshCacheWriter & writer, unsigned int id){
+  static const char zeros[MESH_CACHE_ALIGNMENT] = { 0 };
+  size_t padding = alignCacheOffset(writer.offset) - writer.offset;
+  writer.ok = writer.ok && writer.blocks.size() < writer.blockCount && fwrite(zeros, 1, padding, writer.file) == padding;
+  writer.offset += padding;
+  MeshCacheBlock block = { id, NULL, 0 };
+  writer.blocks.push_back(block);
+}
+
+void writeMeshCacheData(MeshCacheWriter & writer, const void * data, size_t size){
+  if (size == 0 || writer.blocks.empty())
+    return;
+  writer.ok = writer.ok && fwrite(data, 1, size, writer.file) == size;
+  writer.offset += size;
+  writer.blocks.back().size += size;
+}
+
+bool finishMeshCache(MeshCacheWriter & writer){
+  SourceStamp stamp;
+  bool ok = writer.ok && writer.blocks.size() == writer.blockCount && stampSource(writer.sourcePath.c_str(), stamp);
+
+  MeshCacheHeader header;
+  memcpy(header.magic, meshCacheMagic, 4);
+  header.version = MESH_CACHE_VERSION;
+  header.options = writer.options;
+  header.blockCount = writer.blockCount;
+  header.sourceSize = ok ? stamp.size : 0;
+  header.sourceTime = ok ? stamp.time : 0;
+  header.sourceHash = ok ? stamp.hash : 0;
+
+  // Blocks follow each other, aligned, from the end of the table on
+  std::vector<MeshCacheEntry> entries(writer.blocks.size());
+  size_t offset = sizeof(MeshCacheHeader) + writer.blockCount * sizeof(MeshCacheEntry);
+  for (size_t i = 0; i < writer.blocks.size(); i++){
+    offset = alignCacheOffset(offset);
+    entries[i].id = writer.blocks[i].id;
+    entries[i].padding = 0;
+    entries[i].offset = offset;
+    entries[i].size = writer.blocks[i].size;
+    offset += writer.blocks[i].size;
+  }
+
+  ok = ok && fseek(writer.file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, writer.file) == 1;
+  if (!entries.empty())
+    ok = ok && fwrite(&entries[0], sizeof(MeshCacheEntry), entries.size(), writer.file) == entries.size();
+  ok = fclose(writer.file) == 0 && ok;
+  writer.file = NULL;
+
+  // Replace the old cache only once the new one is whole
+  const char * cachePath = writer.cachePath.c_str();
+  remove(cachePath);
+  ok = ok && rename(writer.temporaryPath.c_str(), cachePath) == 0;
+  if (!ok){
+    printf("Could not write %s\n", cachePath);
+    remove(writer.temporaryPath.c_str());
+  }
+  return ok;
+}
+
+bool writeMeshCache(
+  const char * cachePath,
+  const char * sourcePath,
+  unsigned int options,
+  const std::vector<MeshCacheBlock> & blocks
+  ){
+  MeshCacheWriter writer;
+  if (!beginMeshCache(writer, cachePath, sourcePath, options, (unsigned int)blocks.size()))
+    return false;
+  for (size_t i = 0; i < blocks.size(); i++){
+    beginMeshCacheBlock(writer, blocks[i].id);
+    writeMeshCacheData(writer, blocks[i].data, blocks[i].size);
+  }
+  return finishMeshCache(writer);
+}
+
+bool openMeshCache(
+  const char * cachePath,
+  const char * sourcePath,
+  unsigned int options,
+  MeshCache & out_cache
+  ){
+  out_cache.blocks.clear();
+  if (!mapFile(cachePath, out_cache.file))
+    return false;
+
+  const MappedFile & file = out_cache.file;
+  MeshCacheHeader header;
+  if (file.size < sizeof(MeshCacheHeader)){
+    closeMeshCache(out_cache);
+    return false;
+  }
+  memcpy(&header, file.data, sizeof(MeshCacheHeader));
+
+  // Cheap checks first, the hash of the source last
+  SourceStamp stamp;
+  bool valid = memcmp(header.magic, meshCacheMagic, 4) == 0 && header.version == MESH_CACHE_VERSION && header.options == options &&
+    file.size >= sizeof(MeshCacheHeader) + (size_t)header.blockCount * sizeof(MeshCacheEntry) &&
+    stampSource(sourcePath, stamp) && stamp.size == header.sourceSize && stamp.time == header.sourceTime && stamp.hash == header.sourceHash;
+
+  for (unsigned int i = 0; valid && i < header.blockCount; i++){
+    MeshCacheEntry entry;
+    memcpy(&entry, file.data + sizeof(MeshCacheHeader) + i * sizeof(MeshCacheEntry), sizeof(MeshCacheEntry));
+    valid = entry.offset <= file.size && entry.size <= file.size - entry.offset;
+    MeshCacheBlock block = { entry.id, file.data + entry.offset, (size_t)entry.size };
+    out_cache.blocks.push_back(block);
+  }
+
+  if (!valid)
+    closeMeshCache(out_cache);
+  return valid;
+}
+
+void closeMeshCache(MeshCache & cache){
+  unmapFile(cache.file);
+  cache.blocks.clear();
+}
+
+const MeshCacheBlock * findMeshCacheBlock(const std::vector<MeshCacheBlock> & blocks, unsigned int id){
+  for (size_t i = 0; i < blocks.size(); i++)
+    if (blocks[i].id == id)
+      return &blocks[i];
+  return NULL;
+}
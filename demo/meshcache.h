@@ -0,0 +1,102 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+#include <vector>
+#include <string>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "mapfile.h"
+
+// Final, GPU-ready mesh buffers saved next to the asset they were built from, so
+// that the next run maps them and hands them to glBufferData as they are, instead
+// of parsing and indexing the asset again.
+//
+// A cache file is a header, a table of blocks and the blocks, each aligned to
+// MESH_CACHE_ALIGNMENT bytes. What the blocks hold is up to the caller.
+
+// Bump whenever the layout of the file, or of what goes in the blocks, changes
+#define MESH_CACHE_VERSION   1
+#define MESH_CACHE_ALIGNMENT 64
+
+// A block of the cache : the caller's id for it, and its bytes
+struct MeshCacheBlock{
+  unsigned int id;
+  const void * data;
+  size_t size;
+};
+
+// Helps fill a block from a vector
+template <typename T>
+MeshCacheBlock meshCacheBlock(unsigned int id, const std::vector<T> & data){
+  MeshCacheBlock block = { id, data.empty() ? NULL : &data[0], data.size() * sizeof(T) };
+  return block;
+}
+
+// Where the cache of sourcePath goes : next to it, with ".meshcache" added
+std::string meshCachePath(const char * sourcePath);
+
+// Writes the blocks to cachePath, stamped with the size, modification time and
+// a hash of the contents of sourcePath, and with options, which are whatever
+// else the blocks depend on (build settings...). Goes through a temporary file,
+// so a cache is never left half written.
+bool writeMeshCache(
+  const char * cachePath,
+  const char * sourcePath,
+  unsigned int options,
+  const std::vector<MeshCacheBlock> & blocks
+  );
+
+// A cache being written a piece at a time, for blocks too big to hold in memory
+// at once. Blocks are written one after the other : each begins where the last
+// one ends.
+struct MeshCacheWriter{
+  FILE * file;
+  std::string cachePath, temporaryPath, sourcePath;
+  unsigned int options;
+  unsigned int blockCount;
+  std::vector<MeshCacheBlock> blocks; // Ids and sizes so far, data is unused
+  size_t offset;                      // End of the file so far
+  bool ok;                            // False once anything failed to write
+};
+
+// Same as writeMeshCache, in steps : beginMeshCache for a cache of blockCount
+// blocks, then for every block beginMeshCacheBlock and any number of
+// writeMeshCacheData, then finishMeshCache, which stamps the source and puts
+// the cache in place. finishMeshCache must be called once beginMeshCache
+// succeeded, it fails if anything went wrong since.
+bool beginMeshCache(
+  MeshCacheWriter & out_writer,
+  const char * cachePath,
+  const char * sourcePath,
+  unsigned int options,
+  unsigned int blockCount
+  );
+
+void beginMeshCacheBlock(MeshCacheWriter & writer, unsigned int id);
+
+void writeMeshCacheData(MeshCacheWriter & writer, const void * data, size_t size);
+
+bool finishMeshCache(MeshCacheWriter & writer);
+
+// An open cache : blocks point into the mapping, valid until closeMeshCache
+struct MeshCache{
+  MappedFile file;
+  std::vector<MeshCacheBlock> blocks;
+};
+
+// Maps cachePath and checks it against sourcePath and options : same version,
+// same options, and a source of the same size, modification time and contents.
+// False if anything differs, the cache is then to be rebuilt.
+bool openMeshCache(
+  const char * cachePath,
+  const char * sourcePath,
+  unsigned int options,
+  MeshCache & out_cache
+  );
+
+void closeMeshCache(MeshCache & cache);
+
+// The block with that id, NULL if there is none
+const MeshCacheBlock * findMeshCacheBlock(const std::vector<MeshCacheBlock> & blocks, unsigned int id);
+
+#endif
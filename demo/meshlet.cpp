@@ -0,0 +1,227 @@
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "meshlet.h"
+#include "meshopt.h"
+
+#include <math.h>
+
+// Sphere and normal cone of the triangles [begin, end) of indices
+static void computeMeshletBounds(
+  const std::vector<unsigned int> & indices,
+  const glm::vec3 * positions,
+  size_t begin,
+  size_t end,
+  Meshlet & meshlet
+  ){
+  // Center of the bounding box, then the farthest vertex from it
+  glm::vec3 minimum = positions[indices[begin]], maximum = minimum;
+  for (size_t i = begin; i < end; i++){
+    minimum = glm::min(minimum, positions[indices[i]]);
+    maximum = glm::max(maximum, positions[indices[i]]);
+  }
+  meshlet.center = (minimum + maximum) * 0.5f;
+  float radius = 0.0f;
+  for (size_t i = begin; i < end; i++)
+    radius = glm::max(radius, glm::length(positions[indices[i]] - meshlet.center));
+  meshlet.radius = radius;
+
+  // Average of the triangle normals, then the one farthest from it
+  std::vector<glm::vec3> normals;
+  glm::vec3 axis(0.0f);
+  for (size_t i = begin; i + 2 < end; i += 3){
+    glm::vec3 a = positions[indices[i]], b = positions[indices[i + 1]], c = positions[indices[i + 2]];
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    float length = glm::length(normal);
+    if (length == 0.0f)
+      continue; // Degenerate, never rasterized
+    normals.push_back(normal / length);
+    axis += normals.back();
+  }
+
+  float axisLength = glm::length(axis);
+  meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+  meshlet.coneApex = meshlet.center;
+  meshlet.coneCutoff = 1.0f;
+  if (axisLength == 0.0f)
+    return;
+
+  float minDot = 1.0f;
+  for (size_t i = 0; i < normals.size(); i++)
+    minDot = glm::min(minDot, glm::dot(normals[i], meshlet.coneAxis));
+
+  // Past about 85 degrees the cone cannot cull anything worth the test
+  if (minDot <= 0.1f)
+    return;
+
+  // Slide the apex back along the axis until it is behind every triangle :
+  // dot(center - t * axis - corner, normal) <= 0
+  float maxT = 0.0f;
+  size_t n = 0;
+  for (size_t i = begin; i + 2 < end; i += 3){
+    glm::vec3 a = positions[indices[i]], b = positions[indices[i + 1]], c = positions[indices[i + 2]];
+    if (glm::length(glm::cross(b - a, c - a)) == 0.0f)
+      continue;
+    glm::vec3 normal = normals[n++];
+    maxT = glm::max(maxT, glm::dot(meshlet.center - a, normal) / glm::dot(meshlet.coneAxis, normal));
+  }
+  meshlet.coneApex = meshlet.center - meshlet.coneAxis * maxT;
+
+  // Normals within acos(minDot) of the axis : the triangles all face away from
+  // cameras within 90 degrees minus that of the axis, seen from the apex
+  meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+// Grows a meshlet from the first triangle left in index order : among the
+// triangles that touch its vertices, the next one adds the fewest new vertices,
+// and of those the one whose normal is closest to the average so far, which
+// keeps both the sphere and the cone tight.
+void buildMeshlets(
+  std::vector<unsigned int> & indices,
+  const std::vector<glm::vec3> & positions,
+  const SubMesh & submesh,
+  std::vector<Meshlet> & out_meshlets
+  ){
+  const unsigned int * triangles = &indices[submesh.indexOffset];
+  const glm::vec3 * submeshPositions = &positions[0] + submesh.baseVertex;
+  size_t triangleCount = submesh.indexCount / 3;
+  size_t vertexCount = submesh.vertexCount;
+
+  // Triangles around each vertex, in one flat array
+  std::vector<unsigned int> offsets(vertexCount + 1, 0);
+  for (size_t i = 0; i < triangleCount * 3; i++)
+    offsets[triangles[i] + 1]++;
+  for (size_t v = 0; v < vertexCount; v++)
+    offsets[v + 1] += offsets[v];
+  std::vector<unsigned int> adjacency(triangleCount * 3);
+  std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+  for (size_t i = 0; i < triangleCount * 3; i++)
+    adjacency[fill[triangles[i]]++] = (unsigned int)(i / 3);
+
+  std::vector<glm::vec3> normals(triangleCount);
+  for (size_t t = 0; t < triangleCount; t++){
+    glm::vec3 a = submeshPositions[triangles[t * 3]], b = submeshPositions[triangles[t * 3 + 1]], c = submeshPositions[triangles[t * 3 + 2]];
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    float length = glm::length(normal);
+    normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+  }
+
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<unsigned int> inMeshlet(vertexCount, 0xffffffffu); // Number of the meshlet that has the vertex
+  std::vector<unsigned int> localVertex(vertexCount);            // Its number within that meshlet
+  std::vector<unsigned int> meshletVertices, localIndices;
+  std::vector<unsigned int> result;
+  result.reserve(triangleCount * 3);
+  size_t cursor = 0;
+  unsigned int meshletNumber = 0;
+
+  while (true){
+    while (cursor < triangleCount && emitted[cursor])
+      cursor++;
+    if (cursor == triangleCount)
+      break;
+
+    Meshlet meshlet;
+    meshlet.indexOffset = submesh.indexOffset + (unsigned int)result.size();
+    meshlet.indexCount = 0;
+    meshlet.baseVertex = submesh.baseVertex;
+    meshletVertices.clear();
+    glm::vec3 normalSum(0.0f);
+
+    unsigned int next = (unsigned int)cursor;
+    while (next != 0xffffffffu){
+      emitted[next] = true;
+      for (int c = 0; c < 3; c++){
+        unsigned int v = triangles[next * 3 + c];
+        result.push_back(v);
+        if (inMeshlet[v] != meshletNumber){
+          inMeshlet[v] = meshletNumber;
+          localVertex[v] = (unsigned int)meshletVertices.size();
+          meshletVertices.push_back(v);
+        }
+      }
+      meshlet.indexCount += 3;
+      normalSum += normals[next];
+      if (meshlet.indexCount / 3 == MESHLET_MAX_TRIANGLES)
+        break;
+
+      // Best neighbour that still fits
+      next = 0xffffffffu;
+      unsigned int bestNew = 3;
+      float bestDot = -2.0f;
+      for (size_t k = 0; k < meshletVertices.size(); k++){
+        unsigned int v = meshletVertices[k];
+        for (unsigned int a = offsets[v]; a < offsets[v + 1]; a++){
+          unsigned int t = adjacency[a];
+          if (emitted[t])
+            continue;
+          unsigned int added = 0;
+          for (int c = 0; c < 3; c++){
+            unsigned int w = triangles[t * 3 + c];
+            bool seen = inMeshlet[w] == meshletNumber;
+            for (int d = 0; d < c; d++)
+              seen = seen || triangles[t * 3 + d] == w;
+            added += !seen;
+          }
+          if (meshletVertices.size() + added > MESHLET_MAX_VERTICES)
+            continue;
+          float dot = glm::dot(normals[t], normalSum);
+          if (added < bestNew || (added == bestNew && dot > bestDot)){
+            next = t;
+            bestNew = added;
+            bestDot = dot;
+          }
+        }
+      }
+    }
+
+    // Growing the meshlet undid the vertex cache order the triangles came in :
+    // put them back in one, over the meshlet's own few vertices
+    size_t first = result.size() - meshlet.indexCount;
+    localIndices.resize(meshlet.indexCount);
+    for (size_t i = 0; i < meshlet.indexCount; i++)
+      localIndices[i] = localVertex[result[first + i]];
+    optimizeVertexCache(&localIndices[0], localIndices.size(), meshletVertices.size());
+    for (size_t i = 0; i < meshlet.indexCount; i++)
+      result[first + i] = meshletVertices[localIndices[i]];
+
+    meshlet.vertexCount = (unsigned int)meshletVertices.size();
+    computeMeshletBounds(result, submeshPositions, result.size() - meshlet.indexCount, result.size(), meshlet);
+    out_meshlets.push_back(meshlet);
+    meshletNumber++;
+  }
+
+  std::copy(result.begin(), result.end(), indices.begin() + submesh.indexOffset);
+}
+
+void setupMeshletCulling(const glm::mat4 & modelView, const glm::mat4 & modelViewProj, MeshletCulling & out_culling){
+  // Gribb & Hartmann : the planes are sums and differences of the rows of the
+  // matrix, here in model space since the matrix starts from model space
+  glm::mat4 m = glm::transpose(modelViewProj); // m[i] is row i
+  out_culling.planes[0] = m[3] + m[0]; // Left
+  out_culling.planes[1] = m[3] - m[0]; // Right
+  out_culling.planes[2] = m[3] + m[1]; // Bottom
+  out_culling.planes[3] = m[3] - m[1]; // Top
+  out_culling.planes[4] = m[3] + m[2]; // Near
+  out_culling.planes[5] = m[3] - m[2]; // Far
+  for (int i = 0; i < 6; i++)
+    out_culling.planes[i] /= glm::length(glm::vec3(out_culling.planes[i]));
+
+  out_culling.cameraPosition = glm::vec3(glm::inverse(modelView) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+bool isMeshletVisible(const Meshlet & meshlet, const MeshletCulling & culling){
+  for (int i = 0; i < 6; i++){
+    if (glm::dot(glm::vec3(culling.planes[i]), meshlet.center) + culling.planes[i].w < -meshlet.radius)
+      return false;
+  }
+
+  // Back facing : the camera sees the apex along a direction within 90 degrees
+  // minus the cone angle of the axis
+  glm::vec3 view = meshlet.coneApex - culling.cameraPosition;
+  if (glm::dot(view, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(view))
+    return false;
+
+  return true;
+}
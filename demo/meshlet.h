@@ -0,0 +1,57 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+// Small clusters of triangles that are culled on their own, so that a big mesh
+// only draws the parts that can be seen.
+
+// Most vertices and triangles in a meshlet. 64 / 126 are what mesh shader
+// hardware likes, and they keep the bounds tight.
+#define MESHLET_MAX_VERTICES  64
+#define MESHLET_MAX_TRIANGLES 126
+
+struct Meshlet{
+  unsigned int indexOffset; // Range of the index buffer, in indices
+  unsigned int indexCount;
+  int baseVertex;           // Of the submesh the meshlet comes from
+  unsigned int vertexCount;
+
+  // Bounding sphere
+  glm::vec3 center;
+  float radius;
+
+  // Every triangle normal is within the cone around coneAxis. coneCutoff is the
+  // sine of its half angle, 1 when the cone is too wide to ever cull. coneApex
+  // is behind the plane of every triangle, on the axis.
+  glm::vec3 coneApex;
+  glm::vec3 coneAxis;
+  float coneCutoff;
+};
+
+// Groups the triangles of submesh into meshlets of neighbouring triangles, and
+// reorders them within the submesh's range of indices so that every meshlet is a
+// range of its own, its triangles in vertex cache order. indices are relative to
+// submesh.baseVertex, like positions[baseVertex...].
+void buildMeshlets(
+  std::vector<unsigned int> & indices,
+  const std::vector<glm::vec3> & positions,
+  const SubMesh & submesh,
+  std::vector<Meshlet> & out_meshlets
+  );
+
+// What isMeshletVisible needs from the camera, in model space
+struct MeshletCulling{
+  glm::vec4 planes[6]; // Frustum, normals pointing inside
+  glm::vec3 cameraPosition;
+};
+
+void setupMeshletCulling(const glm::mat4 & modelView, const glm::mat4 & modelViewProj, MeshletCulling & out_culling);
+
+// False if the meshlet is entirely outside the frustum, or entirely back facing.
+// Assumes the model matrix does not scale.
+bool isMeshletVisible(const Meshlet & meshlet, const MeshletCulling & culling);
+
+#endif
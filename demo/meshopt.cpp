@@ -0,0 +1,441 @@
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "meshopt.h"
+
+// FIFO post-transform cache that can be emptied in constant time
+struct FifoCache{
+  std::vector<unsigned int> pushedAt; // Pushes are numbered from 1, 0 is never
+  unsigned int pushes;
+  unsigned int flushedAt;
+  unsigned int size;
+
+  FifoCache(size_t vertexCount, unsigned int cacheSize)
+    : pushedAt(vertexCount, 0), pushes(0), flushedAt(0), size(cacheSize){}
+
+  // Returns true if v had to be transformed
+  bool miss(unsigned int v){
+    if (pushedAt[v] > flushedAt && pushes - pushedAt[v] < size)
+      return false;
+    pushedAt[v] = ++pushes;
+    return true;
+  }
+
+  unsigned int missTriangles(const unsigned int * indices, size_t begin, size_t end){
+    unsigned int misses = 0;
+    for (size_t i = begin * 3; i < end * 3; i++)
+      misses += miss(indices[i]);
+    return misses;
+  }
+
+  void flush(){
+    flushedAt = pushes;
+  }
+};
+
+VertexCacheStats analyzeVertexCache(
+  const unsigned int * indices,
+  size_t indexCount,
+  size_t vertexCount,
+  unsigned int cacheSize
+  ){
+  FifoCache cache(vertexCount, cacheSize);
+  std::vector<bool> used(vertexCount, false);
+  unsigned int usedCount = 0;
+
+  for (size_t i = 0; i < indexCount; i++){
+    unsigned int v = indices[i];
+    cache.miss(v);
+    if (!used[v]){
+      used[v] = true;
+      usedCount++;
+    }
+  }
+
+  VertexCacheStats stats;
+  stats.transformedVertices = cache.pushes;
+  stats.acmr = indexCount ? cache.pushes / (indexCount / 3.0f) : 0.0f;
+  stats.atvr = usedCount ? cache.pushes / (float)usedCount : 0.0f;
+  return stats;
+}
+
+// Rasterizes one view of analyzeOverdraw : X and Y are the first two components
+// of the positions once swizzled, Z points towards the viewer
+static void rasterizeOverdrawView(
+  const unsigned int * indices,
+  size_t indexCount,
+  const std::vector<glm::vec3> & view,
+  OverdrawStats & stats
+  ){
+  glm::vec3 minimum = view[indices[0]], maximum = minimum;
+  for (size_t i = 0; i < indexCount; i++){
+    minimum = glm::min(minimum, view[indices[i]]);
+    maximum = glm::max(maximum, view[indices[i]]);
+  }
+  glm::vec3 extent = maximum - minimum;
+  float scale = (OVERDRAW_VIEW_SIZE - 1) / glm::max(glm::max(extent.x, extent.y), 1e-20f);
+
+  std::vector<float> depth(OVERDRAW_VIEW_SIZE * OVERDRAW_VIEW_SIZE, -1e30f);
+  std::vector<bool> covered(OVERDRAW_VIEW_SIZE * OVERDRAW_VIEW_SIZE, false);
+
+  for (size_t t = 0; t + 2 < indexCount; t += 3){
+    glm::vec3 a = (view[indices[t]] - minimum) * scale;
+    glm::vec3 b = (view[indices[t + 1]] - minimum) * scale;
+    glm::vec3 c = (view[indices[t + 2]] - minimum) * scale;
+
+    // Counter-clockwise triangles face the viewer, like glFrontFace(GL_CCW)
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area <= 0.0f)
+      continue;
+
+    int x0 = glm::max((int)glm::min(glm::min(a.x, b.x), c.x), 0);
+    int y0 = glm::max((int)glm::min(glm::min(a.y, b.y), c.y), 0);
+    int x1 = glm::min((int)glm::max(glm::max(a.x, b.x), c.x), OVERDRAW_VIEW_SIZE - 1);
+    int y1 = glm::min((int)glm::max(glm::max(a.y, b.y), c.y), OVERDRAW_VIEW_SIZE - 1);
+
+    for (int y = y0; y <= y1; y++){
+      for (int x = x0; x <= x1; x++){
+        // Barycentric coordinates of the pixel center, times area
+        float px = x + 0.5f, py = y + 0.5f;
+        float wa = (b.x - px) * (c.y - py) - (b.y - py) * (c.x - px);
+        float wb = (c.x - px) * (a.y - py) - (c.y - py) * (a.x - px);
+        float wc = (a.x - px) * (b.y - py) - (a.y - py) * (b.x - px);
+        if (wa < 0.0f || wb < 0.0f || wc < 0.0f)
+          continue;
+
+        float z = (wa * a.z + wb * b.z + wc * c.z) / area;
+        int pixel = y * OVERDRAW_VIEW_SIZE + x;
+        if (z > depth[pixel]){
+          depth[pixel] = z;
+          stats.shadedFragments++;
+          if (!covered[pixel]){
+            covered[pixel] = true;
+            stats.coveredPixels++;
+          }
+        }
+      }
+    }
+  }
+}
+
+OverdrawStats analyzeOverdraw(
+  const unsigned int * indices,
+  size_t indexCount,
+  const std::vector<glm::vec3> & positions
+  ){
+  OverdrawStats stats = { 0, 0, 0.0f };
+  if (indexCount < 3)
+    return stats;
+
+  // Looking down -Z, -X and -Y, then from the other side : mirroring X and Z
+  // keeps counter-clockwise triangles front facing
+  std::vector<glm::vec3> view(positions.size());
+  for (int axis = 0; axis < 3; axis++){
+    for (int side = 0; side < 2; side++){
+      for (size_t v = 0; v < positions.size(); v++){
+        glm::vec3 p = positions[v];
+        glm::vec3 swizzled = axis == 0 ? p : axis == 1 ? glm::vec3(p.y, p.z, p.x) : glm::vec3(p.z, p.x, p.y);
+        view[v] = side == 0 ? swizzled : glm::vec3(-swizzled.x, swizzled.y, -swizzled.z);
+      }
+      rasterizeOverdrawView(indices, indexCount, view, stats);
+    }
+  }
+
+  stats.overdraw = stats.coveredPixels ? stats.shadedFragments / (float)stats.coveredPixels : 0.0f;
+  return stats;
+}
+
+// Tipsify, from here on
+
+// Triangles using each vertex, in one flat array
+struct VertexTriangles{
+  std::vector<unsigned int> offsets; // Triangles of v are triangles[offsets[v]..offsets[v+1]]
+  std::vector<unsigned int> triangles;
+};
+
+static void buildVertexTriangles(const unsigned int * indices, size_t indexCount, size_t vertexCount, VertexTriangles & out_adjacency){
+  std::vector<unsigned int> & offsets = out_adjacency.offsets;
+  offsets.assign(vertexCount + 1, 0);
+  for (size_t i = 0; i < indexCount; i++)
+    offsets[indices[i] + 1]++;
+  for (size_t v = 0; v < vertexCount; v++)
+    offsets[v + 1] += offsets[v];
+
+  std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+  out_adjacency.triangles.resize(indexCount);
+  for (size_t i = 0; i < indexCount; i++)
+    out_adjacency.triangles[fill[indices[i]]++] = (unsigned int)(i / 3);
+}
+
+static const int NO_VERTEX = -1;
+
+// The candidate that will still be in the cache after its remaining triangles
+// are emitted, and that has been there the longest. If there is none, a vertex
+// from the dead-end stack, or else the next vertex in input order with triangles left.
+static int nextVertex(
+  const std::vector<unsigned int> & candidates,
+  const std::vector<unsigned int> & liveTriangles,
+  const std::vector<unsigned int> & cacheTime,
+  unsigned int time,
+  unsigned int cacheSize,
+  std::vector<unsigned int> & deadEnds,
+  size_t & cursor
+  ){
+  int best = NO_VERTEX;
+  int bestPriority = -1;
+  for (size_t i = 0; i < candidates.size(); i++){
+    unsigned int v = candidates[i];
+    if (liveTriangles[v] == 0)
+      continue;
+    int priority = 0;
+    if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+      priority = time - cacheTime[v];
+    if (priority > bestPriority){
+      bestPriority = priority;
+      best = v;
+    }
+  }
+  if (best != NO_VERTEX)
+    return best;
+
+  while (!deadEnds.empty()){
+    unsigned int v = deadEnds.back();
+    deadEnds.pop_back();
+    if (liveTriangles[v] > 0)
+      return v;
+  }
+
+  for (; cursor < liveTriangles.size(); cursor++){
+    if (liveTriangles[cursor] > 0)
+      return (int)cursor;
+  }
+  return NO_VERTEX;
+}
+
+void optimizeVertexCache(
+  unsigned int * indices,
+  size_t indexCount,
+  size_t vertexCount,
+  unsigned int cacheSize
+  ){
+  size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0)
+    return;
+
+  VertexTriangles adjacency;
+  buildVertexTriangles(indices, triangleCount * 3, vertexCount, adjacency);
+
+  std::vector<unsigned int> liveTriangles(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++)
+    liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+  // A vertex is in the cache while time - cacheTime[v] <= cacheSize. Time starts
+  // past cacheSize so that no vertex is in the cache at first.
+  std::vector<unsigned int> cacheTime(vertexCount, 0);
+  unsigned int time = cacheSize + 1;
+
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<unsigned int> deadEnds;
+  std::vector<unsigned int> candidates;
+  std::vector<unsigned int> result;
+  result.reserve(triangleCount * 3);
+  size_t cursor = 0;
+
+  int fanning = nextVertex(candidates, liveTriangles, cacheTime, time, cacheSize, deadEnds, cursor);
+  while (fanning != NO_VERTEX){
+    candidates.clear();
+
+    // Emit every triangle left around the fanning vertex
+    for (unsigned int k = adjacency.offsets[fanning]; k < adjacency.offsets[fanning + 1]; k++){
+      unsigned int t = adjacency.triangles[k];
+      if (emitted[t])
+        continue;
+      emitted[t] = true;
+
+      for (int c = 0; c < 3; c++){
+        unsigned int v = indices[t * 3 + c];
+        result.push_back(v);
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        liveTriangles[v]--;
+        if (time - cacheTime[v] > cacheSize)
+          cacheTime[v] = time++;
+      }
+    }
+
+    fanning = nextVertex(candidates, liveTriangles, cacheTime, time, cacheSize, deadEnds, cursor);
+  }
+
+  std::copy(result.begin(), result.end(), indices);
+}
+
+VertexFetchStats analyzeVertexFetch(
+  const unsigned int * indices,
+  size_t indexCount,
+  size_t vertexCount,
+  size_t vertexStride,
+  unsigned int cacheSize
+  ){
+  FifoCache transformCache(vertexCount, cacheSize);
+  std::vector<bool> used(vertexCount, false);
+  size_t usedCount = 0;
+
+  // Pre-transform cache : which line each slot holds and when it was last read
+  size_t lines[VERTEX_FETCH_LINES];
+  unsigned int lastRead[VERTEX_FETCH_LINES];
+  for (int i = 0; i < VERTEX_FETCH_LINES; i++){
+    lines[i] = (size_t)-1;
+    lastRead[i] = 0;
+  }
+  unsigned int reads = 0;
+  unsigned int lineMisses = 0;
+
+  for (size_t i = 0; i < indexCount; i++){
+    unsigned int v = indices[i];
+    if (!used[v]){
+      used[v] = true;
+      usedCount++;
+    }
+    if (!transformCache.miss(v))
+      continue; // Already transformed, nothing is read
+
+    size_t first = v * vertexStride / VERTEX_FETCH_LINE_SIZE;
+    size_t last = (v * vertexStride + vertexStride - 1) / VERTEX_FETCH_LINE_SIZE;
+    for (size_t line = first; line <= last; line++){
+      reads++;
+      int slot = 0;
+      bool hit = false;
+      for (int j = 0; j < VERTEX_FETCH_LINES; j++){
+        if (lines[j] == line){
+          slot = j;
+          hit = true;
+          break;
+        }
+        if (lastRead[j] < lastRead[slot])
+          slot = j; // Least recently read, evicted on a miss
+      }
+      if (!hit){
+        lines[slot] = line;
+        lineMisses++;
+      }
+      lastRead[slot] = reads;
+    }
+  }
+
+  VertexFetchStats stats;
+  stats.bytesFetched = lineMisses * VERTEX_FETCH_LINE_SIZE;
+  stats.overfetch = usedCount ? stats.bytesFetched / (float)(usedCount * vertexStride) : 0.0f;
+  return stats;
+}
+
+size_t optimizeVertexFetch(
+  unsigned int * indices,
+  size_t indexCount,
+  size_t vertexCount,
+  std::vector<unsigned int> & out_remap
+  ){
+  out_remap.assign(vertexCount, 0xffffffffu);
+  unsigned int next = 0;
+  for (size_t i = 0; i < indexCount; i++){
+    unsigned int & remapped = out_remap[indices[i]];
+    if (remapped == 0xffffffffu)
+      remapped = next++;
+    indices[i] = remapped;
+  }
+  return next;
+}
+
+// A run of triangles that optimizeOverdraw keeps together
+struct OverdrawCluster{
+  size_t begin, end; // In triangles
+  float sortKey;
+};
+
+static bool drawnBefore(const OverdrawCluster & a, const OverdrawCluster & b){
+  return a.sortKey > b.sortKey;
+}
+
+void optimizeOverdraw(
+  unsigned int * indices,
+  size_t indexCount,
+  const std::vector<glm::vec3> & positions,
+  float threshold,
+  unsigned int cacheSize
+  ){
+  size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0)
+    return;
+
+  // Hard boundaries : triangles whose three vertices all miss the cache, where
+  // Tipsify jumped to a vertex outside of the current fan
+  std::vector<size_t> hardBoundaries(1, 0);
+  FifoCache cache(positions.size(), cacheSize);
+  for (size_t t = 0; t < triangleCount; t++){
+    if (cache.missTriangles(indices, t, t + 1) == 3 && t > 0)
+      hardBoundaries.push_back(t);
+  }
+  hardBoundaries.push_back(triangleCount);
+
+  // Soft boundaries : within a hard cluster, cut as soon as the triangles since
+  // the last cut have an ACMR within threshold of that of the whole hard cluster
+  std::vector<OverdrawCluster> clusters;
+  for (size_t h = 0; h + 1 < hardBoundaries.size(); h++){
+    size_t begin = hardBoundaries[h], end = hardBoundaries[h + 1];
+    cache.flush();
+    float target = threshold * cache.missTriangles(indices, begin, end) / (float)(end - begin);
+
+    cache.flush();
+    size_t clusterBegin = begin;
+    unsigned int misses = 0;
+    for (size_t t = begin; t < end; t++){
+      misses += cache.missTriangles(indices, t, t + 1);
+      if (t + 1 < end && misses <= target * (t + 1 - clusterBegin)){
+        OverdrawCluster cluster = { clusterBegin, t + 1, 0.0f };
+        clusters.push_back(cluster);
+        clusterBegin = t + 1;
+        misses = 0;
+        cache.flush();
+      }
+    }
+    OverdrawCluster cluster = { clusterBegin, end, 0.0f };
+    clusters.push_back(cluster);
+  }
+
+  // Occlusion potential : how far the cluster lies from the middle of the mesh
+  // in the direction it faces. Centroids and normals are weighted by area.
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  for (size_t t = 0; t < triangleCount; t++){
+    glm::vec3 a = positions[indices[t * 3]], b = positions[indices[t * 3 + 1]], c = positions[indices[t * 3 + 2]];
+    float area = glm::length(glm::cross(b - a, c - a));
+    meshCentroid += (a + b + c) * area;
+    meshArea += area;
+  }
+  meshCentroid /= glm::max(meshArea * 3.0f, 1e-20f);
+
+  for (size_t k = 0; k < clusters.size(); k++){
+    glm::vec3 centroid(0.0f), normal(0.0f);
+    float clusterArea = 0.0f;
+    for (size_t t = clusters[k].begin; t < clusters[k].end; t++){
+      glm::vec3 a = positions[indices[t * 3]], b = positions[indices[t * 3 + 1]], c = positions[indices[t * 3 + 2]];
+      glm::vec3 n = glm::cross(b - a, c - a); // Length is twice the area
+      float area = glm::length(n);
+      centroid += (a + b + c) * area;
+      normal += n;
+      clusterArea += area;
+    }
+    float normalLength = glm::length(normal);
+    if (clusterArea > 0.0f && normalLength > 0.0f)
+      clusters[k].sortKey = glm::dot(centroid / (clusterArea * 3.0f) - meshCentroid, normal / normalLength);
+  }
+
+  // Equal keys keep their cache order, so the result does not depend on the sort
+  std::stable_sort(clusters.begin(), clusters.end(), drawnBefore);
+
+  std::vector<unsigned int> result;
+  result.reserve(triangleCount * 3);
+  for (size_t k = 0; k < clusters.size(); k++)
+    result.insert(result.end(), indices + clusters[k].begin * 3, indices + clusters[k].end * 3);
+  std::copy(result.begin(), result.end(), indices);
+}
@@ -0,0 +1,119 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+#include <vector>
+#include <stddef.h>
+#include <glm/glm.hpp>
+
+// Reorders the triangles and vertices of indexed meshes so that the GPU runs
+// the vertex shader fewer times and reads vertex buffers more linearly, and
+// measures how well that works.
+
+// Entries of the post-transform cache we optimize for and simulate. Real
+// hardware differs, but an order that is good for 16 is good for most.
+#define VERTEX_CACHE_SIZE 16
+
+struct VertexCacheStats{
+  unsigned int transformedVertices; // Vertex shader invocations with a FIFO cache
+  float acmr; // Average cache miss ratio : transformed vertices per triangle, 0.5 at best
+  float atvr; // Average transformed vertex ratio : per vertex actually used, 1.0 at best
+};
+
+// Runs indices through a FIFO cache of cacheSize entries, the way the post-transform
+// cache sees them
+VertexCacheStats analyzeVertexCache(
+  const unsigned int * indices,
+  size_t indexCount,
+  size_t vertexCount,
+  unsigned int cacheSize = VERTEX_CACHE_SIZE
+  );
+
+// Reorders the triangles of indices, in place, with Tipsify (Sander, Nehab &
+// Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+// Vertices keep their numbers, only the triangle order changes. Linear time.
+void optimizeVertexCache(
+  unsigned int * indices,
+  size_t indexCount,
+  size_t vertexCount,
+  unsigned int cacheSize = VERTEX_CACHE_SIZE
+  );
+
+// How much worse than the Tipsify order the ACMR of a cluster may get when
+// optimizeOverdraw cuts clusters smaller, 1.05 is 5% worse
+#define OVERDRAW_THRESHOLD 1.05f
+
+// Resolution of the views analyzeOverdraw rasterizes
+#define OVERDRAW_VIEW_SIZE 256
+
+struct OverdrawStats{
+  unsigned int coveredPixels;   // Pixels the mesh covers, over every view
+  unsigned int shadedFragments; // Fragments that passed the depth test and ran the fragment shader
+  float overdraw;               // shadedFragments per covered pixel, 1.0 at best
+};
+
+// Rasterizes the mesh, back faces culled and triangles in index order, along both
+// directions of the X, Y and Z axes, and counts how many fragments pass an early
+// depth test. A CPU stand-in for GL_SAMPLES_PASSED queries from a few fixed views.
+OverdrawStats analyzeOverdraw(
+  const unsigned int * indices,
+  size_t indexCount,
+  const std::vector<glm::vec3> & positions
+  );
+
+// Second half of Tipsify : cuts the vertex cache ordered triangles into clusters
+// where the cache order restarts anyway, or where the ACMR stays within threshold
+// times that of the cache order, then draws the clusters that face away from the
+// middle of the mesh first. They are the ones most likely to hide the others,
+// from any point of view. Run it after optimizeVertexCache.
+void optimizeOverdraw(
+  unsigned int * indices,
+  size_t indexCount,
+  const std::vector<glm::vec3> & positions,
+  float threshold = OVERDRAW_THRESHOLD,
+  unsigned int cacheSize = VERTEX_CACHE_SIZE
+  );
+
+// Size of the pre-transform cache lines and how many of them we simulate, fully
+// associative with LRU eviction
+#define VERTEX_FETCH_LINE_SIZE 64
+#define VERTEX_FETCH_LINES     64
+
+struct VertexFetchStats{
+  unsigned int bytesFetched; // Cache lines read from the vertex buffer, in bytes
+  float overfetch; // bytesFetched per byte of vertex actually used, 1.0 at best
+};
+
+// Simulates the memory reads of a vertex buffer of vertexStride bytes per vertex :
+// every vertex that misses the post-transform cache is fetched through a cache of
+// VERTEX_FETCH_LINES lines
+VertexFetchStats analyzeVertexFetch(
+  const unsigned int * indices,
+  size_t indexCount,
+  size_t vertexCount,
+  size_t vertexStride,
+  unsigned int cacheSize = VERTEX_CACHE_SIZE
+  );
+
+// Renumbers vertices in the order the indices first use them, so that vertex
+// fetches walk the buffers forward. Rewrites indices in place and fills out_remap
+// with the new number of every old vertex, or 0xffffffff for the vertices no
+// triangle uses. Returns the number of vertices left, apply out_remap to every
+// vertex attribute with remapVertices.
+size_t optimizeVertexFetch(
+  unsigned int * indices,
+  size_t indexCount,
+  size_t vertexCount,
+  std::vector<unsigned int> & out_remap
+  );
+
+// Moves every vertices[v] to vertices[remap[v]], dropping unused vertices
+template <typename T>
+void remapVertices(std::vector<T> & vertices, const std::vector<unsigned int> & remap, size_t newVertexCount){
+  std::vector<T> remapped(newVertexCount);
+  for (size_t v = 0; v < remap.size(); v++){
+    if (remap[v] != 0xffffffffu)
+      remapped[remap[v]] = vertices[v];
+  }
+  vertices.swap(remapped);
+}
+
+#endif
@@ -0,0 +1,257 @@
+#include <vector>
+#include <algorithm>
+
+#include "mipmap.h"
+#include "parallel.h"
+
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+// Linear light is looked up in steps of 1/MIP_ENCODE_STEPS. Near black, where
+// sRGB is steepest, a step is a tenth of an 8-bit code.
+#define MIP_ENCODE_STEPS 16383
+
+// Pixels of the widest band of rows a thread takes at once
+#define MIP_BAND_PIXELS 16384
+
+static float srgbToLinear(float c){
+  return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSRGB(float c){
+  return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static unsigned char toByte(float c){
+  c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+  return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+// Built once, before main
+struct SRGBTables{
+  float decode[256];
+  unsigned char encode[MIP_ENCODE_STEPS + 1];
+
+  SRGBTables(){
+    for (int i = 0; i < 256; i++)
+      decode[i] = srgbToLinear(i / 255.0f);
+    for (int i = 0; i <= MIP_ENCODE_STEPS; i++)
+      encode[i] = toByte(linearToSRGB((float)i / MIP_ENCODE_STEPS));
+  }
+};
+
+static const SRGBTables srgbTables;
+
+size_t mipChainLayout(unsigned int width, unsigned int height, std::vector<MipLevel> & out_levels){
+  out_levels.clear();
+  size_t offset = 0;
+  for (;;){
+    MipLevel level;
+    level.width = width;
+    level.height = height;
+    level.offset = offset;
+    level.size = mipRowSize(width) * height;
+    out_levels.push_back(level);
+    offset += level.size;
+
+    if (width == 1 && height == 1)
+      return offset;
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+}
+
+// A level in linear light : 3 floats a pixel, and one more at the end of each
+// row, that the filter may read and write but never uses
+struct LinearLevel{
+  std::vector<float> pixels;
+  size_t stride; // In floats
+  unsigned int width, height;
+};
+
+static void resizeLinear(LinearLevel & level, unsigned int width, unsigned int height){
+  level.width = width;
+  level.height = height;
+  level.stride = (size_t)width * 3 + 1;
+  level.pixels.assign(level.stride * height, 0.0f);
+}
+
+// Calls task(first, end) on bands of rows of a level, spread over threads
+template <typename Task>
+static void forEachBand(unsigned int width, unsigned int height, unsigned int threadCount, Task task){
+  unsigned int bandRows = std::max(1u, MIP_BAND_PIXELS / width);
+  unsigned int bandCount = (height + bandRows - 1) / bandRows;
+  parallelFor(bandCount, threadCount, [&](unsigned int band){
+    task(band * bandRows, std::min(height, (band + 1) * bandRows));
+  });
+}
+
+// One row of level 0 in linear light
+static void decodeRow(const unsigned char * in, unsigned int width, float * out){
+  for (unsigned int i = 0; i < width * 3; i++)
+    out[i] = srgbTables.decode[in[i]];
+}
+
+// Box filters a row of width pixels from the 2x2 pixels above it, in rows a and
+// b. nextPixel is 3 floats, or 0 when the level above is 1 pixel wide. An odd
+// last row or column of the level above is left out, like GL does.
+static void filterRow(const float * a, const float * b, size_t nextPixel, unsigned int width, float * out){
+#ifdef MIPMAP_SSE2
+  // Both pixels of a pair, read 4 floats at a time : BGRB' and B'G'R'B'', lanes
+  // 0..2 add up to the pair. Lane 3 lands on the next output pixel, or on the
+  // spare float at the end of the row, and is overwritten or ignored.
+  const __m128 quarter = _mm_set1_ps(0.25f);
+  for (unsigned int x = 0; x < width; x++){
+    __m128 top = _mm_add_ps(_mm_loadu_ps(a + 6 * x), _mm_loadu_ps(a + 6 * x + nextPixel));
+    __m128 bottom = _mm_add_ps(_mm_loadu_ps(b + 6 * x), _mm_loadu_ps(b + 6 * x + nextPixel));
+    _mm_storeu_ps(out + 3 * x, _mm_mul_ps(_mm_add_ps(top, bottom), quarter));
+  }
+#else
+  for (unsigned int x = 0; x < width; x++)
+    for (int c = 0; c < 3; c++)
+      out[3 * x + c] = (a[6 * x + c] + a[6 * x + nextPixel + c] + b[6 * x + c] + b[6 * x + nextPixel + c]) * 0.25f;
+#endif
+}
+
+// Rows first..end of to, from the level above it in linear light
+static void filterRows(const LinearLevel & from, LinearLevel & to, unsigned int first, unsigned int end){
+  size_t nextPixel = from.width > 1 ? 3 : 0;
+  for (unsigned int y = first; y < end; y++){
+    const float * a = &from.pixels[std::min(2 * y, from.height - 1) * from.stride];
+    const float * b = &from.pixels[std::min(2 * y + 1, from.height - 1) * from.stride];
+    filterRow(a, b, nextPixel, to.width, &to.pixels[y * to.stride]);
+  }
+}
+
+// Rows first..end of level 1 of to, straight from the bytes of level 0 : the
+// biggest level is never held in linear light
+static void filterFirstRows(const unsigned char * level0, unsigned int width, unsigned int height, LinearLevel & to, unsigned int first, unsigned int end){
+  size_t rowSize = mipRowSize(width), stride = (size_t)width * 3 + 1;
+  size_t nextPixel = width > 1 ? 3 : 0;
+  std::vector<float> rows(2 * stride, 0.0f);
+  for (unsigned int y = first; y < end; y++){
+    decodeRow(level0 + std::min(2 * y, height - 1) * rowSize, width, &rows[0]);
+    decodeRow(level0 + std::min(2 * y + 1, height - 1) * rowSize, width, &rows[stride]);
+    filterRow(&rows[0], &rows[stride], nextPixel, to.width, &to.pixels[y * to.stride]);
+  }
+}
+
+static void encodeRows(const LinearLevel & level, unsigned char * pixels, unsigned int first, unsigned int end){
+  size_t rowSize = mipRowSize(level.width);
+  unsigned int count = level.width * 3;
+  for (unsigned int y = first; y < end; y++){
+    const float * in = &level.pixels[y * level.stride];
+    unsigned char * out = pixels + y * rowSize;
+    unsigned int i = 0;
+
+#ifdef MIPMAP_SSE2
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), steps = _mm_set1_ps((float)MIP_ENCODE_STEPS);
+    for (; i + 4 <= count; i += 4){
+      __m128 c = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), zero), one);
+      union { __m128i vector; int lanes[4]; } step;
+      step.vector = _mm_cvtps_epi32(_mm_mul_ps(c, steps));
+      out[i] = srgbTables.encode[step.lanes[0]];
+      out[i + 1] = srgbTables.encode[step.lanes[1]];
+      out[i + 2] = srgbTables.encode[step.lanes[2]];
+      out[i + 3] = srgbTables.encode[step.lanes[3]];
+    }
+#endif
+    for (; i < count; i++){
+      float c = std::min(std::max(in[i], 0.0f), 1.0f);
+      out[i] = srgbTables.encode[(int)(c * MIP_ENCODE_STEPS + 0.5f)];
+    }
+    for (; i < rowSize; i++)
+      out[i] = 0;
+  }
+}
+
+void generateMipChain(const unsigned char * level0, unsigned char * chain, const std::vector<MipLevel> & levels, unsigned int threadCount){
+  if (levels.empty())
+    return;
+  if (chain != level0)
+    memcpy(chain, level0, levels[0].size);
+
+  // Levels are filtered from the one before, only rows run in parallel. Every
+  // level from level 0 would cost more than it gains.
+  LinearLevel from, to;
+  for (size_t l = 1; l < levels.size(); l++){
+    const MipLevel & level = levels[l];
+    resizeLinear(to, level.width, level.height);
+    unsigned char * pixels = chain + level.offset;
+    forEachBand(level.width, level.height, threadCount, [&](unsigned int first, unsigned int end){
+      if (l == 1)
+        filterFirstRows(level0, levels[0].width, levels[0].height, to, first, end);
+      else
+        filterRows(from, to, first, end);
+      encodeRows(to, pixels, first, end);
+    });
+    std::swap(from, to);
+  }
+}
+
+void generateMipChain_reference(const unsigned char * level0, unsigned char * chain, const std::vector<MipLevel> & levels){
+  if (levels.empty())
+    return;
+  if (chain != level0)
+    memcpy(chain, level0, levels[0].size);
+
+  std::vector<float> from(levels[0].width * levels[0].height * 3), to;
+  size_t rowSize = mipRowSize(levels[0].width);
+  for (unsigned int y = 0; y < levels[0].height; y++)
+    for (unsigned int i = 0; i < levels[0].width * 3; i++)
+      from[y * levels[0].width * 3 + i] = srgbToLinear(level0[y * rowSize + i] / 255.0f);
+
+  for (size_t l = 1; l < levels.size(); l++){
+    const MipLevel & above = levels[l - 1];
+    const MipLevel & level = levels[l];
+    to.assign(level.width * level.height * 3, 0.0f);
+    rowSize = mipRowSize(level.width);
+    memset(chain + level.offset, 0, level.size);
+
+    for (unsigned int y = 0; y < level.height; y++){
+      unsigned int y0 = std::min(2 * y, above.height - 1), y1 = std::min(2 * y + 1, above.height - 1);
+      for (unsigned int x = 0; x < level.width; x++){
+        unsigned int x0 = std::min(2 * x, above.width - 1), x1 = std::min(2 * x + 1, above.width - 1);
+        for (int c = 0; c < 3; c++){
+          float sum = from[(y0 * above.width + x0) * 3 + c] + from[(y0 * above.width + x1) * 3 + c] +
+                      from[(y1 * above.width + x0) * 3 + c] + from[(y1 * above.width + x1) * 3 + c];
+          float linear = sum * 0.25f;
+          to[(y * level.width + x) * 3 + c] = linear;
+          chain[level.offset + y * rowSize + x * 3 + c] = toByte(linearToSRGB(linear));
+        }
+      }
+    }
+    from.swap(to);
+  }
+}
+
+void generateMipChain_encoded(const unsigned char * level0, unsigned char * chain, const std::vector<MipLevel> & levels){
+  if (levels.empty())
+    return;
+  if (chain != level0)
+    memcpy(chain, level0, levels[0].size);
+
+  for (size_t l = 1; l < levels.size(); l++){
+    const MipLevel & above = levels[l - 1];
+    const MipLevel & level = levels[l];
+    const unsigned char * from = chain + above.offset;
+    unsigned char * to = chain + level.offset;
+    size_t fromRow = mipRowSize(above.width), toRow = mipRowSize(level.width);
+    memset(to, 0, level.size);
+
+    for (unsigned int y = 0; y < level.height; y++){
+      unsigned int y0 = std::min(2 * y, above.height - 1), y1 = std::min(2 * y + 1, above.height - 1);
+      for (unsigned int x = 0; x < level.width; x++){
+        unsigned int x0 = std::min(2 * x, above.width - 1), x1 = std::min(2 * x + 1, above.width - 1);
+        for (int c = 0; c < 3; c++)
+          to[y * toRow + x * 3 + c] = (unsigned char)((from[y0 * fromRow + x0 * 3 + c] + from[y0 * fromRow + x1 * 3 + c] +
+                                                       from[y1 * fromRow + x0 * 3 + c] + from[y1 * fromRow + x1 * 3 + c] + 2) / 4);
+      }
+    }
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+#include <vector>
+#include <stddef.h>
+
+// Mip chains built on the CPU instead of by glGenerateMipmap, which on GL_RGB8
+// averages the sRGB encoded values, darkening every level, and does whatever the
+// driver does otherwise. Here pixels are decoded to linear light, averaged 2x2,
+// and encoded again.
+//
+// A chain is one block of BGR pixels : level 0, then every smaller level down to
+// 1x1. Each level has its rows bottom up and padded to 4 bytes, like a BMP, which
+// is also what glTexImage2D expects with the default GL_UNPACK_ALIGNMENT.
+
+struct MipLevel{
+  unsigned int width, height;
+  size_t offset; // From the start of the chain
+  size_t size;
+};
+
+// Bytes of a BGR row, padded to 4
+inline size_t mipRowSize(unsigned int width){
+  return ((size_t)width * 3 + 3) & ~(size_t)3;
+}
+
+// Fills out_levels with the levels of a width x height chain, and returns its
+// size in bytes
+size_t mipChainLayout(unsigned int width, unsigned int height, std::vector<MipLevel> & out_levels);
+
+// Writes the chain described by levels into chain : level 0 copied from
+// level0, unless it already is chain, and every level after it filtered from the
+// one before. Filters 4 floats at a time with SSE2 when the compiler targets it,
+// rows spread over threadCount threads (0 = one per core). chain is only
+// written to, front to back, so it can be a mapped buffer.
+void generateMipChain(const unsigned char * level0, unsigned char * chain, const std::vector<MipLevel> & levels, unsigned int threadCount);
+
+// Same, one channel at a time with powf for every conversion. Levels differ
+// from generateMipChain's by at most 1 per channel.
+void generateMipChain_reference(const unsigned char * level0, unsigned char * chain, const std::vector<MipLevel> & levels);
+
+// What glGenerateMipmap does with GL_RGB8 : averages the encoded bytes. A plain
+// box filter, the right one for pixels that are linear already.
+void generateMipChain_encoded(const unsigned char * level0, unsigned char * chain, const std::vector<MipLevel> & levels);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+#include <vector>
+#include <thread>
+#include <atomic>
+
+// Number of threads to use when the caller asked for `requested` (0 = one per core)
+inline unsigned int workerCount(unsigned int requested){
+  if (requested == 0)
+    requested = std::thread::hardware_concurrency();
+  return requested == 0 ? 1 : requested;
+}
+
+// Calls task(i) once for every i in [0, taskCount), spread over up to threadCount
+// threads (0 = one per core). Threads pull the next task from a shared counter, so
+// uneven tasks balance out. The calling thread works too and everything is done
+// when this returns.
+template <typename Task>
+void parallelFor(unsigned int taskCount, unsigned int threadCount, Task task){
+  threadCount = workerCount(threadCount);
+  if (threadCount > taskCount)
+    threadCount = taskCount;
+
+  if (threadCount <= 1){
+    for (unsigned int i = 0; i < taskCount; i++)
+      task(i);
+    return;
+  }
+
+  std::atomic<unsigned int> next(0);
+  auto worker = [&](){
+    for (unsigned int i = next++; i < taskCount; i = next++)
+      task(i);
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int t = 1; t < threadCount; t++)
+    threads.push_back(std::thread(worker));
+  worker();
+  for (size_t t = 0; t < threads.size(); t++)
+    threads[t].join();
+}
+
+#endif
@@ -0,0 +1,204 @@
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "quantize.h"
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUANTIZE_SSE2
+#include <emmintrin.h>
+#endif
+
+QuantizationBounds computeQuantizationBounds(const std::vector<PackedVertex> & vertices){
+  glm::vec3 minimum(0.0f), maximum(0.0f);
+  if (!vertices.empty())
+    minimum = maximum = vertices[0].position;
+  for (size_t i = 1; i < vertices.size(); i++){
+    minimum = glm::min(minimum, vertices[i].position);
+    maximum = glm::max(maximum, vertices[i].position);
+  }
+
+  QuantizationBounds bounds;
+  bounds.offset = (minimum + maximum) * 0.5f;
+  glm::vec3 halfExtent = (maximum - minimum) * 0.5f;
+  for (int c = 0; c < 3; c++)
+    bounds.scale[c] = halfExtent[c] > 0.0f ? halfExtent[c] / 32767.0f : 1.0f; // Flat axis : every vertex quantizes to 0
+  return bounds;
+}
+
+void quantizeVertices_glm(
+  const std::vector<PackedVertex> & in_vertices,
+  const QuantizationBounds & bounds,
+  std::vector<QuantizedVertex> & out_vertices
+  ){
+  out_vertices.resize(in_vertices.size());
+  for (size_t i = 0; i < in_vertices.size(); i++){
+    const PackedVertex & in = in_vertices[i];
+    QuantizedVertex & out = out_vertices[i];
+
+    // packSnorm1x16 multiplies by 32767, the bounds already include it
+    glm::vec3 normalized = (in.position - bounds.offset) / (bounds.scale * 32767.0f);
+    for (int c = 0; c < 3; c++)
+      out.position[c] = (short)glm::packSnorm1x16(normalized[c]);
+    out.position[3] = 0;
+
+    out.normal = glm::packSnorm3x10_1x2(glm::vec4(in.normal, 0.0f));
+    out.uv = glm::packHalf2x16(in.uv);
+  }
+}
+
+#ifdef QUANTIZE_SSE2
+
+// Rounds 4 floats to the nearest half float, ties to even, infinities and NaNs
+// kept. From Fabian Giesen's float_to_half_rtne_SSE2.
+static inline __m128i floatToHalf4(__m128 f){
+  const __m128i signMask = _mm_set1_epi32(0x80000000);
+  const __m128i halfMax = _mm_set1_epi32((127 + 16) << 23); // Rounds to infinity from here on
+  const __m128i nanBit = _mm_set1_epi32(0x200);
+  const __m128i infinity = _mm_set1_epi32(0x7c00);
+  const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23); // Smallest float that is a normal half
+  const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+  const __m128i normalBias = _mm_set1_epi32(0xfff - ((127 - 15) << 23)); // Rebias the exponent, round the mantissa
+
+  __m128 sign = _mm_and_ps(_mm_castsi128_ps(signMask), f);
+  __m128 absolute = _mm_xor_ps(f, sign);
+  __m128i absoluteBits = _mm_castps_si128(absolute);
+
+  __m128i isNaN = _mm_castps_si128(_mm_cmpunord_ps(absolute, absolute));
+  __m128i isFinite = _mm_cmpgt_epi32(halfMax, absoluteBits);
+  __m128i special = _mm_or_si128(_mm_and_si128(isNaN, nanBit), infinity);
+
+  // Subnormal halves : let the float adder round the mantissa
+  __m128i isSubnormal = _mm_cmpgt_epi32(minNormal, absoluteBits);
+  __m128 subnormalSum = _mm_add_ps(absolute, _mm_castsi128_ps(subnormalMagic));
+  __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(subnormalSum), subnormalMagic);
+
+  // Normal halves : add the rounding bias, plus one more if the kept mantissa is odd
+  __m128i odd = _mm_srai_epi32(_mm_slli_epi32(absoluteBits, 31 - 13), 31);
+  __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absoluteBits, normalBias), odd), 13);
+
+  __m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+  __m128i result = _mm_or_si128(_mm_and_si128(isFinite, finite), _mm_andnot_si128(isFinite, special));
+  return _mm_or_si128(result, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+// Rows a, b, c, d become columns
+static inline void transpose4(__m128 & a, __m128 & b, __m128 & c, __m128 & d){
+  _MM_TRANSPOSE4_PS(a, b, c, d);
+}
+
+void quantizeVertices(
+  const std::vector<PackedVertex> & in_vertices,
+  const QuantizationBounds & bounds,
+  std::vector<QuantizedVertex> & out_vertices
+  ){
+  out_vertices.resize(in_vertices.size());
+  size_t blocks = in_vertices.size() / 4;
+
+  const __m128 offsetX = _mm_set1_ps(bounds.offset.x), offsetY = _mm_set1_ps(bounds.offset.y), offsetZ = _mm_set1_ps(bounds.offset.z);
+  const __m128 scaleX = _mm_set1_ps(1.0f / bounds.scale.x), scaleY = _mm_set1_ps(1.0f / bounds.scale.y), scaleZ = _mm_set1_ps(1.0f / bounds.scale.z);
+  const __m128 one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f), normalScale = _mm_set1_ps(511.0f);
+  const __m128 positionMax = _mm_set1_ps(32767.0f), positionMin = _mm_set1_ps(-32767.0f);
+  const __m128i tenBits = _mm_set1_epi32(0x3ff);
+  const __m128i zero = _mm_setzero_si128();
+
+  for (size_t block = 0; block < blocks; block++){
+    // 4 vertices of 8 floats, px py pz u v nx ny nz. Each register holds one
+    // half of one vertex until transposed.
+    const float * in = &in_vertices[block * 4].position.x;
+    __m128 px = _mm_loadu_ps(in), py = _mm_loadu_ps(in + 8), pz = _mm_loadu_ps(in + 16), u = _mm_loadu_ps(in + 24);
+    __m128 v = _mm_loadu_ps(in + 4), nx = _mm_loadu_ps(in + 12), ny = _mm_loadu_ps(in + 20), nz = _mm_loadu_ps(in + 28);
+    transpose4(px, py, pz, u);
+    transpose4(v, nx, ny, nz);
+
+    // Positions : to -32767..32767, rounded, packed as x y z 0 per vertex
+    __m128i qx = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_sub_ps(px, offsetX), scaleX), positionMax), positionMin));
+    __m128i qy = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_sub_ps(py, offsetY), scaleY), positionMax), positionMin));
+    __m128i qz = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_sub_ps(pz, offsetZ), scaleZ), positionMax), positionMin));
+    __m128i xz = _mm_packs_epi32(qx, qz);                 // x0 x1 x2 x3 z0 z1 z2 z3
+    __m128i y0 = _mm_packs_epi32(qy, zero);               // y0 y1 y2 y3 0 0 0 0
+    __m128i xy = _mm_unpacklo_epi16(xz, y0);              // x0 y0 x1 y1 x2 y2 x3 y3
+    __m128i zw = _mm_unpackhi_epi16(xz, y0);              // z0 0 z1 0 z2 0 z3 0
+    __m128i positions01 = _mm_unpacklo_epi32(xy, zw);     // x0 y0 z0 0 x1 y1 z1 0
+    __m128i positions23 = _mm_unpackhi_epi32(xy, zw);
+
+    // Normals : to -511..511, 10 bits each, x in the low bits
+    __m128i nqx = _mm_cvtps_epi32(_mm_mul_ps(_mm_max_ps(_mm_min_ps(nx, one), minusOne), normalScale));
+    __m128i nqy = _mm_cvtps_epi32(_mm_mul_ps(_mm_max_ps(_mm_min_ps(ny, one), minusOne), normalScale));
+    __m128i nqz = _mm_cvtps_epi32(_mm_mul_ps(_mm_max_ps(_mm_min_ps(nz, one), minusOne), normalScale));
+    __m128i normals = _mm_or_si128(_mm_and_si128(nqx, tenBits),
+                      _mm_or_si128(_mm_slli_epi32(_mm_and_si128(nqy, tenBits), 10),
+                                   _mm_slli_epi32(_mm_and_si128(nqz, tenBits), 20)));
+
+    // UVs : two halves, u in the low bits
+    __m128i uvs = _mm_or_si128(floatToHalf4(u), _mm_slli_epi32(floatToHalf4(v), 16));
+
+    // Interleave back : 8 bytes of position, normal, uv
+    __m128i attributes01 = _mm_unpacklo_epi32(normals, uvs); // n0 uv0 n1 uv1
+    __m128i attributes23 = _mm_unpackhi_epi32(normals, uvs);
+    __m128i * out = (__m128i *)&out_vertices[block * 4];
+    _mm_storeu_si128(out,     _mm_unpacklo_epi64(positions01, attributes01));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi64(positions01, attributes01));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi64(positions23, attributes23));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi64(positions23, attributes23));
+  }
+
+  // The last few vertices
+  std::vector<PackedVertex> tail(in_vertices.begin() + blocks * 4, in_vertices.end());
+  std::vector<QuantizedVertex> quantizedTail;
+  quantizeVertices_glm(tail, bounds, quantizedTail);
+  std::copy(quantizedTail.begin(), quantizedTail.end(), out_vertices.begin() + blocks * 4);
+}
+
+#else
+
+void quantizeVertices(
+  const std::vector<PackedVertex> & in_vertices,
+  const QuantizationBounds & bounds,
+  std::vector<QuantizedVertex> & out_vertices
+  ){
+  quantizeVertices_glm(in_vertices, bounds, out_vertices);
+}
+
+#endif
+
+PackedVertex dequantizeVertex(const QuantizedVertex & vertex, const QuantizationBounds & bounds){
+  PackedVertex result;
+  result.position = bounds.offset + bounds.scale * glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2]);
+  result.uv = glm::unpackHalf2x16(vertex.uv);
+  result.normal = glm::vec3(glm::unpackSnorm3x10_1x2(vertex.normal));
+  return result;
+}
+
+QuantizationError measureQuantizationError(
+  const std::vector<PackedVertex> & vertices,
+  const std::vector<QuantizedVertex> & quantized,
+  const QuantizationBounds & bounds
+  ){
+  QuantizationError error = { 0.0f, 0.0f, 0.0f, 0.0f };
+  double positionSum = 0.0;
+  float minCosine = 1.0f;
+
+  for (size_t i = 0; i < vertices.size(); i++){
+    PackedVertex decoded = dequantizeVertex(quantized[i], bounds);
+
+    float position = glm::length(decoded.position - vertices[i].position);
+    error.maxPosition = glm::max(error.maxPosition, position);
+    positionSum += position;
+
+    // Both renormalized, the way the shaders use them
+    float originalLength = glm::length(vertices[i].normal), decodedLength = glm::length(decoded.normal);
+    if (originalLength > 0.0f && decodedLength > 0.0f)
+      minCosine = glm::min(minCosine, glm::dot(vertices[i].normal / originalLength, decoded.normal / decodedLength));
+
+    glm::vec2 uv = glm::abs(decoded.uv - vertices[i].uv);
+    error.maxUV = glm::max(error.maxUV, glm::max(uv.x, uv.y));
+  }
+
+  error.meanPosition = vertices.empty() ? 0.0f : (float)(positionSum / vertices.size());
+  error.maxNormal = (float)(acos(glm::clamp(minCosine, -1.0f, 1.0f)) * 180.0 / 3.14159265358979);
+  return error;
+}
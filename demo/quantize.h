@@ -0,0 +1,62 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "loader.h"
+
+// A PackedVertex squeezed from 32 bytes into 16 :
+//  - position : 16-bit integers spanning the bounding box of the mesh, read
+//    unnormalized (GL_SHORT) and scaled back by the vertex shader
+//  - normal : signed normalized 10:10:10:2 (GL_INT_2_10_10_10_REV)
+//  - uv : two half floats (GL_HALF_FLOAT)
+struct QuantizedVertex{
+  short position[4]; // w is always 0, it keeps normal 4-byte aligned
+  unsigned int normal;
+  unsigned int uv;
+};
+
+// Position = offset + scale * quantized position
+struct QuantizationBounds{
+  glm::vec3 offset;
+  glm::vec3 scale;
+};
+
+// Centers the bounding box of vertices on 0 and spreads it over -32767..32767
+QuantizationBounds computeQuantizationBounds(const std::vector<PackedVertex> & vertices);
+
+// Quantizes vertices 4 at a time with SSE2 when the compiler targets it, and
+// falls back to quantizeVertices_glm otherwise
+void quantizeVertices(
+  const std::vector<PackedVertex> & in_vertices,
+  const QuantizationBounds & bounds,
+  std::vector<QuantizedVertex> & out_vertices
+  );
+
+// Same, one component at a time with glm's packSnorm1x16, packSnorm3x10_1x2 and
+// packHalf2x16. The two only differ on values exactly halfway between two steps.
+void quantizeVertices_glm(
+  const std::vector<PackedVertex> & in_vertices,
+  const QuantizationBounds & bounds,
+  std::vector<QuantizedVertex> & out_vertices
+  );
+
+// Unpacks a quantized vertex the way the GPU does
+PackedVertex dequantizeVertex(const QuantizedVertex & vertex, const QuantizationBounds & bounds);
+
+struct QuantizationError{
+  float maxPosition;  // In model units
+  float meanPosition;
+  float maxNormal;    // Angle, in degrees
+  float maxUV;
+};
+
+// How far the quantized vertices are from the float ones they were made from
+QuantizationError measureQuantizationError(
+  const std::vector<PackedVertex> & vertices,
+  const std::vector<QuantizedVertex> & quantized,
+  const QuantizationBounds & bounds
+  );
+
+#endif
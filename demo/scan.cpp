@@ -0,0 +1,428 @@
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "scan.h"
+#include "mapfile.h"
+#include "hashmap.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Area-weighted : the cross product of two edges is twice the triangle's area long
+static void computeSmoothNormals(const std::vector<unsigned int> & indices, std::vector<PackedVertex> & vertices){
+  for (size_t i = 0; i < vertices.size(); i++)
+    vertices[i].normal = glm::vec3(0.0f);
+  for (size_t i = 0; i + 2 < indices.size(); i += 3){
+    PackedVertex & a = vertices[indices[i]], & b = vertices[indices[i + 1]], & c = vertices[indices[i + 2]];
+    glm::vec3 normal = glm::cross(b.position - a.position, c.position - a.position);
+    a.normal += normal, b.normal += normal, c.normal += normal;
+  }
+  for (size_t i = 0; i < vertices.size(); i++){
+    float length = glm::length(vertices[i].normal);
+    vertices[i].normal = length > 0.0f ? vertices[i].normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+  }
+}
+
+enum PLYType{
+  PLY_NONE,
+  PLY_INT8,
+  PLY_UINT8,
+  PLY_INT16,
+  PLY_UINT16,
+  PLY_INT32,
+  PLY_UINT32,
+  PLY_FLOAT32,
+  PLY_FLOAT64
+};
+
+static PLYType plyType(const std::string & name){
+  static const char * names[] = {
+    "char", "uchar", "short", "ushort", "int", "uint", "float", "double",
+    "int8", "uint8", "int16", "uint16", "int32", "uint32", "float32", "float64"
+  };
+  for (int i = 0; i < 16; i++)
+    if (name == names[i])
+      return (PLYType)(PLY_INT8 + i % 8);
+  return PLY_NONE;
+}
+
+static size_t plyTypeSize(PLYType type){
+  static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+  return sizes[type];
+}
+
+struct PLYProperty{
+  std::string name;
+  PLYType type;      // Of the value, or of the items of a list
+  PLYType countType; // Of the item count of a list, PLY_NONE for a single value
+};
+
+struct PLYElement{
+  std::string name;
+  size_t count;
+  std::vector<PLYProperty> properties;
+};
+
+// Reads a value of type at p, reversing its bytes first when the file's byte
+// order is not the CPU's. The switch is on a type fixed for the whole element,
+// so it is predicted right every time.
+template <bool swapBytes>
+static inline double readPLY(const char * p, PLYType type){
+  unsigned char bytes[8];
+  size_t size = plyTypeSize(type);
+  memcpy(bytes, p, size);
+  if (swapBytes)
+    std::reverse(bytes, bytes + size);
+  switch (type){
+  case PLY_INT8:    { signed char value;    memcpy(&value, bytes, 1); return value; }
+  case PLY_UINT8:   { unsigned char value;  memcpy(&value, bytes, 1); return value; }
+  case PLY_INT16:   { short value;          memcpy(&value, bytes, 2); return value; }
+  case PLY_UINT16:  { unsigned short value; memcpy(&value, bytes, 2); return value; }
+  case PLY_INT32:   { int value;            memcpy(&value, bytes, 4); return value; }
+  case PLY_UINT32:  { unsigned int value;   memcpy(&value, bytes, 4); return value; }
+  case PLY_FLOAT32: { float value;          memcpy(&value, bytes, 4); return value; }
+  case PLY_FLOAT64: { double value;         memcpy(&value, bytes, 8); return value; }
+  default:          return 0.0;
+  }
+}
+
+// Next line of the header, split into words. False at the end of the file.
+static bool readHeaderLine(const char *& p, const char * end, std::vector<std::string> & out_words){
+  out_words.clear();
+  if (p >= end)
+    return false;
+  const char * lineEnd = (const char *)memchr(p, '\n', end - p);
+  if (!lineEnd)
+    lineEnd = end;
+  const char * word = p;
+  for (const char * c = p; c <= lineEnd; c++){
+    if (c == lineEnd || *c == ' ' || *c == '\t' || *c == '\r'){
+      if (c > word)
+        out_words.push_back(std::string(word, c));
+      word = c + 1;
+    }
+  }
+  p = lineEnd < end ? lineEnd + 1 : end;
+  return true;
+}
+
+// Where the vertex attributes PackedVertex gets sit in a vertex of the file
+enum PLYAttribute{ PLY_X, PLY_Y, PLY_Z, PLY_NX, PLY_NY, PLY_NZ, PLY_U, PLY_V, PLY_ATTRIBUTE_COUNT };
+
+struct PLYVertexLayout{
+  size_t stride;
+  int offsets[PLY_ATTRIBUTE_COUNT]; // -1 when the file doesn't have it
+  PLYType types[PLY_ATTRIBUTE_COUNT];
+};
+
+static int plyAttribute(const std::string & name){
+  static const char * names[] = { "x", "y", "z", "nx", "ny", "nz", "s", "t", "u", "v", "texture_u", "texture_v" };
+  for (int i = 0; i < 12; i++)
+    if (name == names[i])
+      return i < PLY_U ? i : PLY_U + (i - PLY_U) % 2;
+  return -1;
+}
+
+// Bytes of one element, walking its lists. NULL if it goes past end.
+template <bool swapBytes>
+static const char * skipPLYElement(const char * p, const char * end, const PLYElement & element){
+  for (size_t k = 0; k < element.properties.size(); k++){
+    const PLYProperty & property = element.properties[k];
+    size_t count = 1;
+    if (property.countType != PLY_NONE){
+      if ((size_t)(end - p) < plyTypeSize(property.countType))
+        return NULL;
+      count = (size_t)readPLY<swapBytes>(p, property.countType);
+      p += plyTypeSize(property.countType);
+    }
+    if ((size_t)(end - p) / plyTypeSize(property.type) < count)
+      return NULL;
+    p += count * plyTypeSize(property.type);
+  }
+  return p;
+}
+
+template <bool swapBytes>
+static bool readPLYBody(
+  const char * path,
+  const char * p,
+  const char * end,
+  const std::vector<PLYElement> & elements,
+  std::vector<unsigned int> & out_indices,
+  std::vector<PackedVertex> & out_vertices,
+  bool & out_hasNormals
+  ){
+  out_hasNormals = false;
+  for (size_t e = 0; e < elements.size(); e++){
+    const PLYElement & element = elements[e];
+
+    if (element.name == "vertex"){
+      // The layout is worked out once, each vertex is then a few reads at fixed offsets
+      PLYVertexLayout layout;
+      layout.stride = 0;
+      for (int a = 0; a < PLY_ATTRIBUTE_COUNT; a++)
+        layout.offsets[a] = -1, layout.types[a] = PLY_NONE;
+      for (size_t k = 0; k < element.properties.size(); k++){
+        const PLYProperty & property = element.properties[k];
+        if (property.countType != PLY_NONE){
+          printf("%s has a list in its vertices\n", path);
+          return false;
+        }
+        int a = plyAttribute(property.name);
+        if (a >= 0 && layout.offsets[a] < 0)
+          layout.offsets[a] = (int)layout.stride, layout.types[a] = property.type;
+        layout.stride += plyTypeSize(property.type);
+      }
+      if (layout.offsets[PLY_X] < 0 || layout.offsets[PLY_Y] < 0 || layout.offsets[PLY_Z] < 0){
+        printf("%s has vertices without x, y and z\n", path);
+        return false;
+      }
+      out_hasNormals = layout.offsets[PLY_NX] >= 0 && layout.offsets[PLY_NY] >= 0 && layout.offsets[PLY_NZ] >= 0;
+      if ((size_t)(end - p) / layout.stride < element.count){
+        printf("%s is cut short in its vertices\n", path);
+        return false;
+      }
+
+      out_vertices.resize(element.count);
+      for (size_t i = 0; i < element.count; i++, p += layout.stride){
+        float values[PLY_ATTRIBUTE_COUNT];
+        for (int a = 0; a < PLY_ATTRIBUTE_COUNT; a++)
+          values[a] = layout.offsets[a] >= 0 ? (float)readPLY<swapBytes>(p + layout.offsets[a], layout.types[a]) : 0.0f;
+        PackedVertex & vertex = out_vertices[i];
+        vertex.position = glm::vec3(values[PLY_X], values[PLY_Y], values[PLY_Z]);
+        vertex.uv = glm::vec2(values[PLY_U], values[PLY_V]);
+        vertex.normal = glm::vec3(values[PLY_NX], values[PLY_NY], values[PLY_NZ]);
+      }
+    }
+
+    else if (element.name == "face"){
+      size_t listProperty = element.properties.size();
+      for (size_t k = 0; k < element.properties.size(); k++)
+        if (element.properties[k].countType != PLY_NONE && (element.properties[k].name == "vertex_indices" || element.properties[k].name == "vertex_index"))
+          listProperty = k;
+      if (listProperty == element.properties.size()){
+        printf("%s has faces without vertex_indices\n", path);
+        return false;
+      }
+
+      // Mostly triangles : one triangle per face is a good guess
+      out_indices.reserve(out_indices.size() + element.count * 3);
+      for (size_t i = 0; i < element.count; i++){
+        for (size_t k = 0; k < element.properties.size(); k++){
+          const PLYProperty & property = element.properties[k];
+          size_t itemSize = plyTypeSize(property.type), count = 1;
+          if (property.countType != PLY_NONE){
+            if ((size_t)(end - p) < plyTypeSize(property.countType)){
+              p = NULL;
+              break;
+            }
+            count = (size_t)readPLY<swapBytes>(p, property.countType);
+            p += plyTypeSize(property.countType);
+          }
+          if ((size_t)(end - p) / itemSize < count){
+            p = NULL;
+            break;
+          }
+
+          // A fan around the first corner. Negative indices become out of range ones.
+          if (k == listProperty){
+            unsigned int first = 0, previous = 0;
+            for (size_t j = 0; j < count; j++){
+              double value = readPLY<swapBytes>(p + j * itemSize, property.type);
+              unsigned int index = value >= 0.0 ? (unsigned int)value : 0xffffffffu;
+              if (j == 0)
+                first = index;
+              else if (j >= 2)
+                out_indices.push_back(first), out_indices.push_back(previous), out_indices.push_back(index);
+              previous = index;
+            }
+          }
+          p += count * itemSize;
+        }
+        if (!p){
+          printf("%s is cut short in its faces\n", path);
+          return false;
+        }
+      }
+    }
+
+    else{
+      for (size_t i = 0; p && i < element.count; i++)
+        p = skipPLYElement<swapBytes>(p, end, element);
+      if (!p){
+        printf("%s is cut short in its %s elements\n", path, element.name.c_str());
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool loadPLY(
+  const char * path,
+  std::vector<unsigned int> & out_indices,
+  std::vector<PackedVertex> & out_vertices
+  ){
+  printf("Loading PLY file %s...\n", path);
+  out_indices.clear();
+  out_vertices.clear();
+
+  MappedFile file;
+  if (!mapFile(path, file)){
+    printf("%s could not be opened.\n", path);
+    return false;
+  }
+  const char * p = file.data, * end = file.data + file.size;
+
+  // The header is text, one line per element and property
+  std::vector<std::string> words;
+  std::vector<PLYElement> elements;
+  int format = -1; // 0 for little endian, 1 for big endian
+  bool ok = readHeaderLine(p, end, words) && words.size() == 1 && words[0] == "ply";
+  while (ok){
+    ok = readHeaderLine(p, end, words);
+    if (!ok || words.empty() || words[0] == "comment" || words[0] == "obj_info")
+      continue;
+    if (words[0] == "end_header")
+      break;
+    if (words[0] == "format" && words.size() >= 2){
+      format = words[1] == "binary_little_endian" ? 0 : words[1] == "binary_big_endian" ? 1 : -1;
+      if (format < 0)
+        printf("%s is %s, only binary PLY is supported\n", path, words[1].c_str());
+      ok = format >= 0;
+    }
+    else if (words[0] == "element" && words.size() == 3){
+      PLYElement element;
+      element.name = words[1];
+      element.count = (size_t)strtoull(words[2].c_str(), NULL, 10);
+      elements.push_back(element);
+    }
+    else if (words[0] == "property" && !elements.empty()){
+      PLYProperty property;
+      bool list = words.size() == 5 && words[1] == "list";
+      property.countType = list ? plyType(words[2]) : PLY_NONE;
+      property.type = plyType(words[list ? 3 : 1]);
+      property.name = words.back();
+      ok = (words.size() == 3 || list) && property.type != PLY_NONE && (!list || property.countType != PLY_NONE);
+      elements.back().properties.push_back(property);
+    }
+    else
+      ok = false;
+  }
+  if (!ok || format < 0){
+    printf("%s is not a binary PLY file\n", path);
+    unmapFile(file);
+    return false;
+  }
+
+  unsigned int one = 1;
+  bool littleEndianCPU = *(unsigned char *)&one == 1;
+  bool hasNormals;
+  if ((format == 0) == littleEndianCPU)
+    ok = readPLYBody<false>(path, p, end, elements, out_indices, out_vertices, hasNormals);
+  else
+    ok = readPLYBody<true>(path, p, end, elements, out_indices, out_vertices, hasNormals);
+  unmapFile(file);
+
+  for (size_t i = 0; ok && i < out_indices.size(); i++)
+    ok = out_indices[i] < out_vertices.size();
+  if (!ok){
+    printf("%s has faces with vertices it doesn't have\n", path);
+    out_indices.clear();
+    out_vertices.clear();
+    return false;
+  }
+  if (out_indices.empty()){
+    printf("%s has no triangles\n", path);
+    out_vertices.clear();
+    return false;
+  }
+  if (!hasNormals)
+    computeSmoothNormals(out_indices, out_vertices);
+  return true;
+}
+
+// Same position if same bits, like the indexers
+struct STLPositionTraits{
+  static unsigned int hash(const glm::vec3 & position){
+    return hashWords(&position, sizeof(glm::vec3));
+  }
+  static bool equal(const glm::vec3 & a, const glm::vec3 & b){
+    return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+  }
+};
+
+#define STL_HEADER_SIZE   84 // 80 bytes of anything, then the triangle count
+#define STL_TRIANGLE_SIZE 50 // Facet normal, 3 corners, 2-byte attribute
+
+bool loadSTL(
+  const char * path,
+  std::vector<unsigned int> & out_indices,
+  std::vector<PackedVertex> & out_vertices
+  ){
+  printf("Loading STL file %s...\n", path);
+  out_indices.clear();
+  out_vertices.clear();
+
+  MappedFile file;
+  if (!mapFile(path, file)){
+    printf("%s could not be opened.\n", path);
+    return false;
+  }
+
+  // ASCII STL begins with "solid", but so do some binary ones : the size tells
+  unsigned int triangleCount = 0;
+  if (file.size >= STL_HEADER_SIZE)
+    memcpy(&triangleCount, file.data + 80, 4);
+  if (file.size < STL_HEADER_SIZE || file.size != STL_HEADER_SIZE + (unsigned long long)triangleCount * STL_TRIANGLE_SIZE){
+    if (file.size >= 5 && memcmp(file.data, "solid", 5) == 0)
+      printf("%s is an ASCII STL, only binary STL is supported\n", path);
+    else
+      printf("%s is not a binary STL file\n", path);
+    unmapFile(file);
+    return false;
+  }
+
+  // A closed mesh has about half as many vertices as triangles
+  IndexHashMap<glm::vec3, STLPositionTraits> positions(triangleCount / 2);
+  out_indices.reserve((size_t)triangleCount * 3);
+  size_t collapsed = 0;
+  for (unsigned int t = 0; t < triangleCount; t++){
+    const char * corners = file.data + STL_HEADER_SIZE + (size_t)t * STL_TRIANGLE_SIZE + 12;
+    unsigned int triangle[3];
+    for (int c = 0; c < 3; c++){
+      float xyz[3];
+      memcpy(xyz, corners + c * 12, 12);
+      glm::vec3 position(xyz[0], xyz[1], xyz[2]);
+      // -0 and 0 are the same place
+      for (int k = 0; k < 3; k++)
+        if (position[k] == 0.0f)
+          position[k] = 0.0f;
+      bool inserted;
+      triangle[c] = positions.findOrInsert(position, inserted);
+    }
+    if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[2] == triangle[0]){
+      collapsed++;
+      continue;
+    }
+    out_indices.insert(out_indices.end(), triangle, triangle + 3);
+  }
+  unmapFile(file);
+  if (out_indices.empty()){
+    printf("%s has no triangles\n", path);
+    return false;
+  }
+
+  out_vertices.resize(positions.size());
+  for (unsigned int i = 0; i < positions.size(); i++){
+    out_vertices[i].position = positions.key(i);
+    out_vertices[i].uv = glm::vec2(0.0f);
+  }
+  computeSmoothNormals(out_indices, out_vertices);
+  if (collapsed > 0)
+    printf("%s : dropped %u triangles that welding collapsed\n", path, (unsigned int)collapsed);
+  return true;
+}
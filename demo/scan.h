@@ -0,0 +1,35 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <vector>
+#include <GL/glew.h>
+
+#include "loader.h"
+
+// Loaders for the binary formats scanners and CAD tools write, into the same
+// indexed, interleaved buffers as loadIndexedOBJ. The files are mapped and read
+// front to back once, nothing but the output is kept in memory.
+//
+// Meshes without normals get smooth ones, the area-weighted average of the
+// triangles around each vertex. Meshes without uvs get (0, 0). Files without a
+// single triangle fail to load.
+
+// Binary PLY, little or big endian. The vertex element gives x, y, z and, when
+// it has them, nx, ny, nz and s, t (or u, v, texture_u, texture_v), of any
+// scalar type. The face element gives a list of vertex indices, polygons are cut
+// into fans. Other elements and properties are skipped.
+bool loadPLY(
+  const char * path,
+  std::vector<unsigned int> & out_indices,
+  std::vector<PackedVertex> & out_vertices
+  );
+
+// Binary STL. Its triangles share no vertices : corners at the same position are
+// welded through a hash table, and triangles that collapse are dropped. The facet
+// normals are not used, the welded mesh gets smooth normals.
+bool loadSTL(
+  const char * path,
+  std::vector<unsigned int> & out_indices,
+  std::vector<PackedVertex> & out_vertices
+  );
+
+#endif
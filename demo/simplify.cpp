@@ -0,0 +1,396 @@
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "simplify.h"
+#include "meshopt.h"
+#include "hashmap.h"
+#include "parallel.h"
+
+#include <math.h>
+
+// Sum of squared distances to planes, weighted, as v^T A v + 2 b.v + c with A
+// symmetric. Dividing by weight gives the mean squared distance.
+struct Quadric{
+  float a00, a11, a22, a01, a02, a12;
+  float b0, b1, b2;
+  float c;
+  float weight;
+};
+
+static void addPlane(Quadric & q, const glm::vec3 & n, float d, float weight){
+  q.a00 += weight * n.x * n.x;
+  q.a11 += weight * n.y * n.y;
+  q.a22 += weight * n.z * n.z;
+  q.a01 += weight * n.x * n.y;
+  q.a02 += weight * n.x * n.z;
+  q.a12 += weight * n.y * n.z;
+  q.b0 += weight * n.x * d;
+  q.b1 += weight * n.y * d;
+  q.b2 += weight * n.z * d;
+  q.c += weight * d * d;
+  q.weight += weight;
+}
+
+static void addQuadric(Quadric & q, const Quadric & r){
+  q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+  q.a01 += r.a01; q.a02 += r.a02; q.a12 += r.a12;
+  q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+  q.c += r.c;
+  q.weight += r.weight;
+}
+
+static float quadricError(const Quadric & q, const glm::vec3 & v){
+  float r = q.a00 * v.x * v.x + q.a11 * v.y * v.y + q.a22 * v.z * v.z
+          + 2.0f * (q.a01 * v.x * v.y + q.a02 * v.x * v.z + q.a12 * v.y * v.z)
+          + 2.0f * (q.b0 * v.x + q.b1 * v.y + q.b2 * v.z)
+          + q.c;
+  return q.weight > 0.0f ? fabsf(r) / q.weight : 0.0f;
+}
+
+// Borders and seams are kept in place by planes through their edges, at right
+// angles to the surface, that weigh this much more than the surface itself
+#define SIMPLIFY_EDGE_WEIGHT 10.0f
+
+// Largest side of the bounding box, what errors are relative to
+static float meshExtent(const std::vector<glm::vec3> & positions){
+  if (positions.empty())
+    return 0.0f;
+  glm::vec3 minimum = positions[0], maximum = positions[0];
+  for (size_t i = 1; i < positions.size(); i++){
+    minimum = glm::min(minimum, positions[i]);
+    maximum = glm::max(maximum, positions[i]);
+  }
+  glm::vec3 size = maximum - minimum;
+  return glm::max(size.x, glm::max(size.y, size.z));
+}
+
+// Same position if same bits, like the indexers
+struct PositionTraits{
+  static unsigned int hash(const glm::vec3 & position){
+    return hashWords(&position, sizeof(glm::vec3));
+  }
+  static bool equal(const glm::vec3 & a, const glm::vec3 & b){
+    return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+  }
+};
+
+// Triangles around each vertex, in one flat array
+struct VertexTriangles{
+  std::vector<unsigned int> offsets;
+  std::vector<unsigned int> triangles;
+
+  void build(const std::vector<unsigned int> & indices, size_t vertexCount){
+    offsets.assign(vertexCount + 1, 0);
+    for (size_t i = 0; i < indices.size(); i++)
+      offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+      offsets[v + 1] += offsets[v];
+    triangles.resize(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+      triangles[fill[indices[i]]++] = (unsigned int)(i / 3);
+  }
+
+  // Whether a triangle has the edge a -> b, in its winding order
+  bool hasEdge(const std::vector<unsigned int> & indices, unsigned int a, unsigned int b) const{
+    for (unsigned int k = offsets[a]; k < offsets[a + 1]; k++){
+      const unsigned int * triangle = &indices[triangles[k] * 3];
+      if ((triangle[0] == a && triangle[1] == b) || (triangle[1] == a && triangle[2] == b) || (triangle[2] == a && triangle[0] == b))
+        return true;
+    }
+    return false;
+  }
+};
+
+enum VertexKind{
+  VERTEX_MANIFOLD, // Collapses onto any neighbour
+  VERTEX_BORDER,   // Onto the border vertices next to it along the border
+  VERTEX_SEAM,     // Onto the seam vertices next to it along the seam, with its twin
+  VERTEX_LOCKED    // Never
+};
+
+#define NO_EDGE    0xffffffffu
+#define MANY_EDGES 0xfffffffeu
+
+// Sorts out the vertices from the edges that have no twin going the other way :
+// one out and one in make a border vertex, and a seam vertex if its twin has the
+// same ones the other way around
+static void classifyVertices(
+  const std::vector<unsigned int> & indices,
+  const VertexTriangles & adjacency,
+  const std::vector<unsigned int> & remap,
+  const std::vector<unsigned int> & twin,
+  std::vector<unsigned char> & out_kinds
+  ){
+  size_t vertexCount = remap.size();
+  std::vector<unsigned int> openOut(vertexCount, NO_EDGE), openIn(vertexCount, NO_EDGE);
+  for (size_t i = 0; i < indices.size(); i++){
+    unsigned int a = indices[i], b = indices[i % 3 == 2 ? i - 2 : i + 1];
+    if (adjacency.hasEdge(indices, b, a))
+      continue;
+    openOut[a] = openOut[a] == NO_EDGE ? b : MANY_EDGES;
+    openIn[b] = openIn[b] == NO_EDGE ? a : MANY_EDGES;
+  }
+
+  out_kinds.resize(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++){
+    unsigned char kind = VERTEX_LOCKED;
+    unsigned int w = twin[v];
+    if (w == v){
+      if (openOut[v] == NO_EDGE && openIn[v] == NO_EDGE)
+        kind = VERTEX_MANIFOLD;
+      else if (openOut[v] < MANY_EDGES && openIn[v] < MANY_EDGES)
+        kind = VERTEX_BORDER;
+    }
+    else if (twin[w] == v){
+      if (openOut[v] < MANY_EDGES && openIn[v] < MANY_EDGES && openOut[w] < MANY_EDGES && openIn[w] < MANY_EDGES &&
+          remap[openOut[v]] == remap[openIn[w]] && remap[openIn[v]] == remap[openOut[w]])
+        kind = VERTEX_SEAM;
+    }
+    out_kinds[v] = kind;
+  }
+}
+
+struct Collapse{
+  unsigned int from, to;
+  float error;
+};
+
+static bool lessError(const Collapse & a, const Collapse & b){
+  return a.error < b.error;
+}
+
+// Whether moving from onto to turns a triangle around from over
+static bool flipsTriangle(
+  const std::vector<unsigned int> & indices,
+  const VertexTriangles & adjacency,
+  const std::vector<glm::vec3> & positions,
+  unsigned int from,
+  unsigned int to
+  ){
+  for (unsigned int k = adjacency.offsets[from]; k < adjacency.offsets[from + 1]; k++){
+    const unsigned int * triangle = &indices[adjacency.triangles[k] * 3];
+    if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+      continue; // Goes away
+    glm::vec3 corners[3], moved[3];
+    for (int c = 0; c < 3; c++){
+      corners[c] = positions[triangle[c]];
+      moved[c] = triangle[c] == from ? positions[to] : corners[c];
+    }
+    glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+    glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+    if (glm::dot(before, after) <= 0.0f)
+      return true;
+  }
+  return false;
+}
+
+float simplifyMesh(
+  const std::vector<unsigned int> & in_indices,
+  const std::vector<glm::vec3> & in_positions,
+  size_t targetIndexCount,
+  float targetError,
+  std::vector<unsigned int> & out_indices
+  ){
+  out_indices = in_indices;
+  size_t vertexCount = in_positions.size();
+  if (out_indices.size() <= targetIndexCount || vertexCount == 0)
+    return 0.0f;
+
+  // Work in a unit box so that errors are relative to the size of the mesh
+  float extent = meshExtent(in_positions);
+  float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+  std::vector<glm::vec3> positions(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++)
+    positions[v] = in_positions[v] * scale;
+
+  // remap : first vertex with the same position. twin : next one with the same
+  // position, in a ring.
+  std::vector<unsigned int> remap(vertexCount), twin(vertexCount), firstVertex;
+  IndexHashMap<glm::vec3, PositionTraits> uniquePositions(vertexCount);
+  for (unsigned int v = 0; v < vertexCount; v++){
+    bool inserted;
+    unsigned int p = uniquePositions.findOrInsert(in_positions[v], inserted);
+    if (inserted)
+      firstVertex.push_back(v);
+    remap[v] = firstVertex[p];
+    twin[v] = v;
+    if (remap[v] != v){
+      twin[v] = twin[remap[v]];
+      twin[remap[v]] = v;
+    }
+  }
+
+  VertexTriangles adjacency;
+  adjacency.build(out_indices, vertexCount);
+  std::vector<unsigned char> kinds;
+  classifyVertices(out_indices, adjacency, remap, twin, kinds);
+
+  // One quadric per position : the planes of its triangles, by area, and of its
+  // border and seam edges
+  Quadric zero = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+  std::vector<Quadric> quadrics(vertexCount, zero);
+  for (size_t i = 0; i < out_indices.size(); i += 3){
+    const unsigned int * triangle = &out_indices[i];
+    glm::vec3 a = positions[triangle[0]], b = positions[triangle[1]], c = positions[triangle[2]];
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    float area = glm::length(normal);
+    if (area == 0.0f)
+      continue;
+    normal /= area;
+    for (int k = 0; k < 3; k++)
+      addPlane(quadrics[remap[triangle[k]]], normal, -glm::dot(normal, a), area * 0.5f);
+
+    for (int k = 0; k < 3; k++){
+      unsigned int e0 = triangle[k], e1 = triangle[(k + 1) % 3];
+      if (adjacency.hasEdge(out_indices, e1, e0))
+        continue;
+      glm::vec3 edge = positions[e1] - positions[e0];
+      float length = glm::length(edge);
+      if (length == 0.0f)
+        continue;
+      glm::vec3 edgeNormal = glm::normalize(glm::cross(edge, normal));
+      float d = -glm::dot(edgeNormal, positions[e0]);
+      addPlane(quadrics[remap[e0]], edgeNormal, d, length * length * SIMPLIFY_EDGE_WEIGHT);
+      addPlane(quadrics[remap[e1]], edgeNormal, d, length * length * SIMPLIFY_EDGE_WEIGHT);
+    }
+  }
+
+  // Passes of collapses that do not touch each other, cheapest first, until
+  // nothing more can go
+  float maxError = targetError * targetError, reached = 0.0f;
+  std::vector<Collapse> collapses;
+  std::vector<unsigned int> collapseTo(vertexCount);
+  std::vector<bool> touched(vertexCount);
+  while (out_indices.size() > targetIndexCount){
+    collapses.clear();
+    for (size_t i = 0; i < out_indices.size(); i++){
+      unsigned int a = out_indices[i], b = out_indices[i % 3 == 2 ? i - 2 : i + 1];
+      if (remap[a] == remap[b])
+        continue;
+      bool open = !adjacency.hasEdge(out_indices, b, a);
+      if (!open && a > b)
+        continue; // The other triangle of the edge has it
+      Quadric q = quadrics[remap[a]];
+      addQuadric(q, quadrics[remap[b]]);
+
+      for (int direction = 0; direction < 2; direction++){
+        unsigned int from = direction ? b : a, to = direction ? a : b;
+        bool allowed = false;
+        switch (kinds[from]){
+        case VERTEX_MANIFOLD:
+          allowed = true;
+          break;
+        case VERTEX_BORDER:
+          allowed = kinds[to] == VERTEX_BORDER && open;
+          break;
+        case VERTEX_SEAM:
+          allowed = kinds[to] == VERTEX_SEAM && open &&
+            (adjacency.hasEdge(out_indices, twin[from], twin[to]) || adjacency.hasEdge(out_indices, twin[to], twin[from]));
+          break;
+        }
+        if (allowed){
+          Collapse collapse = { from, to, quadricError(q, positions[to]) };
+          collapses.push_back(collapse);
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(), lessError);
+
+    // A manifold collapse takes 2 triangles away, a border one 1, a seam one 1 on each side
+    size_t triangleGoal = (out_indices.size() - targetIndexCount) / 3, removed = 0;
+    for (size_t v = 0; v < vertexCount; v++)
+      collapseTo[v] = (unsigned int)v;
+    touched.assign(vertexCount, false);
+    size_t collapsed = 0;
+    for (size_t i = 0; i < collapses.size() && removed < triangleGoal; i++){
+      const Collapse & collapse = collapses[i];
+      if (collapse.error > maxError)
+        break;
+      unsigned int from = collapse.from, to = collapse.to;
+      if (touched[remap[from]] || touched[remap[to]])
+        continue;
+      if (flipsTriangle(out_indices, adjacency, positions, from, to))
+        continue;
+      if (kinds[from] == VERTEX_SEAM && flipsTriangle(out_indices, adjacency, positions, twin[from], twin[to]))
+        continue;
+
+      collapseTo[from] = to;
+      if (kinds[from] == VERTEX_SEAM)
+        collapseTo[twin[from]] = twin[to];
+      addQuadric(quadrics[remap[to]], quadrics[remap[from]]);
+      touched[remap[from]] = touched[remap[to]] = true;
+      removed += kinds[from] == VERTEX_BORDER ? 1 : 2;
+      reached = glm::max(reached, collapse.error);
+      collapsed++;
+    }
+    if (collapsed == 0)
+      break;
+
+    // Move the corners, drop the triangles that lost an edge
+    size_t kept = 0;
+    for (size_t i = 0; i < out_indices.size(); i += 3){
+      unsigned int a = collapseTo[out_indices[i]], b = collapseTo[out_indices[i + 1]], c = collapseTo[out_indices[i + 2]];
+      if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a])
+        continue;
+      out_indices[kept++] = a;
+      out_indices[kept++] = b;
+      out_indices[kept++] = c;
+    }
+    out_indices.resize(kept);
+    adjacency.build(out_indices, vertexCount);
+  }
+
+  return sqrtf(reached);
+}
+
+void generateLODs(
+  std::vector<unsigned int> & indices,
+  const std::vector<glm::vec3> & positions,
+  std::vector<MeshLOD> & out_lods,
+  unsigned int threadCount
+  ){
+  // Every level starts from the full mesh, so they can all be made at once
+  std::vector<std::vector<unsigned int> > levels(LOD_LEVELS);
+  std::vector<float> errors(LOD_LEVELS, 0.0f);
+  size_t triangleCount = indices.size() / 3;
+  parallelFor(LOD_LEVELS - 1, threadCount, [&](unsigned int i){
+    size_t target = (size_t)(triangleCount * pow(LOD_REDUCTION, (double)(i + 1))) * 3;
+    errors[i + 1] = simplifyMesh(indices, positions, target, LOD_MAX_ERROR, levels[i + 1]);
+    if (!levels[i + 1].empty())
+      optimizeVertexCache(&levels[i + 1][0], levels[i + 1].size(), positions.size());
+  });
+
+  float extent = meshExtent(positions);
+  MeshLOD full = { 0, (unsigned int)indices.size(), 0.0f };
+  out_lods.assign(1, full);
+  for (size_t i = 1; i < levels.size(); i++){
+    if (levels[i].empty() || levels[i].size() >= out_lods.back().indexCount)
+      continue;
+    MeshLOD lod = { (unsigned int)indices.size(), (unsigned int)levels[i].size(), errors[i] * extent };
+    out_lods.push_back(lod);
+    indices.insert(indices.end(), levels[i].begin(), levels[i].end());
+  }
+}
+
+size_t selectLOD(
+  const std::vector<MeshLOD> & lods,
+  const glm::vec3 & center,
+  const glm::mat4 & modelView,
+  const glm::mat4 & proj,
+  float viewportHeight,
+  float maxPixels
+  ){
+  float depth = -(modelView * glm::vec4(center, 1.0f)).z;
+  if (depth <= 0.0f)
+    return 0;
+
+  // proj[1][1] is how many half viewports one unit spans at a depth of 1
+  float pixelsPerUnit = proj[1][1] * viewportHeight * 0.5f / depth;
+  size_t level = 0;
+  for (size_t i = 1; i < lods.size(); i++)
+    if (lods[i].error * pixelsPerUnit <= maxPixels)
+      level = i;
+  return level;
+}
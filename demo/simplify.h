@@ -0,0 +1,66 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+#include <vector>
+#include <stddef.h>
+#include <glm/glm.hpp>
+
+// Fewer triangles for about the same shape : edge collapses in the order of their
+// quadric error (Garland & Heckbert, "Surface Simplification Using Quadric Error
+// Metrics"), and levels of detail made out of them.
+
+// Levels generateLODs makes, the full mesh included, and the fraction of the
+// triangles of the full mesh each one keeps over the one before
+#define LOD_LEVELS    4
+#define LOD_REDUCTION 0.5f
+
+// Largest error a level may reach on its way to its triangle target, relative to
+// the size of the mesh
+#define LOD_MAX_ERROR 0.05f
+
+// Collapses edges of in_indices, cheapest first, until at most targetIndexCount
+// indices are left or the next collapse would move the surface by more than
+// targetError, relative to the size of the mesh. Collapses merge a vertex into a
+// neighbour and never move or create one, so out_indices index the same vertices.
+//  - vertices that share their position with one other vertex, but not their uv
+//    or normal, are on a seam : both only collapse along the seam, together
+//  - vertices on an open border only collapse along the border
+//  - anything more tangled than that never collapses
+// Returns the error reached, relative to the size of the mesh.
+float simplifyMesh(
+  const std::vector<unsigned int> & in_indices,
+  const std::vector<glm::vec3> & positions,
+  size_t targetIndexCount,
+  float targetError,
+  std::vector<unsigned int> & out_indices
+  );
+
+// A level of detail : a range of the shared index buffer
+struct MeshLOD{
+  unsigned int indexOffset; // In indices, not bytes
+  unsigned int indexCount;
+  float error;              // In model units, 0 for the full mesh
+};
+
+// Simplifies indices into up to LOD_LEVELS - 1 coarser levels, each on its own
+// thread out of threadCount (0 = one per core), and appends them to indices.
+// out_lods[0] is indices as they were. Levels come vertex cache optimized, and one
+// that could not get coarser than the level before is left out.
+void generateLODs(
+  std::vector<unsigned int> & indices,
+  const std::vector<glm::vec3> & positions,
+  std::vector<MeshLOD> & out_lods,
+  unsigned int threadCount = 0
+  );
+
+// Coarsest level whose error, seen at the depth of center through modelView and
+// proj on a viewport viewportHeight pixels tall, spans at most maxPixels
+size_t selectLOD(
+  const std::vector<MeshLOD> & lods,
+  const glm::vec3 & center,
+  const glm::mat4 & modelView,
+  const glm::mat4 & proj,
+  float viewportHeight,
+  float maxPixels
+  );
+
+#endif
@@ -0,0 +1,77 @@
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "tangent.h"
+#include "parallel.h"
+
+#include <math.h>
+
+// Triangles per parallelFor task
+#define TANGENT_BLOCK_SIZE (1 << 14)
+
+// Any unit vector at right angles to normal
+static glm::vec3 perpendicular(const glm::vec3 & normal){
+  glm::vec3 axis = fabsf(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  return glm::normalize(glm::cross(normal, axis));
+}
+
+// Angle between the edges from a to b and from a to c
+static float cornerAngle(const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c){
+  glm::vec3 ab = b - a, ac = c - a;
+  float lengths = glm::length(ab) * glm::length(ac);
+  if (lengths == 0.0f)
+    return 0.0f;
+  return acosf(glm::clamp(glm::dot(ab, ac) / lengths, -1.0f, 1.0f));
+}
+
+void computeTangentBasis(
+  const std::vector<glm::vec3> & vertices,
+  const std::vector<glm::vec2> & uvs,
+  const std::vector<glm::vec3> & normals,
+  std::vector<glm::vec3> & out_tangents,
+  std::vector<glm::vec3> & out_bitangents,
+  unsigned int threadCount
+  ){
+  size_t triangleCount = vertices.size() / 3;
+  out_tangents.resize(triangleCount * 3);
+  out_bitangents.resize(triangleCount * 3);
+
+  unsigned int blockCount = (unsigned int)((triangleCount + TANGENT_BLOCK_SIZE - 1) / TANGENT_BLOCK_SIZE);
+  parallelFor(blockCount, threadCount, [&](unsigned int block){
+    size_t begin = (size_t)block * TANGENT_BLOCK_SIZE, end = std::min(begin + TANGENT_BLOCK_SIZE, triangleCount);
+    for (size_t t = begin; t < end; t++){
+      const glm::vec3 * v = &vertices[t * 3];
+      const glm::vec2 * uv = &uvs[t * 3];
+
+      // Edges of the triangle, in space and in uv space
+      glm::vec3 deltaPos1 = v[1] - v[0], deltaPos2 = v[2] - v[0];
+      glm::vec2 deltaUV1 = uv[1] - uv[0], deltaUV2 = uv[2] - uv[0];
+
+      // Where u and v grow, the signed area of the uvs flipping them both for
+      // mirrored uvs
+      float area = deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x;
+      glm::vec3 tangent = deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y;
+      glm::vec3 bitangent = deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x;
+      if (area < 0.0f)
+        tangent = -tangent, bitangent = -bitangent;
+
+      for (int c = 0; c < 3; c++){
+        const glm::vec3 & normal = normals[t * 3 + c];
+        float angle = cornerAngle(v[c], v[(c + 1) % 3], v[(c + 2) % 3]);
+
+        // Degenerate uvs : any tangent will do, it has nothing to map
+        glm::vec3 cornerTangent = tangent - normal * glm::dot(normal, tangent);
+        float length = glm::length(cornerTangent);
+        cornerTangent = area != 0.0f && length > 0.0f ? cornerTangent / length : perpendicular(normal);
+
+        glm::vec3 cornerBitangent = bitangent - normal * glm::dot(normal, bitangent);
+        length = glm::length(cornerBitangent);
+        cornerBitangent = area != 0.0f && length > 0.0f ? cornerBitangent / length : glm::cross(normal, cornerTangent);
+
+        out_tangents[t * 3 + c] = cornerTangent * angle;
+        out_bitangents[t * 3 + c] = cornerBitangent * angle;
+      }
+    }
+  });
+}
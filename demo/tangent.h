@@ -0,0 +1,25 @@
+#ifndef TANGENT_H
+#define TANGENT_H
+#include <vector>
+#include <glm/glm.hpp>
+
+// Tangent space for normal mapping, from the uvs of the triangles
+
+// Tangent and bitangent of every corner of a triangle soup, as loadOBJ gives it,
+// laid out for indexVBO_TBN_fast to sum over the corners of each vertex :
+//  - the tangent and bitangent of the triangle, from the derivatives of its uvs
+//  - projected onto the plane of the corner's normal and normalized
+//  - scaled by the angle of the corner, so that big fans of thin triangles
+//    don't outweigh the rest
+// Which is how MikkTSpace weighs them. Triangles are independent, and split
+// over threadCount threads (0 = one per core).
+void computeTangentBasis(
+  const std::vector<glm::vec3> & vertices,
+  const std::vector<glm::vec2> & uvs,
+  const std::vector<glm::vec3> & normals,
+  std::vector<glm::vec3> & out_tangents,
+  std::vector<glm::vec3> & out_bitangents,
+  unsigned int threadCount = 0
+  );
+
+#endif
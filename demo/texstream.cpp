@@ -0,0 +1,310 @@
+#include <GL/glew.h>
+
+#include "texstream.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Locks, so that the decode thread never sees a state half written
+static void setSlotState(TextureStreamer & streamer, TextureStreamSlot & slot, TextureSlotState state){
+  std::lock_guard<std::mutex> lock(streamer.mutex);
+  slot.state = state;
+}
+
+// Destination for size bytes : the mapped buffer when they fit, slot.overflow
+// when not
+static unsigned char * slotPixels(TextureStreamSlot & slot, size_t slotSize, size_t size){
+  if (slot.mapped && size <= slotSize)
+    return slot.mapped;
+  slot.overflow.resize(size);
+  return &slot.overflow[0];
+}
+
+// On the decode thread : the compressed chain of slot.path, copied from its
+// cache or built
+static bool readCompressedSlot(TextureStreamSlot & slot, size_t slotSize, BlockFormat format){
+  CompressedChain chain;
+  if (!loadCompressedChain(slot.path.c_str(), format, chain))
+    return false;
+  size_t size = chain.levels.back().offset + chain.levels.back().size;
+  memcpy(slotPixels(slot, slotSize, size), chain.blocks, size);
+  slot.levels = chain.levels;
+  closeCompressedChain(chain);
+  return true;
+}
+
+// On the decode thread : the levels of the KTX file slot.path, one after the
+// other
+static bool readKTXSlot(TextureStreamSlot & slot, size_t slotSize){
+  KTXImage image;
+  if (!loadKTX(slot.path.c_str(), image))
+    return false;
+
+  size_t size = 0;
+  slot.levels = image.levels;
+  for (size_t l = 0; l < slot.levels.size(); l++){
+    slot.levels[l].offset = size;
+    size += slot.levels[l].size;
+  }
+  unsigned char * pixels = slotPixels(slot, slotSize, size);
+  for (size_t l = 0; l < slot.levels.size(); l++)
+    memcpy(pixels + slot.levels[l].offset, image.file.data + image.levels[l].offset, slot.levels[l].size);
+
+  slot.ktxFormat = image.format;
+  slot.generateMipmaps = image.generateMipmaps;
+  closeKTX(image);
+  return true;
+}
+
+// On the decode thread : the pixels of slot.path, and their mip chain with
+// cpuMipmaps, into the mapped buffer when they fit, into slot.overflow when not
+static bool readSlot(TextureStreamSlot & slot, size_t slotSize, const TextureOptions & options){
+  printf("Streaming image %s\n", slot.path.c_str());
+  slot.ktx = isKTXPath(slot.path.c_str());
+  if (slot.ktx)
+    return readKTXSlot(slot, slotSize);
+  if (options.compressed)
+    return readCompressedSlot(slot, slotSize, options.blockFormat);
+  bool cpuMipmaps = options.cpuMipmaps;
+
+  FILE * file = fopen(slot.path.c_str(), "rb");
+  if (!file)                        { printf("%s could not be opened.\n", slot.path.c_str()); return false; }
+
+  if (!readBMPInfo(file, slot.info)){
+    fclose(file);
+    return false;
+  }
+
+  // glTexSubImage2D reads rows padded to 4 bytes, as BMP stores them : all of
+  // them must be there
+  size_t rowSize = (slot.info.width * 3 + 3) & ~3u;
+  if (slot.info.imageSize < rowSize * slot.info.height){
+    printf("%s is shorter than its header says\n", slot.path.c_str());
+    fclose(file);
+    return false;
+  }
+
+  // The buffer is write combined, reading it back would crawl : level 0 goes
+  // to memory first when the chain is made from it
+  size_t size = rowSize * slot.info.height;
+  size_t chainSize = cpuMipmaps ? mipChainLayout(slot.info.width, slot.info.height, slot.levels) : size;
+  unsigned char * pixels = slotPixels(slot, slotSize, chainSize);
+  unsigned char * read = pixels;
+  if (cpuMipmaps){
+    slot.source.resize(size);
+    read = &slot.source[0];
+  }
+
+  bool ok = fread(read, 1, size, file) == size;
+  fclose(file);
+  if (!ok)
+    printf("%s could not be read.\n", slot.path.c_str());
+  else if (cpuMipmaps)
+    generateMipChain(read, pixels, slot.levels, 0);
+  std::vector<unsigned char>().swap(slot.source);
+  return ok;
+}
+
+static void decodeTextures(TextureStreamer * streamer){
+  std::unique_lock<std::mutex> lock(streamer->mutex);
+  for (;;){
+    TextureStreamSlot * slot = NULL;
+    streamer->wake.wait(lock, [&](){
+      for (int i = 0; i < TEXTURE_STREAM_SLOTS && !slot; i++)
+        if (streamer->slots[i].state == TEXTURE_SLOT_QUEUED)
+          slot = &streamer->slots[i];
+      return streamer->quit || slot != NULL;
+    });
+    if (streamer->quit)
+      return;
+
+    slot->state = TEXTURE_SLOT_DECODING;
+    lock.unlock();
+    slot->ok = readSlot(*slot, streamer->slotSize, streamer->options);
+    lock.lock();
+    slot->state = TEXTURE_SLOT_DECODED;
+  }
+}
+
+void startTextureStreamer(TextureStreamer & streamer, size_t slotSize, const TextureOptions & options){
+  streamer.quit = false;
+  streamer.options = options;
+  streamer.slotSize = slotSize;
+  streamer.persistent = GLEW_ARB_buffer_storage != 0;
+
+  for (int i = 0; i < TEXTURE_STREAM_SLOTS; i++){
+    TextureStreamSlot & slot = streamer.slots[i];
+    glGenBuffers(1, &slot.buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    if (streamer.persistent){
+      GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slotSize, NULL, flags);
+      slot.mapped = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotSize, flags);
+    }
+    else{
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, slotSize, NULL, GL_STREAM_DRAW);
+      slot.mapped = NULL;
+    }
+    slot.fence = 0;
+    slot.state = TEXTURE_SLOT_FREE;
+    slot.ok = false;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  unsigned char grey[4] = { 128, 128, 128, 0 };
+  createTexturePair(1, 1, grey, streamer.placeholder);
+
+  streamer.worker = std::thread(decodeTextures, &streamer);
+}
+
+size_t requestTexture(TextureStreamer & streamer, const char * path){
+  for (size_t i = 0; i < streamer.textures.size(); i++)
+    if (streamer.textures[i].path == path)
+      return i;
+
+  StreamedTexture texture;
+  texture.path = path;
+  texture.pair = streamer.placeholder;
+  texture.state = STREAMED_TEXTURE_PENDING;
+  streamer.textures.push_back(texture);
+  streamer.pending.push_back(streamer.textures.size() - 1);
+  return streamer.textures.size() - 1;
+}
+
+// The pixels are in the slot : make the textures from them
+static void uploadSlot(TextureStreamer & streamer, TextureStreamSlot & slot){
+  StreamedTexture & texture = streamer.textures[slot.texture];
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+  if (!streamer.persistent && slot.mapped){
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    slot.mapped = NULL;
+  }
+
+  if (slot.ok && slot.ktx && !ktxFormatSupported(slot.ktxFormat)){
+    printf("%s is in a format this context can't sample\n", slot.path.c_str());
+    slot.ok = false;
+  }
+
+  if (!slot.ok){
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    std::vector<unsigned char>().swap(slot.overflow);
+    texture.state = STREAMED_TEXTURE_FAILED;
+    setSlotState(streamer, slot, TEXTURE_SLOT_FREE);
+    return;
+  }
+
+  // Offset 0 in the buffer, or the overflow in memory
+  const unsigned char * pixels = NULL;
+  if (!slot.overflow.empty()){
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    pixels = &slot.overflow[0];
+  }
+  if (slot.ktx)
+    createKTXTexturePair(pixels, slot.levels, slot.ktxFormat, slot.generateMipmaps, texture.pair);
+  else if (streamer.options.compressed)
+    createCompressedTexturePair(pixels, slot.levels, streamer.options.blockFormat, texture.pair);
+  else if (streamer.options.cpuMipmaps)
+    createTexturePairLevels(pixels, slot.levels, texture.pair);
+  else
+    createTexturePair(slot.info.width, slot.info.height, pixels, texture.pair);
+  std::vector<unsigned char>().swap(slot.overflow);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  setSlotState(streamer, slot, TEXTURE_SLOT_UPLOADED);
+}
+
+// True once the upload has read the buffer, the textures are then ready
+static bool retireSlot(TextureStreamer & streamer, TextureStreamSlot & slot){
+  if (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+    return false;
+  glDeleteSync(slot.fence);
+  slot.fence = 0;
+  streamer.textures[slot.texture].state = STREAMED_TEXTURE_READY;
+  setSlotState(streamer, slot, TEXTURE_SLOT_FREE);
+  return true;
+}
+
+static void queueSlot(TextureStreamer & streamer, TextureStreamSlot & slot){
+  slot.texture = streamer.pending.front();
+  streamer.pending.pop_front();
+  slot.path = streamer.textures[slot.texture].path;
+
+  if (!streamer.persistent){
+    // The fence has passed, nothing reads the old contents any more
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    slot.mapped = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, streamer.slotSize,
+                                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  setSlotState(streamer, slot, TEXTURE_SLOT_QUEUED);
+  streamer.wake.notify_one();
+}
+
+void updateTextureStreamer(TextureStreamer & streamer){
+  for (int i = 0; i < TEXTURE_STREAM_SLOTS; i++){
+    TextureStreamSlot & slot = streamer.slots[i];
+    TextureSlotState state;
+    {
+      std::lock_guard<std::mutex> lock(streamer.mutex);
+      state = slot.state;
+    }
+
+    if (state == TEXTURE_SLOT_DECODED){
+      uploadSlot(streamer, slot);
+      continue; // Its fence can't have passed yet
+    }
+    if (state == TEXTURE_SLOT_UPLOADED && retireSlot(streamer, slot))
+      state = TEXTURE_SLOT_FREE;
+    if (state == TEXTURE_SLOT_FREE && !streamer.pending.empty())
+      queueSlot(streamer, slot);
+  }
+}
+
+const TexturePair & streamedTexture(const TextureStreamer & streamer, size_t handle){
+  const StreamedTexture & texture = streamer.textures[handle];
+  return texture.state == STREAMED_TEXTURE_READY ? texture.pair : streamer.placeholder;
+}
+
+bool textureStreamerIdle(const TextureStreamer & streamer){
+  for (size_t i = 0; i < streamer.textures.size(); i++)
+    if (streamer.textures[i].state == STREAMED_TEXTURE_PENDING)
+      return false;
+  return true;
+}
+
+void stopTextureStreamer(TextureStreamer & streamer){
+  {
+    std::lock_guard<std::mutex> lock(streamer.mutex);
+    streamer.quit = true;
+  }
+  streamer.wake.notify_all();
+  if (streamer.worker.joinable())
+    streamer.worker.join();
+
+  for (int i = 0; i < TEXTURE_STREAM_SLOTS; i++){
+    TextureStreamSlot & slot = streamer.slots[i];
+    if (slot.fence)
+      glDeleteSync(slot.fence);
+    if (slot.mapped){
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    glDeleteBuffers(1, &slot.buffer);
+    slot.fence = 0;
+    slot.mapped = NULL;
+    slot.buffer = 0;
+    slot.state = TEXTURE_SLOT_FREE;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  // A texture still uploading when the fence was dropped is deleted all the same
+  for (size_t i = 0; i < streamer.textures.size(); i++)
+    if (streamer.textures[i].pair.linear != streamer.placeholder.linear)
+      deleteTexturePair(streamer.textures[i].pair);
+  deleteTexturePair(streamer.placeholder);
+  streamer.textures.clear();
+  streamer.pending.clear();
+}
@@ -0,0 +1,105 @@
+#ifndef TEXSTREAM_H
+#define TEXSTREAM_H
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <GL/glew.h>
+
+#include "loader.h"
+#include "texture.h"
+
+// Loads textures without stalling the frames. A decode thread reads each BMP
+// straight into a mapped pixel unpack buffer, one of a small ring; the GL thread
+// then makes the textures from that buffer with glTexSubImage2D, which the driver
+// can do asynchronously, and fences the upload before the buffer is filled again.
+// Until a texture is ready, a 1x1 placeholder stands in for it. With CPU mip
+// chains, the decode thread builds them too, straight into the buffer. Block
+// compressed chains are copied into it from their cache, or built first. KTX
+// files are copied into it from their mapping, level by level.
+//
+// With ARB_buffer_storage (GL 4.4) the buffers stay mapped, persistent and
+// coherent, for as long as the streamer runs. Without it, each one is mapped by
+// the GL thread before its job and unmapped before the upload.
+
+#define TEXTURE_STREAM_SLOTS 2
+
+enum TextureSlotState{
+  TEXTURE_SLOT_FREE,     // GL thread's, may be handed a job
+  TEXTURE_SLOT_QUEUED,   // Waiting for the decode thread
+  TEXTURE_SLOT_DECODING, // Decode thread's
+  TEXTURE_SLOT_DECODED,  // GL thread's, to be uploaded
+  TEXTURE_SLOT_UPLOADED  // GL thread's, until the fence says the upload read it
+};
+
+// One pixel unpack buffer of the ring and the job it holds
+struct TextureStreamSlot{
+  GLuint buffer;
+  unsigned char * mapped;              // NULL while unmapped
+  GLsync fence;
+  TextureSlotState state;
+  size_t texture;                      // Handle of the texture being loaded
+  std::string path;
+  BMPInfo info;
+  std::vector<MipLevel> levels;        // Of the chain, with CPU mip chains, compressed, or KTX
+  bool ktx;                            // The job is a KTX file, in ktxFormat
+  KTXFormat ktxFormat;
+  bool generateMipmaps;                // The KTX file has level 0 only
+  std::vector<unsigned char> source;   // Level 0, as read, with CPU mip chains
+  std::vector<unsigned char> overflow; // The pixels, for images bigger than the buffer
+  bool ok;
+};
+
+enum StreamedTextureState{
+  STREAMED_TEXTURE_PENDING,
+  STREAMED_TEXTURE_READY,
+  STREAMED_TEXTURE_FAILED
+};
+
+struct StreamedTexture{
+  std::string path;
+  TexturePair pair;
+  StreamedTextureState state;
+};
+
+struct TextureStreamer{
+  std::thread worker;
+  std::mutex mutex;                    // Guards the slot states, and quit
+  std::condition_variable wake;        // A slot was queued, or quit set
+  bool quit;
+  bool persistent;                     // Slots stay mapped
+  TextureOptions options;
+  size_t slotSize;
+  TextureStreamSlot slots[TEXTURE_STREAM_SLOTS];
+  std::vector<StreamedTexture> textures;
+  std::deque<size_t> pending;          // Requested, not handed to a slot yet
+  TexturePair placeholder;
+};
+
+// Creates the buffers, slotSize bytes each, the placeholder, and the decode
+// thread. Images up to slotSize bytes of pixels, mip chain included, go through
+// the buffers.
+void startTextureStreamer(TextureStreamer & streamer, size_t slotSize, const TextureOptions & options);
+
+// Queues the BMP or KTX file at path and returns its handle, the same for the
+// same path
+size_t requestTexture(TextureStreamer & streamer, const char * path);
+
+// On the GL thread, once a frame : uploads what was decoded, retires the
+// uploads that completed and hands the free buffers their next jobs. Never waits.
+void updateTextureStreamer(TextureStreamer & streamer);
+
+// The textures of handle once they are ready, the placeholder until then, or
+// for good if it failed to load
+const TexturePair & streamedTexture(const TextureStreamer & streamer, size_t handle);
+
+// True when every requested texture is ready or has failed
+bool textureStreamerIdle(const TextureStreamer & streamer);
+
+// Stops the decode thread and deletes the buffers, the placeholder and every
+// streamed texture
+void stopTextureStreamer(TextureStreamer & streamer);
+
+#endif
@@ -0,0 +1,325 @@
+#include <vector>
+#include <map>
+#include <string>
+#include <GL/glew.h>
+
+#include "texture.h"
+#include "loader.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Levels of a full mip chain down to 1x1
+static GLsizei mipLevelCount(unsigned int width, unsigned int height){
+  GLsizei levels = 1;
+  for (unsigned int size = width > height ? width : height; size > 1; size >>= 1)
+    levels++;
+  return levels;
+}
+
+// Same sampling as loadBMP : repeated, trilinear
+static void setSampling(GLuint texture){
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+}
+
+static GLuint uploadTexture(unsigned int width, unsigned int height, const void * pixels, GLint internalFormat){
+  GLuint texture;
+  glGenTextures(1, &texture);
+  setSampling(texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, pixels);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  return texture;
+}
+
+void createTexturePair(unsigned int width, unsigned int height, const void * pixels, TexturePair & out_pair){
+  if (GLEW_ARB_texture_storage && GLEW_ARB_texture_view){
+    // RGB8 and SRGB8 are both 24 bits per texel, the same view class : one
+    // allocation can be seen as either
+    GLsizei levels = mipLevelCount(width, height);
+    glGenTextures(1, &out_pair.linear);
+    glBindTexture(GL_TEXTURE_2D, out_pair.linear);
+    glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGB8, width, height);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, pixels);
+    setSampling(out_pair.linear);
+
+    // A view must be a name that was never bound
+    glGenTextures(1, &out_pair.srgb);
+    glTextureView(out_pair.srgb, GL_TEXTURE_2D, out_pair.linear, GL_SRGB8, 0, levels, 0, 1);
+    setSampling(out_pair.srgb);
+    glGenerateMipmap(GL_TEXTURE_2D);
+  }
+  else{
+    out_pair.linear = uploadTexture(width, height, pixels, GL_RGB8);
+    out_pair.srgb = uploadTexture(width, height, pixels, GL_SRGB8);
+  }
+}
+
+// Every level of levels, from chain
+static void uploadLevels(const unsigned char * chain, const std::vector<MipLevel> & levels, GLint internalFormat){
+  for (size_t l = 0; l < levels.size(); l++){
+    const MipLevel & level = levels[l];
+    if (internalFormat)
+      glTexImage2D(GL_TEXTURE_2D, (GLint)l, internalFormat, level.width, level.height, 0, GL_BGR, GL_UNSIGNED_BYTE, chain + level.offset);
+    else
+      glTexSubImage2D(GL_TEXTURE_2D, (GLint)l, 0, 0, level.width, level.height, GL_BGR, GL_UNSIGNED_BYTE, chain + level.offset);
+  }
+}
+
+void createTexturePairLevels(const unsigned char * chain, const std::vector<MipLevel> & levels, TexturePair & out_pair){
+  if (GLEW_ARB_texture_storage && GLEW_ARB_texture_view){
+    glGenTextures(1, &out_pair.linear);
+    glBindTexture(GL_TEXTURE_2D, out_pair.linear);
+    glTexStorage2D(GL_TEXTURE_2D, (GLsizei)levels.size(), GL_RGB8, levels[0].width, levels[0].height);
+    uploadLevels(chain, levels, 0);
+    setSampling(out_pair.linear);
+
+    glGenTextures(1, &out_pair.srgb);
+    glTextureView(out_pair.srgb, GL_TEXTURE_2D, out_pair.linear, GL_SRGB8, 0, (GLuint)levels.size(), 0, 1);
+    setSampling(out_pair.srgb);
+  }
+  else{
+    glGenTextures(1, &out_pair.linear);
+    setSampling(out_pair.linear);
+    uploadLevels(chain, levels, GL_RGB8);
+    glGenTextures(1, &out_pair.srgb);
+    setSampling(out_pair.srgb);
+    uploadLevels(chain, levels, GL_SRGB8);
+  }
+}
+
+static GLenum compressedFormat(BlockFormat format, bool srgb){
+  if (format == BLOCK_BC1)
+    return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+}
+
+static void uploadCompressedLevels(const unsigned char * blocks, const std::vector<MipLevel> & levels, GLenum internalFormat, bool allocated){
+  for (size_t l = 0; l < levels.size(); l++){
+    const MipLevel & level = levels[l];
+    if (allocated)
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)l, 0, 0, level.width, level.height, internalFormat, (GLsizei)level.size, blocks + level.offset);
+    else
+      glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)l, internalFormat, level.width, level.height, 0, (GLsizei)level.size, blocks + level.offset);
+  }
+}
+
+void createCompressedTexturePair(const unsigned char * blocks, const std::vector<MipLevel> & levels, BlockFormat format, TexturePair & out_pair){
+  GLenum linear = compressedFormat(format, false), srgb = compressedFormat(format, true);
+  if (GLEW_ARB_texture_storage && GLEW_ARB_texture_view){
+    // The linear and sRGB variants of a block format share a view class
+    glGenTextures(1, &out_pair.linear);
+    glBindTexture(GL_TEXTURE_2D, out_pair.linear);
+    glTexStorage2D(GL_TEXTURE_2D, (GLsizei)levels.size(), linear, levels[0].width, levels[0].height);
+    uploadCompressedLevels(blocks, levels, linear, true);
+    setSampling(out_pair.linear);
+
+    glGenTextures(1, &out_pair.srgb);
+    glTextureView(out_pair.srgb, GL_TEXTURE_2D, out_pair.linear, srgb, 0, (GLuint)levels.size(), 0, 1);
+    setSampling(out_pair.srgb);
+  }
+  else{
+    glGenTextures(1, &out_pair.linear);
+    setSampling(out_pair.linear);
+    uploadCompressedLevels(blocks, levels, linear, false);
+    glGenTextures(1, &out_pair.srgb);
+    setSampling(out_pair.srgb);
+    uploadCompressedLevels(blocks, levels, srgb, false);
+  }
+}
+
+static void uploadKTXLevels(const unsigned char * data, const std::vector<MipLevel> & levels, const KTXFormat & format, GLenum internalFormat, bool allocated){
+  for (size_t l = 0; l < levels.size(); l++){
+    const MipLevel & level = levels[l];
+    const unsigned char * pixels = data + level.offset;
+    if (format.compressed && allocated)
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)l, 0, 0, level.width, level.height, internalFormat, (GLsizei)level.size, pixels);
+    else if (format.compressed)
+      glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)l, internalFormat, level.width, level.height, 0, (GLsizei)level.size, pixels);
+    else if (allocated)
+      glTexSubImage2D(GL_TEXTURE_2D, (GLint)l, 0, 0, level.width, level.height, format.format, format.type, pixels);
+    else
+      glTexImage2D(GL_TEXTURE_2D, (GLint)l, internalFormat, level.width, level.height, 0, format.format, format.type, pixels);
+  }
+}
+
+void createKTXTexturePair(const unsigned char * data, const std::vector<MipLevel> & levels, const KTXFormat & format, bool generateMipmaps, TexturePair & out_pair){
+  GLsizei levelCount = generateMipmaps ? mipLevelCount(levels[0].width, levels[0].height) : (GLsizei)levels.size();
+  if (GLEW_ARB_texture_storage && GLEW_ARB_texture_view){
+    glGenTextures(1, &out_pair.linear);
+    glBindTexture(GL_TEXTURE_2D, out_pair.linear);
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, format.linearFormat, levels[0].width, levels[0].height);
+    uploadKTXLevels(data, levels, format, format.linearFormat, true);
+    setSampling(out_pair.linear);
+
+    glGenTextures(1, &out_pair.srgb);
+    glTextureView(out_pair.srgb, GL_TEXTURE_2D, out_pair.linear, format.srgbFormat, 0, levelCount, 0, 1);
+    setSampling(out_pair.srgb);
+
+    // Averaged in the color space the file says it is in
+    if (generateMipmaps){
+      glBindTexture(GL_TEXTURE_2D, format.srgb ? out_pair.srgb : out_pair.linear);
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
+  }
+  else{
+    GLuint * textures[2] = { &out_pair.linear, &out_pair.srgb };
+    GLenum internalFormats[2] = { format.linearFormat, format.srgbFormat };
+    for (int i = 0; i < 2; i++){
+      glGenTextures(1, textures[i]);
+      setSampling(*textures[i]);
+      uploadKTXLevels(data, levels, format, internalFormats[i], false);
+      if (generateMipmaps)
+        glGenerateMipmap(GL_TEXTURE_2D);
+      else
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1); // The file may stop short of 1x1
+    }
+  }
+}
+
+bool isKTXPath(const char * path){
+  const char * extension = strrchr(path, '.');
+  return extension && strcmp(extension, ".ktx") == 0;
+}
+
+void deleteTexturePair(const TexturePair & pair){
+  // A view keeps its storage alive until it is deleted too
+  glDeleteTextures(1, &pair.linear);
+  glDeleteTextures(1, &pair.srgb);
+}
+
+bool blockFormatSupported(BlockFormat format){
+  if (format == BLOCK_BC1)
+    return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB; // The sRGB DXT1 format comes with the latter
+  return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+}
+
+// What the texture cache holds
+enum TextureCacheBlock{
+  TEXTURE_CACHE_INFO,
+  TEXTURE_CACHE_BLOCKS
+};
+
+struct TextureCacheInfo{
+  unsigned int width, height;
+};
+
+std::string textureCachePath(const char * path, BlockFormat format){
+  return std::string(path) + (format == BLOCK_BC1 ? ".bc1.texcache" : ".bc7.texcache");
+}
+
+bool loadCompressedChain(const char * path, BlockFormat format, CompressedChain & out_chain){
+  std::string cachePath = textureCachePath(path, format);
+  unsigned int options = format | TEXTURE_CACHE_VERSION << 8;
+  std::vector<MipLevel> levels;
+
+  if (openMeshCache(cachePath.c_str(), path, options, out_chain.cache)){
+    const MeshCacheBlock * info = findMeshCacheBlock(out_chain.cache.blocks, TEXTURE_CACHE_INFO);
+    const MeshCacheBlock * blocks = findMeshCacheBlock(out_chain.cache.blocks, TEXTURE_CACHE_BLOCKS);
+    if (info && blocks && info->size == sizeof(TextureCacheInfo)){
+      const TextureCacheInfo * image = (const TextureCacheInfo *)info->data;
+      mipChainLayout(image->width, image->height, levels);
+      if (compressedChainLayout(levels, format, out_chain.levels) == blocks->size){
+        out_chain.blocks = (const unsigned char *)blocks->data;
+        return true;
+      }
+    }
+    printf("%s does not hold a mip chain, rebuilding it\n", cachePath.c_str());
+    closeMeshCache(out_chain.cache);
+  }
+
+  DecodedImage image;
+  if (!decodeBMP(path, image))
+    return false;
+  size_t chainSize = mipChainLayout(image.width, image.height, levels);
+  if (image.pixels.size() < levels[0].size){
+    printf("%s is shorter than its header says\n", path);
+    return false;
+  }
+  image.pixels.resize(chainSize);
+  generateMipChain(&image.pixels[0], &image.pixels[0], levels, 0);
+
+  out_chain.built.resize(compressedChainLayout(levels, format, out_chain.levels));
+  compressMipChain(&image.pixels[0], levels, format, &out_chain.built[0], out_chain.levels, 0);
+  out_chain.blocks = &out_chain.built[0];
+
+  // Not fatal : the next run compresses again
+  TextureCacheInfo info = { image.width, image.height };
+  std::vector<MeshCacheBlock> blocks;
+  MeshCacheBlock infoBlock = { TEXTURE_CACHE_INFO, &info, sizeof(info) };
+  blocks.push_back(infoBlock);
+  blocks.push_back(meshCacheBlock(TEXTURE_CACHE_BLOCKS, out_chain.built));
+  if (!writeMeshCache(cachePath.c_str(), path, options, blocks))
+    printf("%s could not be written\n", cachePath.c_str());
+  return true;
+}
+
+void closeCompressedChain(CompressedChain & chain){
+  closeMeshCache(chain.cache);
+  std::vector<unsigned char>().swap(chain.built);
+  chain.blocks = NULL;
+  chain.levels.clear();
+}
+
+bool loadTexturePair(TextureCache & cache, const char * path, TexturePair & out_pair){
+  std::map<std::string, TexturePair>::const_iterator found = cache.textures.find(path);
+  if (found != cache.textures.end()){
+    out_pair = found->second;
+    return true;
+  }
+
+  if (isKTXPath(path)){
+    KTXImage image;
+    if (!loadKTX(path, image))
+      return false;
+    bool supported = ktxFormatSupported(image.format);
+    if (supported)
+      createKTXTexturePair((const unsigned char *)image.file.data, image.levels, image.format, image.generateMipmaps, out_pair);
+    else
+      printf("%s is in a format this context can't sample\n", path);
+    closeKTX(image);
+    if (supported)
+      cache.textures[path] = out_pair;
+    return supported;
+  }
+
+  if (cache.options.compressed){
+    CompressedChain chain;
+    if (!loadCompressedChain(path, cache.options.blockFormat, chain))
+      return false;
+    createCompressedTexturePair(chain.blocks, chain.levels, cache.options.blockFormat, out_pair);
+    closeCompressedChain(chain);
+    cache.textures[path] = out_pair;
+    return true;
+  }
+
+  DecodedImage image;
+  if (!decodeBMP(path, image))
+    return false;
+  if (cache.options.cpuMipmaps){
+    // The levels go after level 0, in place
+    std::vector<MipLevel> levels;
+    size_t chainSize = mipChainLayout(image.width, image.height, levels);
+    if (image.pixels.size() < levels[0].size){
+      printf("%s is shorter than its header says\n", path);
+      return false;
+    }
+    image.pixels.resize(chainSize);
+    generateMipChain(&image.pixels[0], &image.pixels[0], levels, 0);
+    createTexturePairLevels(&image.pixels[0], levels, out_pair);
+  }
+  else
+    createTexturePair(image.width, image.height, &image.pixels[0], out_pair);
+  cache.textures[path] = out_pair;
+  return true;
+}
+
+void releaseTextureCache(TextureCache & cache){
+  std::map<std::string, TexturePair>::const_iterator it;
+  for (it = cache.textures.begin(); it != cache.textures.end(); ++it)
+    deleteTexturePair(it->second);
+  cache.textures.clear();
+}
@@ -0,0 +1,100 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+#include <map>
+#include <vector>
+#include <string>
+#include <GL/glew.h>
+
+#include "mipmap.h"
+#include "blockcompress.h"
+#include "meshcache.h"
+#include "ktx.h"
+
+// The demo samples every image both as plain RGB8 and as SRGB8, to compare. A
+// TextureCache decodes each file once, whatever it is asked for, and keeps both
+// textures of it.
+//
+// With ARB_texture_view (GL 4.3), both are views of one immutable allocation :
+// one upload, one mip chain, half the memory. The mip chain is built through the
+// sRGB view, so that it averages light, not encoded values. Without it, the
+// decoded image is uploaded twice, as loadBMP would.
+//
+// The mip chain can also come from generateMipChain, built in linear light on
+// the CPU and uploaded level by level : then it is the same on every driver, and
+// also right for the RGB8 copy. Or the chain can be block compressed, BC1 or
+// BC7, and kept in a cache file next to the image, so that later runs upload the
+// blocks straight from the mapped cache. KTX files come with their chain, and
+// say themselves whether they are sRGB : they are uploaded as they are.
+
+// The two ways to sample one image
+struct TexturePair{
+  GLuint linear; // GL_RGB8
+  GLuint srgb;   // GL_SRGB8
+};
+
+// Both textures of a width x height BGR image, mipmapped. pixels is an offset
+// instead when a GL_PIXEL_UNPACK_BUFFER is bound, like for glTexImage2D.
+void createTexturePair(unsigned int width, unsigned int height, const void * pixels, TexturePair & out_pair);
+
+// Same, with every level given, by generateMipChain's layout. chain is an
+// offset too when a GL_PIXEL_UNPACK_BUFFER is bound.
+void createTexturePairLevels(const unsigned char * chain, const std::vector<MipLevel> & levels, TexturePair & out_pair);
+
+// Same, block compressed. blocks is laid out by compressedChainLayout.
+void createCompressedTexturePair(const unsigned char * blocks, const std::vector<MipLevel> & levels, BlockFormat format, TexturePair & out_pair);
+
+// Same, from the levels of a KTX file at data, or an offset. The texture in the
+// file's own format gets the levels, the other one sees them through a view or
+// gets them too. generateMipmaps builds the chain from level 0.
+void createKTXTexturePair(const unsigned char * data, const std::vector<MipLevel> & levels, const KTXFormat & format, bool generateMipmaps, TexturePair & out_pair);
+
+// True when path ends with ".ktx"
+bool isKTXPath(const char * path);
+
+void deleteTexturePair(const TexturePair & pair);
+
+// True when the context samples format both as linear and as sRGB
+bool blockFormatSupported(BlockFormat format);
+
+// Bump whenever the compressor writes different blocks
+#define TEXTURE_CACHE_VERSION 2
+
+// A block compressed mip chain, mapped from its cache or just built
+struct CompressedChain{
+  MeshCache cache;                  // The mapped cache, when it was up to date
+  std::vector<unsigned char> built; // The blocks, when they had to be made
+  const unsigned char * blocks;
+  std::vector<MipLevel> levels;     // Laid out by compressedChainLayout
+};
+
+// Where the compressed chains of path go : next to it, with ".bc1.texcache" or
+// ".bc7.texcache" added
+std::string textureCachePath(const char * path, BlockFormat format);
+
+// The compressed chain of the BMP at path : from its cache when the image has
+// not changed since, else decoded, mipmapped with generateMipChain, compressed
+// on every core, and cached. No GL, any thread can call it.
+bool loadCompressedChain(const char * path, BlockFormat format, CompressedChain & out_chain);
+
+void closeCompressedChain(CompressedChain & chain);
+
+// How the textures are built
+struct TextureOptions{
+  bool cpuMipmaps;         // generateMipChain rather than glGenerateMipmap
+  bool compressed;         // Block compressed, mipmapped on the CPU
+  BlockFormat blockFormat; // Then, to that, which must be supported
+};
+
+struct TextureCache{
+  std::map<std::string, TexturePair> textures; // By path, as it was asked for
+  TextureOptions options;                       // Set before the first load
+};
+
+// The textures of the BMP or KTX file at path, read and uploaded the first time
+// only. False if it could not be read.
+bool loadTexturePair(TextureCache & cache, const char * path, TexturePair & out_pair);
+
+// Deletes every texture of the cache
+void releaseTextureCache(TextureCache & cache);
+
+#endif